@@ -0,0 +1,288 @@
+#include "IncrementalSearch.h"
+#include "TextBuffer.h"
+#include "regex/Regex.h"
+#include "regex/RegexCache.h"
+#include "regex/RegexException.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+/*
+** Return a regular expression matching "text" literally
+*/
+std::string literalExpression(const std::string &text) {
+	static const char Special[] = "()-[]<>{}.\\|^$*+?&";
+
+	std::string exp;
+	for (char ch : text) {
+		if (ch != '\0' && strchr(Special, ch)) {
+			exp += '\\';
+		}
+		exp += ch;
+	}
+
+	return exp;
+}
+
+bool sameChar(char a, char b, bool caseSense) {
+	return caseSense ? a == b : tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+}
+
+}
+
+IncrementalSearch::IncrementalSearch(TextBuffer *buffer, SearchType type) : buffer_(buffer), type_(type) {
+	buffer_->BufAddModifyCB(this);
+}
+
+IncrementalSearch::~IncrementalSearch() {
+	buffer_->BufRemoveModifyCB(this);
+}
+
+/*
+** Change the query.  A literal query that extends one kept from before is
+** found among its matches, a query typed before is taken back up as it was,
+** anything else is searched for from the start of the buffer, as far as one
+** chunk goes.
+*/
+bool IncrementalSearch::SetQuery(const std::string &query) {
+
+	/* Back off to the longest query kept that the new one begins with */
+	while (!levels_.empty() && query.compare(0, levels_.back().query.size(), levels_.back().query) != 0) {
+		levels_.pop_back();
+	}
+
+	if (!levels_.empty() && levels_.back().query == query) {
+		return levels_.back().regex != nullptr;
+	}
+
+	if (query.empty()) {
+		return true;
+	}
+
+	Level level;
+	level.query = query;
+	level.searchedTo = 0;
+
+	try {
+		const bool caseSense = (type_ == SEARCH_CASE_SENSE || type_ == SEARCH_REGEX);
+		level.regex = RegexCache::Compile(isLiteral() ? literalExpression(query).c_str() : query.c_str(), caseSense ? REDFLT_STANDARD : REDFLT_CASE_INSENSITIVE);
+	} catch (const RegexException &) {
+		levels_.push_back(std::move(level));
+		return false;
+	}
+
+	if (isLiteral() && !levels_.empty()) {
+		narrow(levels_.back(), &level);
+	} else {
+		search(&level, std::min(ScanChunk, buffer_->BufGetLength()));
+	}
+
+	levels_.push_back(std::move(level));
+	return true;
+}
+
+/*
+** Find the match nearest to "pos" in "direction".  Matches already known are
+** looked up, past the end of those the buffer is searched directly.
+*/
+bool IncrementalSearch::FindNext(int pos, Direction direction, SearchMatch *match) {
+
+	if (levels_.empty() || !levels_.back().regex) {
+		return false;
+	}
+
+	const Level &level = levels_.back();
+	const int length = buffer_->BufGetLength();
+	int start;
+	int end;
+
+	/* First known match beginning at or after pos */
+	auto it = std::lower_bound(level.matches.begin(), level.matches.end(), pos, [](const SearchMatch &m, int p) { return m.start < p; });
+
+	if (direction == Direction::Forward) {
+		if (it != level.matches.end()) {
+			*match = *it;
+			return true;
+		}
+
+		start = std::max(pos, level.searchedTo);
+		end = length;
+	} else {
+		if (pos <= level.searchedTo || level.searchedTo >= length) {
+			if (it == level.matches.begin()) {
+				return false;
+			}
+
+			*match = *--it;
+			return true;
+		}
+
+		start = level.searchedTo;
+		end = pos - 1;
+	}
+
+	if (start >= length) {
+		return false;
+	}
+
+	std::unique_ptr<RegexMatch> found(buffer_->BufSearchRE(*level.regex, start, end, direction, nullptr));
+	if (found) {
+		const Capture capture = found->capture(0);
+		match->start = buffer_->BufPositionOf(capture.start);
+		match->end = buffer_->BufPositionOf(capture.end);
+		return true;
+	}
+
+	/* Nothing in the part searched directly, a backward search goes on
+	   with the matches known before it */
+	if (direction == Direction::Backward && !level.matches.empty()) {
+		*match = level.matches.back();
+		return true;
+	}
+
+	return false;
+}
+
+/*
+** Search on for the current query, from where the last search stopped
+*/
+bool IncrementalSearch::Continue() {
+
+	if (Complete() || levels_.back().matches.size() >= MaxMatches) {
+		return false;
+	}
+
+	Level &level = levels_.back();
+	const int length = buffer_->BufGetLength();
+	search(&level, (length - level.searchedTo > ScanChunk) ? level.searchedTo + ScanChunk : length);
+
+	return !Complete() && level.matches.size() < MaxMatches;
+}
+
+bool IncrementalSearch::Complete() const {
+	return levels_.empty() || !levels_.back().regex || levels_.back().searchedTo >= buffer_->BufGetLength();
+}
+
+const std::vector<SearchMatch> &IncrementalSearch::Matches() const {
+	static const std::vector<SearchMatch> none;
+	return levels_.empty() ? none : levels_.back().matches;
+}
+
+const std::string &IncrementalSearch::Query() const {
+	static const std::string none;
+	return levels_.empty() ? none : levels_.back().query;
+}
+
+/*
+** Keep the matches of a literal query that no change can have touched, and
+** search again from there on.  Regular expressions may look any distance
+** ahead or behind, so they are searched again from the start.  The queries
+** typed before are dropped, they would all need the same treatment.
+*/
+void IncrementalSearch::bufferModified(const ModifyEvent *event) {
+
+	if (levels_.empty() || (event->nInserted == 0 && event->nDeleted == 0)) {
+		return;
+	}
+
+	levels_.erase(levels_.begin(), levels_.end() - 1);
+
+	Level &level = levels_.back();
+	const int cut = isLiteral() ? std::max(0, event->pos - static_cast<int>(level.query.size()) + 1) : 0;
+
+	if (level.searchedTo > cut) {
+		auto it = std::lower_bound(level.matches.begin(), level.matches.end(), cut, [](const SearchMatch &m, int p) { return m.start < p; });
+		level.matches.erase(it, level.matches.end());
+		level.searchedTo = cut;
+	}
+}
+
+bool IncrementalSearch::isLiteral() const {
+	return type_ == SEARCH_LITERAL || type_ == SEARCH_CASE_SENSE;
+}
+
+/*
+** Tell whether the buffer holds "text" at "pos", ignoring case unless the
+** search is case sensitive
+*/
+bool IncrementalSearch::matchesAt(int pos, const char *text, size_t length) const {
+
+	if (pos < 0 || pos + static_cast<int>(length) > buffer_->BufGetLength()) {
+		return false;
+	}
+
+	if (type_ == SEARCH_CASE_SENSE) {
+		return buffer_->BufCmp(pos, static_cast<int>(length), text) == 0;
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		if (!sameChar(buffer_->BufGetCharacter(pos + static_cast<int>(i)), text[i], false)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+** Fill in the matches of "to", which extends the literal query of "from",
+** by checking which of those of "from" go on with the added text
+*/
+void IncrementalSearch::narrow(const Level &from, Level *to) const {
+	const size_t extended = from.query.size();
+	const char *added = to->query.data() + extended;
+	const size_t addedLength = to->query.size() - extended;
+	const int length = static_cast<int>(to->query.size());
+
+	for (const SearchMatch &match : from.matches) {
+		if (matchesAt(match.start + static_cast<int>(extended), added, addedLength)) {
+			to->matches.push_back(SearchMatch{ match.start, match.start + length });
+		}
+	}
+
+	to->searchedTo = from.searchedTo;
+}
+
+/*
+** Search from where "level" got to up to "end", keeping at most MaxMatches
+** matches.  The regex search finds non-overlapping matches; where a literal
+** query can overlap itself, the places it occurs again inside a match found
+** are added, so that a longer query can be narrowed down from them.
+*/
+void IncrementalSearch::search(Level *level, int end) const {
+
+	const size_t room = MaxMatches - std::min(MaxMatches, level->matches.size());
+	const std::string &query = level->query;
+	const int length = static_cast<int>(query.size());
+
+	std::vector<int> shifts;
+	if (isLiteral()) {
+		for (int shift = 1; shift < length; ++shift) {
+			int i = 0;
+			while (i < length - shift && sameChar(query[shift + i], query[i], type_ == SEARCH_CASE_SENSE)) {
+				++i;
+			}
+
+			if (i == length - shift) {
+				shifts.push_back(shift);
+			}
+		}
+	}
+
+	std::vector<Capture> found;
+	level->searchedTo = buffer_->BufFindRE(*level->regex, level->searchedTo, end, nullptr, room, &found);
+
+	for (const Capture &capture : found) {
+		const int start = buffer_->BufPositionOf(capture.start);
+		level->matches.push_back(SearchMatch{ start, buffer_->BufPositionOf(capture.end) });
+
+		for (int shift : shifts) {
+			if (matchesAt(start + shift, query.data(), query.size())) {
+				level->matches.push_back(SearchMatch{ start + shift, start + shift + length });
+			}
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef INCREMENTAL_SEARCH_H_
+#define INCREMENTAL_SEARCH_H_
+
+#include "IBufferModifiedHandler.h"
+#include "regex/RegexMatch.h"
+#include "Types.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Regex;
+class TextBuffer;
+
+enum SearchType {
+	SEARCH_LITERAL,      // Literal text, ignoring case.
+	SEARCH_CASE_SENSE,   // Literal text.
+	SEARCH_REGEX,        // Regular expression.
+	SEARCH_REGEX_NOCASE  // Regular expression, ignoring case.
+};
+
+struct SearchMatch {
+	int start;
+	int end;
+};
+
+/* Find-as-you-type over a buffer. The session keeps the matches of the query
+   typed so far, from the start of the buffer up to how far it has searched.
+   When a literal query is extended, only the previous matches are checked for
+   the added text instead of searching again, and taking characters back off
+   returns to the matches kept for the shorter query. Everything else, regular
+   expressions included, is searched afresh. No step searches more than
+   'ScanChunk' characters or keeps more than 'MaxMatches' matches, so typing
+   stays responsive on any size of buffer: 'Continue' searches on from idle
+   time, and 'FindNext' searches past the end of what is known directly. */
+class IncrementalSearch : public IBufferModifiedHandler {
+public:
+	static const int    ScanChunk  = 4 * 1024 * 1024;
+	static const size_t MaxMatches = 1024 * 1024;
+
+public:
+	IncrementalSearch(TextBuffer *buffer, SearchType type);
+	~IncrementalSearch() override;
+
+private:
+	IncrementalSearch(const IncrementalSearch &) = delete;
+	IncrementalSearch &operator=(const IncrementalSearch &) = delete;
+
+public:
+	/**
+	 * @brief SetQuery - Makes 'query' the text being searched for.
+	 * @return false if it is not a valid regular expression (nothing matches it then).
+	 */
+	bool SetQuery(const std::string &query);
+
+	/**
+	 * @brief FindNext - Finds the first match beginning at or after 'pos', or the last one beginning before it.
+	 * @return false if there is none, the search does not wrap around.
+	 */
+	bool FindNext(int pos, Direction direction, SearchMatch *match);
+
+	/**
+	 * @brief Continue - Searches up to 'ScanChunk' more characters for matches of the current query.
+	 * @return true if it can search further, false once it is complete or holds 'MaxMatches' matches.
+	 */
+	bool Continue();
+
+	// True once every match in the buffer is known.
+	bool Complete() const;
+
+	// The matches known so far, in order of their start.
+	const std::vector<SearchMatch> &Matches() const;
+
+	const std::string &Query() const;
+
+public:
+	void bufferModified(const ModifyEvent *event) override;
+
+private:
+	/* The matches of one query, for the part of the buffer before 'searchedTo'.
+	   Literal queries keep every position the query occurs at, overlapping or
+	   not; regular expressions keep their non-overlapping matches. */
+	struct Level {
+		std::string                  query;
+		std::shared_ptr<const Regex> regex;
+		std::vector<SearchMatch>     matches;
+		int                          searchedTo;
+	};
+
+private:
+	bool isLiteral() const;
+	bool matchesAt(int pos, const char *text, size_t length) const;
+	void narrow(const Level &from, Level *to) const;
+	void search(Level *level, int end) const;
+
+private:
+	TextBuffer *       buffer_;
+	SearchType         type_;
+	std::vector<Level> levels_; // Each query extending the one before, the current one last.
+};
+
+#endif
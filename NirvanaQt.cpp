@@ -166,6 +166,7 @@ NirvanaQt::NirvanaQt(QWidget *parent)
 
     buffer_ = new TextBuffer();
     syntaxHighlighter_ = new SyntaxHighlighter();
+    connect(syntaxHighlighter_, SIGNAL(stylesChanged(int, int)), this, SLOT(syntaxHighlighter_stylesChanged(int, int)));
     absTopLineNum_ = 1;
     anchor_ = -1;
     autoIndent_ = false;
@@ -209,7 +210,6 @@ NirvanaQt::NirvanaQt(QWidget *parent)
     suppressResync_ = false;
     topLineNum_ = 1;
     top_ = 0;
-    unfinishedStyle_ = ASCII_A;
     wrapMargin_ = 0;
     modifyingTabDist_ = false;
     matchSyntaxBased_ = false;
@@ -233,8 +233,6 @@ NirvanaQt::NirvanaQt(QWidget *parent)
     if (buffer_) {
 
         if (syntaxHighlighter_) {
-            highlightHandlers_.push_back(syntaxHighlighter_);
-
             buffer_->BufAddModifyCB(syntaxHighlighter_); // TODO(eteran): move this to
                                                          // the SyntaxHighlighter
                                                          // contructor?
@@ -254,6 +252,7 @@ NirvanaQt::NirvanaQt(QWidget *parent)
 // Name: ~NirvanaQt
 //------------------------------------------------------------------------------
 NirvanaQt::~NirvanaQt() {
+    delete syntaxHighlighter_;
     delete buffer_;
 }
 
@@ -1161,7 +1160,7 @@ int NirvanaQt::styleOfPos(int lineStartPos, int lineLen, int lineIndex, int disp
 
     int pos;
     int style = 0;
-    TextBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
+    StyleBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
 
     if (lineStartPos == -1 || !buffer_) {
         return FILL_MASK;
@@ -1172,12 +1171,9 @@ int NirvanaQt::styleOfPos(int lineStartPos, int lineLen, int lineIndex, int disp
     if (lineIndex >= lineLen) {
         style = FILL_MASK;
     } else if (styleBuffer) {
+        /* "unfinished" styles, text the highlighter hasn't got to yet, are
+           drawn plain until it has */
         style = static_cast<unsigned char>(styleBuffer->BufGetCharacter(pos));
-        if (style == unfinishedStyle_) {
-            /* encountered "unfinished" style, trigger parsing */
-            emitUnfinishedHighlightEncountered(pos);
-            style = static_cast<unsigned char>(styleBuffer->BufGetCharacter(pos));
-        }
     }
 
     if (inSelection(&buffer_->BufGetPrimarySelection(), pos, lineStartPos, dispIndex)) {
@@ -1983,7 +1979,7 @@ bool NirvanaQt::emptyLinesVisible() {
 int NirvanaQt::measurePropChar(char_type c, int colNum, int pos) {
     int style;
     char_type expChar[MAX_EXP_CHAR_LEN];
-    TextBuffer *styleBuf = syntaxHighlighter_->styleBuffer();
+    StyleBuffer *styleBuf = syntaxHighlighter_->styleBuffer();
 
     int charLen =
         TextBuffer::BufExpandCharacter(c, colNum, expChar, buffer_->BufGetTabDistance(), buffer_->BufGetNullSubsChar());
@@ -1991,11 +1987,6 @@ int NirvanaQt::measurePropChar(char_type c, int colNum, int pos) {
         style = 0;
     } else {
         style = (unsigned char)styleBuf->BufGetCharacter(pos);
-        if (style == unfinishedStyle_) {
-            /* encountered "unfinished" style, trigger parsing */
-            emitUnfinishedHighlightEncountered(pos);
-            style = (unsigned char)styleBuf->BufGetCharacter(pos);
-        }
     }
 
     return stringWidth(expChar, charLen, style);
@@ -2811,7 +2802,7 @@ void NirvanaQt::bufferModified(const ModifyEvent *event) {
     int wrapModStart;
     int wrapModEnd;
 
-    TextBuffer *const styleBuffer = syntaxHighlighter_->styleBuffer();
+    StyleBuffer *const styleBuffer = syntaxHighlighter_->styleBuffer();
 
     /* buffer modification cancels vertical cursor motion column */
     if (nInserted != 0 || nDeleted != 0) {
@@ -3268,7 +3259,7 @@ void NirvanaQt::TextDRedisplayRect(int left, int top, int width, int height) {
 */
 void NirvanaQt::extendRangeForStyleMods(int *start, int *end) {
 
-    TextBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
+    StyleBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
     Selection *sel = &styleBuffer->BufGetPrimarySelection();
     bool extended = false;
 
@@ -4458,7 +4449,7 @@ int NirvanaQt::measureVisLine(int visLineNum) {
     int charCount = 0;
     int lineStartPos = lineStarts_[visLineNum];
     char_type expandedChar[MAX_EXP_CHAR_LEN];
-    TextBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
+    StyleBuffer *styleBuffer = syntaxHighlighter_->styleBuffer();
 
     if (styleBuffer == nullptr) {
         for (int i = 0; i < lineLen; i++) {
@@ -4660,6 +4651,10 @@ void NirvanaQt::processTabAP() {
     buffer_->BufUnselect();
 }
 
+void NirvanaQt::syntaxHighlighter_stylesChanged(int start, int end) {
+    textDRedisplayRange(start, end);
+}
+
 void NirvanaQt::verticalScrollBar_valueChanged(int value) {
     const int newValue = value + 1;
     const int lineDelta = newValue - topLineNum_;
@@ -5503,17 +5498,6 @@ void NirvanaQt::emitCursorMoved() {
     }
 }
 
-void NirvanaQt::emitUnfinishedHighlightEncountered(int pos) {
-
-    HighlightEvent event;
-    event.buffer = buffer_;
-    event.pos = pos;
-
-    for (IHighlightHandler *handler : highlightHandlers_) {
-        handler->unfinishedHighlightEncountered(&event);
-    }
-}
-
 /*
 ** Cancel a block drag operation
 */
@@ -7,7 +7,6 @@
 #include "ICursorMoveHandler.h"
 #include "IBufferModifiedHandler.h"
 #include "IPreDeleteHandler.h"
-#include "IHighlightHandler.h"
 #include <QAbstractScrollArea>
 #include <QList>
 
@@ -91,6 +90,7 @@ private Q_SLOTS:
 	void verticalScrollBar_valueChanged(int value);
 	void horizontalScrollBar_valueChanged(int value);
 	void customContextMenuRequested(const QPoint &pos);
+	void syntaxHighlighter_stylesChanged(int start, int end);
 
 public Q_SLOTS:
 	void shiftRight();
@@ -247,7 +247,6 @@ private:
 	void drawCursor(QPainter *painter, int x, int y);
 	void drawString(QPainter *painter, int style, int x, int y, int toX, char_type *string, int nChars);
 	void emitCursorMoved();
-	void emitUnfinishedHighlightEncountered(int pos);
 	void endDrag();
 	void endDragAP();
 	void endOfFileAP(MoveMode mode);
@@ -317,7 +316,6 @@ private:
 	int firstChar_;
 	int lastChar_;
 	bool continuousWrap_;
-	char_type unfinishedStyle_;
 	int cursorX_;
 	int cursorY_;
 	bool cursorOn_;
@@ -373,7 +371,6 @@ private:
 	QTimer *autoScrollTimer_;
 	int clickCount_;
 	QPoint clickPos_;
-	QList<IHighlightHandler *> highlightHandlers_;
 	QList<ICursorMoveHandler *> cursorMoveHandlers_;
 	SyntaxHighlighter *syntaxHighlighter_;
 };
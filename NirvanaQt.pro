@@ -17,16 +17,24 @@ linux-g++ {
     DEFINES += _CRT_SECURE_NO_WARNINGS _SCL_SECURE_NO_WARNINGS
 }
 
+# qmake CONFIG+=regex_profile counts the work done by every regex search and
+# reports the most expensive highlight patterns of each document loaded.
+regex_profile {
+    DEFINES += REGEX_PROFILE
+}
+
 
 
 HEADERS += \
     NirvanaQt.h   \
     TextBuffer.h \
+    IncrementalSearch.h \
     Selection.h     \
     ICursorMoveHandler.h \
     IHighlightHandler.h \
     IBufferModifiedHandler.h \
     SyntaxHighlighter.h \
+    StyleBuffer.h \
     IPreDeleteHandler.h \
     X11Colors.h \
     Types.h \
@@ -34,6 +42,12 @@ HEADERS += \
 	regex/RegexMatch.h \
 	regex/RegexException.h \
 	regex/RegexCommon.h \
+	regex/RegexProfile.h \
+	regex/RegexCache.h \
+	regex/RegexSet.h \
+	regex/RegexIterator.h \
+	regex/RegexParallelSearch.h \
+	regex/RegexAnalysis.h \
     QJson4/QJsonArray.h \
     QJson4/QJsonDocument.h \
     QJson4/QJsonObject.h \
@@ -47,12 +61,20 @@ SOURCES += \
     main.cpp          \
     NirvanaQt.cpp   \
     TextBuffer.cpp \
+    IncrementalSearch.cpp \
     Selection.cpp \
     SyntaxHighlighter.cpp \
+    StyleBuffer.cpp \
     X11Colors.cpp \
     regex/Regex.cpp \
 	regex/RegexMatch.cpp \	
 	regex/RegexCommon.cpp \
+	regex/RegexProfile.cpp \
+	regex/RegexCache.cpp \
+	regex/RegexSet.cpp \
+	regex/RegexIterator.cpp \
+	regex/RegexParallelSearch.cpp \
+	regex/RegexAnalysis.cpp \
     QJson4/QJsonArray.cpp \
     QJson4/QJsonDocument.cpp \
     QJson4/QJsonObject.cpp \
@@ -0,0 +1,378 @@
+
+#include "StyleBuffer.h"
+#include <algorithm>
+
+namespace {
+
+/*
+** Move a selection along with a change to the styles, the way TextBuffer
+** moves its selections along with changes to the text
+*/
+void updateSelection(Selection *sel, int pos, int nDeleted, int nInserted) {
+	if ((!sel->selected && !sel->zeroWidth) || pos > sel->end) {
+		return;
+	}
+
+	if (pos + nDeleted <= sel->start) {
+		sel->start += nInserted - nDeleted;
+		sel->end += nInserted - nDeleted;
+	} else if (pos <= sel->start && pos + nDeleted >= sel->end) {
+		sel->start = pos;
+		sel->end = pos;
+		sel->selected = false;
+		sel->zeroWidth = false;
+	} else if (pos <= sel->start && pos + nDeleted < sel->end) {
+		sel->start = pos;
+		sel->end = nInserted + sel->end - nDeleted;
+	} else if (pos < sel->end) {
+		sel->end += nInserted - nDeleted;
+		if (sel->end <= sel->start)
+			sel->selected = false;
+	}
+}
+
+}
+
+StyleBuffer::StyleBuffer() : root_(nullptr), seed_(2463534242u), cachedStart_(0), cachedEnd_(0), cachedStyle_(_T('\0')) {
+}
+
+StyleBuffer::~StyleBuffer() {
+	destroy(root_);
+}
+
+Selection &StyleBuffer::BufGetPrimarySelection() {
+	return primary_;
+}
+
+int StyleBuffer::BufGetLength() const {
+	return total(root_);
+}
+
+char_type StyleBuffer::BufGetCharacter(int pos) const {
+	if (pos < 0 || pos >= BufGetLength()) {
+		return '\0';
+	}
+
+	if (pos >= cachedStart_ && pos < cachedEnd_) {
+		return cachedStyle_;
+	}
+
+	int runStart;
+	const Block *block = findBlock(pos, &runStart);
+
+	for (const StyleRun &run : block->runs) {
+		if (pos < runStart + run.length) {
+			cachedStart_ = runStart;
+			cachedEnd_   = runStart + run.length;
+			cachedStyle_ = run.style;
+			break;
+		}
+		runStart += run.length;
+	}
+
+	return cachedStyle_;
+}
+
+/*
+** Return the styles from "start" to "end" as a string, the same way
+** TextBuffer::BufGetRange returns text
+*/
+String StyleBuffer::BufGetRange(int start, int end) const {
+	const int length = BufGetLength();
+
+	if (start < 0 || start > length) {
+		auto text = new char_type[1];
+		text[0] = '\0';
+		return String(text, 0);
+	}
+
+	if (end < start) {
+		std::swap(start, end);
+	}
+
+	end = std::min(end, length);
+
+	auto text = new char_type[end - start + 1];
+	char_type *p = text;
+	for (const StyleRun &run : BufGetRuns(start, end)) {
+		p = std::fill_n(p, run.length, run.style);
+	}
+	*p = '\0';
+
+	return String(text, end - start);
+}
+
+std::vector<StyleRun> StyleBuffer::BufGetRuns(int start, int end) const {
+	std::vector<StyleRun> runs;
+	collectRuns(root_, 0, std::max(start, 0), std::min(end, BufGetLength()), &runs);
+	return runs;
+}
+
+int StyleBuffer::BufCmp(int pos, int len, const char_type *cmpText) const {
+	if (pos + len > BufGetLength()) {
+		return 1;
+	}
+
+	if (pos < 0) {
+		return -1;
+	}
+
+	for (const StyleRun &run : BufGetRuns(pos, pos + len)) {
+		for (int i = 0; i < run.length; ++i, ++cmpText) {
+			if (*cmpText != run.style) {
+				return traits_type::lt(run.style, *cmpText) ? -1 : 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void StyleBuffer::BufRemove(int start, int end) {
+	if (start > end) {
+		std::swap(start, end);
+	}
+
+	const int length = BufGetLength();
+	start = std::max(0, std::min(start, length));
+	end   = std::max(0, std::min(end, length));
+
+	BufReplace(start, end, std::vector<StyleRun>());
+}
+
+void StyleBuffer::BufReplace(int start, int end, const char_type *text) {
+	const int length = static_cast<int>(traits_type::length(text));
+	BufReplace(start, end, text, length);
+}
+
+void StyleBuffer::BufReplace(int start, int end, const char_type *text, int length) {
+	std::vector<StyleRun> runs;
+	for (int i = 0; i < length; ++i) {
+		appendRun(&runs, 1, text[i]);
+	}
+
+	BufReplace(start, end, runs);
+}
+
+void StyleBuffer::BufSelect(int start, int end) {
+	primary_.selected    = start != end;
+	primary_.zeroWidth   = start == end;
+	primary_.rectangular = false;
+	primary_.start       = std::min(start, end);
+	primary_.end         = std::max(start, end);
+}
+
+void StyleBuffer::BufUnselect() {
+	primary_.selected  = false;
+	primary_.zeroWidth = false;
+}
+
+/*
+** Replace the styles from "start" to "end" with "runs".  The blocks the change
+** falls in, and the one after them (to keep blocks from getting ever smaller),
+** are taken out of the tree, and their runs, with the change made, are shared
+** out over as few new blocks as will hold them.
+*/
+void StyleBuffer::BufReplace(int start, int end, const std::vector<StyleRun> &runs) {
+	Block *before;
+	Block *changed;
+	Block *after;
+
+	split(root_, start, &before, &changed);
+	const int changedStart = total(before);
+	split(changed, end - changedStart, &changed, &after);
+	changed = merge(changed, takeFirst(&after));
+	const int changedEnd = changedStart + total(changed);
+
+	std::vector<StyleRun> merged;
+	collectRuns(changed, changedStart, changedStart, start, &merged);
+	for (const StyleRun &run : runs) {
+		appendRun(&merged, run.length, run.style);
+	}
+	std::vector<StyleRun> rest;
+	collectRuns(changed, changedStart, end, changedEnd, &rest);
+	for (const StyleRun &run : rest) {
+		appendRun(&merged, run.length, run.style);
+	}
+	destroy(changed);
+
+	const size_t nBlocks = (merged.size() + MaxBlockRuns - 1) / MaxBlockRuns;
+	Block *middle = nullptr;
+	for (size_t i = 0; i < nBlocks; ++i) {
+		auto block      = new Block;
+		block->runs.assign(merged.begin() + merged.size() * i / nBlocks, merged.begin() + merged.size() * (i + 1) / nBlocks);
+		block->length   = 0;
+		block->priority = nextPriority();
+		block->left     = nullptr;
+		block->right    = nullptr;
+		for (const StyleRun &run : block->runs) {
+			block->length += run.length;
+		}
+		update(block);
+		middle = merge(middle, block);
+	}
+
+	root_ = merge(merge(before, middle), after);
+
+	int nInserted = 0;
+	for (const StyleRun &run : runs) {
+		nInserted += run.length;
+	}
+
+	/* As TextBuffer does it, a deletion followed by an insertion */
+	updateSelection(&primary_, start, end - start, 0);
+	updateSelection(&primary_, start, 0, nInserted);
+	cachedStart_ = 0;
+	cachedEnd_   = 0;
+}
+
+/*
+** Find the block holding the character at "pos", and where it begins
+*/
+StyleBuffer::Block *StyleBuffer::findBlock(int pos, int *blockStart) const {
+	Block *block = root_;
+	int offset = 0;
+
+	while (block) {
+		const int before = offset + total(block->left);
+		if (pos < before) {
+			block = block->left;
+		} else if (pos < before + block->length) {
+			*blockStart = before;
+			return block;
+		} else {
+			offset = before + block->length;
+			block = block->right;
+		}
+	}
+
+	return nullptr;
+}
+
+uint32_t StyleBuffer::nextPriority() {
+	seed_ ^= seed_ << 13;
+	seed_ ^= seed_ >> 17;
+	seed_ ^= seed_ << 5;
+	return seed_;
+}
+
+/*
+** Split "tree" into the blocks ending at or before "pos" and the rest
+*/
+void StyleBuffer::split(Block *tree, int pos, Block **left, Block **right) {
+	if (!tree) {
+		*left  = nullptr;
+		*right = nullptr;
+		return;
+	}
+
+	const int before = total(tree->left);
+	if (before + tree->length <= pos) {
+		split(tree->right, pos - before - tree->length, &tree->right, right);
+		*left = tree;
+	} else {
+		split(tree->left, pos, left, &tree->left);
+		*right = tree;
+	}
+
+	update(tree);
+}
+
+/*
+** Join two trees, all of "left" coming before all of "right"
+*/
+StyleBuffer::Block *StyleBuffer::merge(Block *left, Block *right) {
+	if (!left) {
+		return right;
+	}
+
+	if (!right) {
+		return left;
+	}
+
+	if (left->priority > right->priority) {
+		left->right = merge(left->right, right);
+		update(left);
+		return left;
+	}
+
+	right->left = merge(left, right->left);
+	update(right);
+	return right;
+}
+
+/*
+** Take the first block out of "tree"
+*/
+StyleBuffer::Block *StyleBuffer::takeFirst(Block **tree) {
+	Block *block = *tree;
+	if (!block) {
+		return nullptr;
+	}
+
+	if (block->left) {
+		Block *first = takeFirst(&block->left);
+		update(block);
+		return first;
+	}
+
+	*tree = block->right;
+	block->right = nullptr;
+	update(block);
+	return block;
+}
+
+/*
+** Append the parts of the runs of "block" and the blocks below it between
+** "start" and "end" to "runs", "offset" being where the first of them begins
+*/
+void StyleBuffer::collectRuns(const Block *block, int offset, int start, int end, std::vector<StyleRun> *runs) {
+	if (!block || start >= end || offset >= end || offset + block->total <= start) {
+		return;
+	}
+
+	collectRuns(block->left, offset, start, end, runs);
+
+	int runStart = offset + total(block->left);
+	for (const StyleRun &run : block->runs) {
+		if (runStart >= end) {
+			return;
+		}
+
+		const int runEnd = runStart + run.length;
+		if (runEnd > start) {
+			appendRun(runs, std::min(runEnd, end) - std::max(runStart, start), run.style);
+		}
+		runStart = runEnd;
+	}
+
+	collectRuns(block->right, runStart, start, end, runs);
+}
+
+void StyleBuffer::appendRun(std::vector<StyleRun> *runs, int length, char_type style) {
+	if (length <= 0) {
+		return;
+	}
+
+	if (!runs->empty() && runs->back().style == style) {
+		runs->back().length += length;
+	} else {
+		runs->push_back(StyleRun{ length, style });
+	}
+}
+
+void StyleBuffer::destroy(Block *block) {
+	if (block) {
+		destroy(block->left);
+		destroy(block->right);
+		delete block;
+	}
+}
+
+int StyleBuffer::total(const Block *block) {
+	return block ? block->total : 0;
+}
+
+void StyleBuffer::update(Block *block) {
+	block->total = total(block->left) + block->length + total(block->right);
+}
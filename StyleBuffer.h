@@ -0,0 +1,89 @@
+#ifndef STYLE_BUFFER_H_
+#define STYLE_BUFFER_H_
+
+#include "Types.h"
+#include "Selection.h"
+#include "TextBuffer.h"
+#include <cstdint>
+#include <vector>
+
+/* A stretch of characters in one style */
+struct StyleRun {
+	int       length;
+	char_type style;
+};
+
+/* The highlight style of every character of a text buffer, kept as runs of
+   characters in the same style, so that it takes memory in proportion to the
+   number of style changes rather than to the length of the text. The runs are
+   held in blocks of up to 'MaxBlockRuns', and the blocks in a tree ordered by
+   position (a treap, in which each block knows the length of its subtree), so
+   finding a position, and moving everything after an edit along, is O(log n).
+   It has the parts of the TextBuffer interface the highlighter and the display
+   use, including the primary selection, which marks the styles changed since
+   the display last drew them (see NirvanaQt::extendRangeForStyleMods). */
+class StyleBuffer {
+public:
+	static const int MaxBlockRuns = 64;
+
+public:
+	StyleBuffer();
+	~StyleBuffer();
+
+private:
+	StyleBuffer(const StyleBuffer &) = delete;
+	StyleBuffer &operator=(const StyleBuffer &) = delete;
+
+public:
+	Selection &BufGetPrimarySelection();
+	String BufGetRange(int start, int end) const;
+	char_type BufGetCharacter(int pos) const;
+	int BufCmp(int pos, int len, const char_type *cmpText) const;
+	int BufGetLength() const;
+	void BufRemove(int start, int end);
+	void BufReplace(int start, int end, const char_type *text);
+	void BufReplace(int start, int end, const char_type *text, int length);
+	void BufReplace(int start, int end, const std::vector<StyleRun> &runs);
+	void BufSelect(int start, int end);
+	void BufUnselect();
+
+	// The runs between 'start' and 'end', the first and last cut to fit.
+	std::vector<StyleRun> BufGetRuns(int start, int end) const;
+
+private:
+	struct Block {
+		std::vector<StyleRun> runs;
+		int                   length;   // Characters in this block.
+		int                   total;    // Characters in this block and the ones below it.
+		uint32_t              priority; // Higher than that of any block below it.
+		Block                *left;
+		Block                *right;
+	};
+
+private:
+	Block *findBlock(int pos, int *blockStart) const;
+	uint32_t nextPriority();
+
+private:
+	static Block *merge(Block *left, Block *right);
+	static Block *takeFirst(Block **tree);
+	static int total(const Block *block);
+	static void appendRun(std::vector<StyleRun> *runs, int length, char_type style);
+	static void collectRuns(const Block *block, int offset, int start, int end, std::vector<StyleRun> *runs);
+	static void destroy(Block *block);
+	static void split(Block *tree, int pos, Block **left, Block **right);
+	static void update(Block *block);
+
+private:
+	Block *           root_;
+	Selection         primary_;
+	uint32_t          seed_;
+
+	/* The run the last character looked up was in. The display looks up the
+	   characters of a line one after the other, mostly in the same run */
+	mutable int       cachedStart_;
+	mutable int       cachedEnd_;
+	mutable char_type cachedStyle_;
+};
+
+#endif
@@ -5,18 +5,23 @@
 #include "QJson4/QJsonObject.h"
 #include "QJson4/QJsonParseError.h"
 #include "TextBuffer.h"
+#include "regex/RegexAnalysis.h"
+#include "regex/RegexCache.h"
+#include "regex/RegexSet.h"
 #include "X11Colors.h"
 #include <QDomDocument>
 #include <QFile>
 #include <QMap>
 #include <QMessageBox>
 #include <QRegExp>
+#include <QTimer>
 #include <QtDebug>
 #include <QtGlobal>
 #include <algorithm>
 #include <climits>
 #include <cstring>
 #include <fstream>
+#include <string>
 #include <cassert>
 
 
@@ -36,6 +41,33 @@ const int MAX_TITLE_FORMAT_LEN  = 50;
 /* How much re-parsing to do when an unfinished style is encountered */
 const int PASS_2_REPARSE_CHUNK_SIZE = 1000;
 
+/* Number of patterns listed by the regex profile report */
+const int PROFILE_REPORT_SIZE = 10;
+
+/* Changes are re-parsed while the user waits as long as the styles they
+   change stay within this distance of them, insertions larger than this
+   (loading a file, pasting) and longer cascades are left to the background
+   worker */
+const int SYNC_REPARSE_LIMIT = 64 * 1024;
+
+/* How much of the document the background worker highlights at a time.  The
+   text of a window is copied for the worker, and its styles are published
+   in one piece when it is done */
+const int BACKGROUND_WINDOW_SIZE = 256 * 1024;
+
+/* A new document is split into as many chunks as there are processors,
+   but none smaller than this, and they are all highlighted at once as if
+   each began outside of any pattern.  The chunks are then checked in order,
+   the parse going on from one into the next until it agrees with what was
+   found for it, which at a line start outside of any pattern is at once */
+const int SPECULATIVE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+/* Pass 1 parsing records where it could be resumed exactly (ParseCheckpoint)
+   at a line start every PARSE_CHECKPOINT_LINES lines, or anywhere between
+   matches if it has gone PARSE_CHECKPOINT_CHARS characters without one */
+const int PARSE_CHECKPOINT_LINES = 64;
+const int PARSE_CHECKPOINT_CHARS = 4096;
+
 /* Initial forward expansion of parsing region in incremental reparsing,
    when style changes propagate forward beyond the original modification.
    This distance is increased by a factor of two for each subsequent step. */
@@ -65,6 +97,20 @@ bool isStyled(char_type style) {
 }
 const char_type delimiters[] = _T(".,/\\`'!|@#%^&*()-=+{}[]\":;<>?~ \t\n");
 
+/*
+** Return where "position" ends up after "nDeleted" characters at "pos" are
+** replaced by "nInserted" new ones.  Positions within the replaced text move
+** to its start.
+*/
+int shiftPosition(int position, int pos, int nDeleted, int nInserted) {
+    if (position >= pos + nDeleted) {
+        return position + nInserted - nDeleted;
+    } else if (position > pos) {
+        return pos;
+    }
+    return position;
+}
+
 /*
 ** Get the character before position "pos" in buffer "buf"
 */
@@ -72,6 +118,67 @@ char_type getPrevChar(TextBuffer *buf, int pos) {
 	return pos == 0 ? _T('\0') : buf->BufGetCharacter(pos - 1);
 }
 
+/*
+** Compare two lists of style runs for the same stretch of text, from
+** "offset" characters in on
+*/
+bool sameStyles(const std::vector<StyleRun> &a, const std::vector<StyleRun> &b, int offset) {
+    auto i = a.begin();
+    int skipA = offset;
+    while (i != a.end() && i->length <= skipA) {
+        skipA -= i->length;
+        ++i;
+    }
+
+    auto j = b.begin();
+    int skipB = offset;
+    while (j != b.end() && j->length <= skipB) {
+        skipB -= j->length;
+        ++j;
+    }
+
+    if (a.end() - i != b.end() - j) {
+        return false;
+    }
+
+    /* Runs of the same style are always merged, so equal styles make equal runs */
+    for (; i != a.end(); ++i, ++j, skipA = 0, skipB = 0) {
+        if (i->style != j->style || i->length - skipA != j->length - skipB) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+** Warn about an expression of a pattern that can take exponential time, so
+** that it is caught when the language definitions are loaded instead of when
+** a user opens the file that triggers it.  Expressions that don't compile are
+** reported once the pattern set is used.
+*/
+void warnIfCostly(const QString &patternName, const QString &re) {
+    if (re.isNull()) {
+        return;
+    }
+
+    try {
+#ifdef USE_WCHAR
+        std::shared_ptr<const Regex> regex = RegexCache::Compile(re.toStdWString().c_str(), REDFLT_STANDARD);
+#else
+        std::shared_ptr<const Regex> regex = RegexCache::Compile(re.toStdString().c_str(), REDFLT_STANDARD);
+#endif
+        const RegexCost cost = RegexAnalysis::Cost(*regex);
+
+        if (cost.exponential) {
+            for (const RegexHazard &hazard : cost.hazards) {
+                qDebug("highlight pattern '%s': %s", qPrintable(patternName), hazard.description.c_str());
+            }
+        }
+    } catch (const std::exception &) {
+    }
+}
+
 }
 
 struct LanguageModeRec {
@@ -117,25 +224,24 @@ struct PatternSet {
 /* "Compiled" version of pattern specification */
 struct HighlightDataRecord {
 
-	HighlightDataRecord() : startRE(nullptr), endRE(nullptr), errorRE(nullptr), subPatternRE(nullptr), style(0),
+	HighlightDataRecord() : style(0),
 		colorOnly(false), flags(0), userStyleIndex(0) {
 
 	}
 
 
 
-	// Returns non-zero if the string matched any of the sub-patterns, and if so, will set *top_branch to the index of the one which matched
-	// otherwise returns zero
-	RegexMatch *exec(const char_type *string, const char_type *end, Direction direction, char_type prev_char, char_type succ_char, const char_type *delimiters, const char_type *look_behind_to, const char_type *match_to) const {
-		return subPatternRE->ExecRE(string, end, direction, prev_char, succ_char, delimiters, look_behind_to, match_to);
-
+	// Returns the match if the string matched the end, error or any of the sub-pattern start patterns, and if so, will set
+	// *pattern_id to the index of the one which matched, otherwise returns nullptr. "scan" carries what earlier searches
+	// of the same text found (see RegexSet::Scan)
+	RegexMatch *exec(const char_type *string, const char_type *end, char_type prev_char, char_type succ_char, const char_type *delimiters, const char_type *look_behind_to, const char_type *match_to, int *pattern_id, RegexSet::Scan *scan) const {
+		return subPatternSet.ExecRE(string, end, prev_char, succ_char, delimiters, look_behind_to, match_to, pattern_id, scan);
 	}
 
-	Regex *                        startRE;
-	Regex *                        endRE;
-	Regex *                        errorRE;
-	Regex *                        subPatternRE;
-	QVector<Regex *>               subPatternsRE;
+	std::shared_ptr<const Regex>          startRE;
+	std::shared_ptr<const Regex>          endRE;
+	std::shared_ptr<const Regex>          errorRE;
+	RegexSet                              subPatternSet;
 	char_type                      style;
 	bool                           colorOnly;
 	QVector<int>                   startSubexprs;
@@ -154,8 +260,124 @@ struct HighlightData {
 	ReparseContext      contextRequirements;
 	StyleTableEntry     *styleTable;
 	int                 nStyles;
-	TextBuffer          *styleBuffer;
+	StyleBuffer         *styleBuffer;
 	PatternSet          *patternSetForWindow;
+	std::vector<ParseCheckpoint> checkpoints; // In order of position.
+};
+
+/* Collects checkpoints during pass 1 parsing.  parseString reports each
+   stretch of text it passes over between matches, with the style of the
+   pattern it is parsing, and checkpoints are taken there at the positions
+   of the previous ones (so that the states can be compared), and otherwise
+   as often as PARSE_CHECKPOINT_LINES and PARSE_CHECKPOINT_CHARS call for */
+struct CheckpointRecorder {
+	CheckpointRecorder(const ParseCheckpoint *first, const ParseCheckpoint *last) : old(first), oldEnd(last),
+		text(nullptr), textPos(0), endPos(0), prevChar('\0'), counted(0), lines(0), lastPos(0), watched(nullptr), job(0) {
+	}
+
+	/* "text" holds the buffer from "textPos" on, parsing goes from "parsePos"
+	   to "parseEnd".  Where a sub-pattern runs into the end, its parent
+	   carries on as though it had ended there, so nothing is taken from the
+	   end on */
+	void start(const char_type *string, int stringPos, int parsePos, int parseEnd, char_type charBefore) {
+		text     = string;
+		textPos  = stringPos;
+		endPos   = parseEnd;
+		prevChar = charBefore;
+		counted  = parsePos - textPos;
+		lastPos  = parsePos;
+	}
+
+	/* Have parsing stop, as though the pattern had failed, once "current" no
+	   longer holds "generation" (the background job was abandoned) */
+	void watch(const std::atomic<int> *current, int generation) {
+		watched = current;
+		job     = generation;
+	}
+
+	bool abandoned() const {
+		return watched && watched->load(std::memory_order_relaxed) != job;
+	}
+
+	void gap(const char_type *from, const char_type *to, char_type style);
+
+	const ParseCheckpoint       *old;      // Previous checkpoints not yet passed.
+	const ParseCheckpoint       *oldEnd;
+	const char_type             *text;
+	int                          textPos;
+	int                          endPos;
+	char_type                    prevChar; // Character before text[0].
+	int                          counted;  // Lines are counted up to this offset in text.
+	int                          lines;    // Lines since the last checkpoint.
+	int                          lastPos;  // Position of the last checkpoint.
+	const std::atomic<int>      *watched;
+	int                          job;
+	std::vector<ParseCheckpoint> found;
+};
+
+/*
+** Take the checkpoints due between "from" and "to" (inclusive), where the
+** parser is between matches of the pattern with style "style"
+*/
+void CheckpointRecorder::gap(const char_type *from, const char_type *to, char_type style) {
+
+	int offset    = from - text;
+	const int end = qMin<int>(to - text, endPos - textPos - 1);
+
+	while (offset <= end) {
+		const int pos = textPos + offset;
+
+		if (counted < offset) {
+			lines += std::count(&text[counted], &text[offset], _T('\n'));
+			counted = offset;
+		}
+
+		while (old != oldEnd && old->pos < pos) {
+			++old;
+		}
+
+		const bool lineStart = ((offset == 0) ? prevChar : text[offset - 1]) == _T('\n');
+
+		/* Where a sub-pattern ends without moving on (a zero length end
+		   match), its parent's state is the one to keep */
+		if (!found.empty() && found.back().pos == pos) {
+			found.back().style = style;
+		} else if ((old != oldEnd && old->pos == pos) || (lineStart && lines >= PARSE_CHECKPOINT_LINES) || pos - lastPos >= PARSE_CHECKPOINT_CHARS) {
+			found.push_back(ParseCheckpoint{ pos, style });
+			lines   = 0;
+			lastPos = pos;
+		}
+
+		if (old != oldEnd && old->pos == pos) {
+			++old;
+		}
+
+		/* On to the next place a checkpoint could be due */
+		const char_type *const newline = std::find(&text[offset], &text[end], _T('\n'));
+		int next = (newline == &text[end]) ? end + 1 : (newline - text) + 1;
+		next = qMin(next, qMax(offset + 1, lastPos + PARSE_CHECKPOINT_CHARS - textPos));
+		if (old != oldEnd) {
+			next = qMin(next, old->pos - textPos);
+		}
+
+		offset = next;
+	}
+}
+
+/* A window of the document for the background worker, with its text and
+   styles copied out of the buffers, plus enough context on either side */
+struct SyntaxHighlighter::HighlightJob {
+	int       generation;
+	int       textStart;   // Buffer position of text[0].
+	int       parseStart;  // Where parsing begins, with startStyle.
+	int       parseEnd;    // End of the styles handed back.
+	int       safeEnd;     // Pass 1 parsing goes on to here, one context past parseEnd.
+	char_type startStyle;
+	char_type prevChar;    // Character before text[0].
+	bool      speculative; // One of the chunks of a new document.
+	String    text;
+	std::vector<StyleRun> styles; // Of the text, as they were.
+	std::vector<ParseCheckpoint> checkpoints; // The previous ones, from parseStart to safeEnd.
 };
 
 SyntaxHighlighter::SyntaxHighlighter() {
@@ -196,12 +418,41 @@ SyntaxHighlighter::SyntaxHighlighter() {
         highlightData_ = nullptr;
 #endif
     }
+
+    buffer_        = nullptr;
+    backgroundPos_ = -1;
+    settledAfter_  = 0;
+    speculating_   = 0;
+    generation_    = 0;
+    quit_          = false;
+#ifdef REGEX_PROFILE
+    reportWhenIdle_ = false;
+#endif
+
+    backgroundTimer_ = new QTimer(this);
+    backgroundTimer_->setSingleShot(true);
+    backgroundTimer_->setInterval(0);
+    connect(backgroundTimer_, SIGNAL(timeout()), this, SLOT(startBackgroundWindow()));
+    connect(this, SIGNAL(backgroundStylesReady()), this, SLOT(publishBackgroundStyles()), Qt::QueuedConnection);
+
+    worker_ = std::thread(&SyntaxHighlighter::backgroundWorker, this, false);
 }
 
 SyntaxHighlighter::~SyntaxHighlighter() {
+    {
+        std::lock_guard<std::mutex> lock(workerLock_);
+        quit_ = true;
+    }
+
+    /* Stop whatever is being parsed as well */
+    ++generation_;
+
+    workerWake_.notify_all();
+    worker_.join();
+    joinHelpers();
 }
 
-TextBuffer *SyntaxHighlighter::styleBuffer() const {
+StyleBuffer *SyntaxHighlighter::styleBuffer() const {
     if (highlightData_) {
         return highlightData_->styleBuffer;
     }
@@ -229,12 +480,8 @@ void SyntaxHighlighter::bufferModified(const ModifyEvent *event) {
     /* First and foremost, the style buffer must track the text buffer
        accurately and correctly */
     if (nInserted > 0) {
-
-        auto insStyle = new char_type[nInserted];
-        std::fill_n(insStyle, nInserted, UNFINISHED_STYLE);
         // TODO(eteran): BUGCHECK: should this be nInserted? here, not nDeleted?
-        highlightData_->styleBuffer->BufReplace(pos, pos + nDeleted, insStyle, nInserted);
-        delete[] insStyle;
+        highlightData_->styleBuffer->BufReplace(pos, pos + nDeleted, { StyleRun{ nInserted, UNFINISHED_STYLE } });
     } else {
         highlightData_->styleBuffer->BufRemove(pos, pos + nDeleted);
     }
@@ -246,9 +493,155 @@ void SyntaxHighlighter::bufferModified(const ModifyEvent *event) {
        changes that are already scheduled for redraw */
     highlightData_->styleBuffer->BufSelect(pos, pos + nInserted);
 
-    /* Re-parse around the changed region */
-    if (highlightData_->pass1Patterns) {
-        incrementalReparse(highlightData_, event->buffer, pos, nInserted, delimiters);
+#ifdef REGEX_PROFILE
+    /* Text replacing the whole buffer is a document being loaded, report
+       which patterns highlighting it cost the most once it is highlighted */
+    if (nInserted > 0 && nInserted == event->buffer->BufGetLength()) {
+        resetPatternProfiles();
+        reportWhenIdle_ = true;
+    }
+#endif
+
+    /* Checkpoints in the changed text are gone, the ones after it move */
+    std::vector<ParseCheckpoint> &checkpoints = highlightData_->checkpoints;
+    auto byPosition = [](const ParseCheckpoint &c, int p) { return c.pos < p; };
+    auto changed = std::lower_bound(checkpoints.begin(), checkpoints.end(), pos + 1, byPosition);
+    auto after   = std::lower_bound(changed, checkpoints.end(), pos + nDeleted, byPosition);
+    for (auto it = after; it != checkpoints.end(); ++it) {
+        it->pos += nInserted - nDeleted;
+    }
+    checkpoints.erase(changed, after);
+
+    /* Keep the progress of background highlighting in step with the text */
+    buffer_       = event->buffer;
+    settledAfter_ = shiftPosition(settledAfter_, pos, nDeleted, nInserted);
+    if (backgroundPos_ != -1) {
+        backgroundPos_ = shiftPosition(backgroundPos_, pos, nDeleted, nInserted);
+    }
+    for (int &chunkStart : unverified_) {
+        chunkStart = shiftPosition(chunkStart, pos, nDeleted, nInserted);
+    }
+
+    /* Large insertions, and changes in text the background worker hasn't
+       got to yet, are highlighted in the background */
+    if (nInserted > SYNC_REPARSE_LIMIT || (backgroundPos_ != -1 && pos >= backgroundPos_)) {
+        settledAfter_ = qMax(settledAfter_, pos + nInserted);
+        startBackgroundHighlight(pos);
+    } else {
+
+        /* Re-parse around the changed region, handing over to the background
+           worker if the styles keep changing too far beyond it */
+        StyleBuffer *const styleBuf = highlightData_->styleBuffer;
+        if (highlightData_->pass1Patterns && !incrementalReparse(highlightData_, event->buffer, pos, nInserted, delimiters)) {
+            settledAfter_ = qMax(settledAfter_, lastModified(styleBuf));
+            startBackgroundHighlight(lastModified(styleBuf));
+        } else if (backgroundPos_ != -1) {
+            /* The window being highlighted has moved with the text */
+            startBackgroundHighlight(backgroundPos_);
+        }
+
+        /* Apply the pass 2 patterns to what was left unfinished, the display
+           never parses.  The worker sees to what is beyond where it is */
+        const Selection sel = styleBuf->BufGetPrimarySelection();
+        if (sel.selected) {
+            if (backgroundPos_ == -1) {
+                finishPass2(event->buffer, sel.start, sel.end);
+            } else {
+                finishPass2(event->buffer, sel.start, qMin(sel.end, backgroundPos_));
+                settledAfter_ = qMax(settledAfter_, sel.end);
+            }
+            styleBuf->BufSelect(sel.start, sel.end);
+        }
+    }
+
+#ifdef REGEX_PROFILE
+    if (reportWhenIdle_ && backgroundPos_ == -1) {
+        reportExpensivePatterns(PROFILE_REPORT_SIZE);
+        reportWhenIdle_ = false;
+    }
+#endif
+}
+
+/*
+** Gather the expressions of "pattern" and its sub-patterns, each one once
+*/
+void SyntaxHighlighter::collectExpressions(const HighlightDataRecord *pattern, std::vector<std::shared_ptr<const Regex>> *regexes) {
+    if (!pattern) {
+        return;
+    }
+
+    for (const std::shared_ptr<const Regex> &regex : {pattern->startRE, pattern->endRE, pattern->errorRE}) {
+        if (regex && std::find(regexes->begin(), regexes->end(), regex) == regexes->end()) {
+            regexes->push_back(regex);
+        }
+    }
+
+    for (const HighlightDataRecord *subPat : pattern->subPatterns) {
+        collectExpressions(subPat, regexes);
+    }
+}
+
+/*
+** Clear the profiles of the expressions highlighting uses, see RegexProfile
+*/
+void SyntaxHighlighter::resetPatternProfiles() {
+    if (!highlightData_) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<const Regex>> regexes;
+    collectExpressions(highlightData_->pass1Patterns, &regexes);
+    collectExpressions(highlightData_->pass2Patterns, &regexes);
+
+    for (const std::shared_ptr<const Regex> &regex : regexes) {
+        regex->ResetProfile();
+    }
+}
+
+/*
+** List the "n" expressions that highlighting spent the most time in since
+** their profiles were last cleared, with the work they did.  Counts are only
+** kept when the regex code is built with REGEX_PROFILE.
+*/
+void SyntaxHighlighter::reportExpensivePatterns(int n) const {
+    if (!highlightData_) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<const Regex>> regexes;
+    collectExpressions(highlightData_->pass1Patterns, &regexes);
+    collectExpressions(highlightData_->pass2Patterns, &regexes);
+
+    std::vector<std::pair<RegexProfile, QString>> profiles;
+    for (const std::shared_ptr<const Regex> &regex : regexes) {
+        profiles.emplace_back(regex->Profile(), regex->Pattern());
+    }
+
+    std::sort(profiles.begin(), profiles.end(), [](const std::pair<RegexProfile, QString> &a, const std::pair<RegexProfile, QString> &b) {
+        return a.first.nanoseconds > b.first.nanoseconds;
+    });
+
+    if (profiles.size() > static_cast<size_t>(n)) {
+        profiles.resize(n);
+    }
+
+    qDebug("regex profile, the %d most expensive of %d highlight expressions:", static_cast<int>(profiles.size()), static_cast<int>(regexes.size()));
+
+    for (const std::pair<RegexProfile, QString> &entry : profiles) {
+        const RegexProfile &p = entry.first;
+
+        const uint64_t *busiest = std::max_element(p.nodes, p.nodes + RegexProfile::NodeKinds);
+
+        qDebug("  %9.3f ms %8llu searches %10llu attempts %10llu skipped %12llu nodes (most %s) %10llu backtracks %4llu limits  %s",
+               p.nanoseconds / 1e6,
+               static_cast<unsigned long long>(p.searches),
+               static_cast<unsigned long long>(p.attempts),
+               static_cast<unsigned long long>(p.prefilterSkips),
+               static_cast<unsigned long long>(p.Nodes()),
+               RegexProfile::NodeName(busiest - p.nodes),
+               static_cast<unsigned long long>(p.backtracks),
+               static_cast<unsigned long long>(p.recursionLimits),
+               qPrintable(entry.second));
     }
 }
 
@@ -302,6 +695,10 @@ void SyntaxHighlighter::loadLanguages(const QString &filename) {
                     pattern.subPatternOf = obj["parent"].toString();
                 }
 
+                warnIfCostly(pattern.name, pattern.startRE);
+                warnIfCostly(pattern.name, pattern.endRE);
+                warnIfCostly(pattern.name, pattern.errorRE);
+
                 pattern_set->patterns.push_back(pattern);
             }
 
@@ -356,35 +753,41 @@ void SyntaxHighlighter::loadStyles(const QString &filename) {
 ** Re-parse the smallest region possible around a modification to buffer "buf"
 ** to gurantee that the promised context lines and characters have
 ** been presented to the patterns.  Changes the style buffer in "highlightData"
-** with the parsing result.
+** with the parsing result.  Parsing starts from the last checkpoint which the
+** modification can't have affected, and stops at the first checkpoint past
+** it where the parser is back in the state it was in before.  Returns false
+** if it stopped because that didn't happen within SYNC_REPARSE_LIMIT
+** characters of the modification, the rest is left to the background worker.
 */
-void SyntaxHighlighter::incrementalReparse(HighlightData *highlightData, TextBuffer *buf, int pos, int nInserted,
+bool SyntaxHighlighter::incrementalReparse(HighlightData *highlightData, TextBuffer *buf, int pos, int nInserted,
                                            const char_type *delimiters) {
 
-    TextBuffer *const styleBuf               = highlightData_->styleBuffer;
+    StyleBuffer *const styleBuf              = highlightData_->styleBuffer;
     HighlightDataRecord *const pass1Patterns = highlightData->pass1Patterns;
     HighlightDataRecord *const pass2Patterns = highlightData->pass2Patterns;
     ReparseContext *const context            = &highlightData->contextRequirements;
     char_type *const parentStyles            = highlightData->parentStyles;
 
-    /* Find the position "beginParse" at which to begin reparsing.  This is
-       far enough back in the buffer such that the guranteed number of
-       lines and characters of context are examined. */
-    int beginParse = pos;
-    int parseInStyle = findSafeParseRestartPos(buf, highlightData, &beginParse);
+    /* Find the position "beginParse" at which to begin reparsing, the last
+       checkpoint far enough back in the buffer such that the guranteed
+       number of lines and characters of context are examined. */
+    char_type parseInStyle;
+    int beginParse = checkpointBefore(backwardOneContext(buf, context, pos), &parseInStyle);
 
-    /* Find the position "endParse" at which point it is safe to stop
-       parsing, unless styles are getting changed beyond the last
-       modification */
-    int lastMod = pos + nInserted;
-    int endParse = forwardOneContext(buf, context, lastMod);
+    /* Parsing is done when it passes a checkpoint, out of reach of the
+       modification, in the same state as before.  Find the position
+       "endParse" which takes it a context distance past the first one. */
+    const int lastMod = pos + nInserted;
+    int settleFrom    = forwardOneContext(buf, context, lastMod);
+    int endParse      = forwardOneContext(buf, context, checkpointAfter(settleFrom));
 
     /*
-    ** Parse the buffer from beginParse, until styles compare
-    ** with originals for one full context distance.  Distance increases
-    ** by powers of two until nothing changes from previous step.  If
-    ** parsing ends before endParse, start again one level up in the
-    ** pattern hierarchy
+    ** Parse the buffer from beginParse, until the state of the parser
+    ** compares with the original at a checkpoint.  Distance increases by
+    ** powers of two until it does, parsing on from the last checkpoint
+    ** found.  If parsing ends before endParse, start again one level up in
+    ** the pattern hierarchy.  Either way, the checkpoints up to where it
+    ** starts again are new ones, no use for telling whether it is done.
     */
     for (int nPasses = 0;; nPasses++) {
 
@@ -399,33 +802,123 @@ void SyntaxHighlighter::incrementalReparse(HighlightData *highlightData, TextBuf
         if (!startPattern) {
             startPattern = pass1Patterns;
         }
-        int endAt = parseBufferRange(startPattern, pass2Patterns, buf, styleBuf, context, beginParse, endParse, delimiters);
+
+        const std::vector<ParseCheckpoint> &checkpoints = highlightData->checkpoints;
+        CheckpointRecorder recorder(checkpoints.data(), checkpoints.data() + checkpoints.size());
+        int endAt = parseBufferRange(startPattern, pass2Patterns, buf, styleBuf, context, beginParse, endParse, delimiters, &recorder);
+
+        /* Back in step at a checkpoint means we're done */
+        if (mergeCheckpoints(recorder.found, beginParse, endAt, settleFrom, backwardOneContext(buf, context, endAt))) {
+            return true;
+        }
 
         /* If parse completed at this level, move one style up in the
            hierarchy and start again from where the previous parse left off. */
         if (endAt < endParse) {
             beginParse = endAt;
+            settleFrom = qMax(settleFrom, beginParse + 1);
             endParse = forwardOneContext(buf, context, qMax(endAt, qMax(lastModified(styleBuf), lastMod)));
             if (isPlain(parseInStyle)) {
                 qDebug("internal error: incr. reparse fell short\n");
-                return;
+                return true;
             }
             parseInStyle = parentStyleOf(parentStyles, parseInStyle);
 
-            /* One context distance beyond last style changed means we're done */
-        } else if (lastModified(styleBuf) <= lastMod) {
-            return;
+            /* The end of the buffer means we're done too */
+        } else if (endParse >= buf->BufGetLength()) {
+            return true;
+
+            /* Too far for the user to wait on, let the background worker go on */
+        } else if (endParse - lastMod > SYNC_REPARSE_LIMIT) {
+            settledAfter_ = qMax(settledAfter_, endAt);
+            return false;
 
-            /* Styles are changing beyond the modification, continue extending
-            the end of the parse range by powers of 2 * REPARSE_CHUNK_SIZE and
-            reparse until nothing changes */
+            /* The state is different beyond the modification, continue from
+            the last checkpoint found, extending the end of the parse range by
+            powers of 2 * REPARSE_CHUNK_SIZE to the next checkpoint, until it
+            is the same */
         } else {
-            lastMod  = lastModified(styleBuf);
-            endParse = qMin(buf->BufGetLength(), forwardOneContext(buf, context, lastMod) + (REPARSE_CHUNK_SIZE << nPasses));
+            if (!recorder.found.empty()) {
+                beginParse   = recorder.found.back().pos;
+                parseInStyle = recorder.found.back().style;
+                settleFrom   = qMax(settleFrom, beginParse + 1);
+            }
+            endParse = qMin(buf->BufGetLength(), forwardOneContext(buf, context, checkpointAfter(endParse + (REPARSE_CHUNK_SIZE << nPasses))));
         }
     }
 }
 
+/*
+** Return the position of the last checkpoint at or before "pos", and the
+** style of the pattern to resume parsing with there in "style".  The start of
+** the buffer serves as one, when there are none.
+*/
+int SyntaxHighlighter::checkpointBefore(int pos, char_type *style) const {
+    const std::vector<ParseCheckpoint> &checkpoints = highlightData_->checkpoints;
+
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), pos, [](int p, const ParseCheckpoint &c) { return p < c.pos; });
+    if (it == checkpoints.begin()) {
+        *style = PLAIN_STYLE;
+        return 0;
+    }
+
+    --it;
+    *style = it->style;
+    return it->pos;
+}
+
+/*
+** Return the position of the first checkpoint at or after "pos", or "pos"
+** itself if there is none
+*/
+int SyntaxHighlighter::checkpointAfter(int pos) const {
+    const std::vector<ParseCheckpoint> &checkpoints = highlightData_->checkpoints;
+
+    auto it = std::lower_bound(checkpoints.begin(), checkpoints.end(), pos, [](const ParseCheckpoint &c, int p) { return c.pos < p; });
+    return (it == checkpoints.end()) ? pos : it->pos;
+}
+
+/*
+** Replace the checkpoints from "start" to "end" with those "found" by parsing
+** there again.  Returns true if one of them between "settleFrom" and
+** "settleTo" has the parser in the same state as the checkpoint it replaces,
+** so that parsing on from there would change nothing.  While the background
+** worker is busy, the new checkpoints are no measure of whether its parse has
+** settled, so it must not stop before passing them.
+*/
+bool SyntaxHighlighter::mergeCheckpoints(const std::vector<ParseCheckpoint> &found, int start, int end, int settleFrom, int settleTo) {
+    std::vector<ParseCheckpoint> &checkpoints = highlightData_->checkpoints;
+    auto byPosition = [](const ParseCheckpoint &c, int p) { return c.pos < p; };
+
+    if (!found.empty()) {
+        end = qMax(end, found.back().pos);
+    }
+
+    auto first = std::lower_bound(checkpoints.begin(), checkpoints.end(), start, byPosition);
+    auto last  = std::lower_bound(first, checkpoints.end(), end + 1, byPosition);
+
+    bool settled = false;
+    auto old = first;
+    for (const ParseCheckpoint &checkpoint : found) {
+        while (old != last && old->pos < checkpoint.pos) {
+            ++old;
+        }
+
+        if (checkpoint.pos >= settleFrom && checkpoint.pos <= settleTo && old != last && old->pos == checkpoint.pos && old->style == checkpoint.style) {
+            settled = true;
+            break;
+        }
+    }
+
+    checkpoints.insert(checkpoints.erase(first, last), found.begin(), found.end());
+
+    if (backgroundPos_ != -1) {
+        settledAfter_ = qMax(settledAfter_, end);
+    }
+
+    return settled;
+}
+
 /*
 ** Return a position far enough back in "buf" from "fromPos" to give patterns
 ** their guranteed amount of context for matching (from "context").  If
@@ -466,149 +959,6 @@ int SyntaxHighlighter::forwardOneContext(TextBuffer *buf, ReparseContext *contex
     }
 }
 
-/*
-** Back up position pointed to by "pos" enough that parsing from that point
-** on will satisfy context gurantees for pattern matching for modifications
-** at pos.  Returns the style with which to begin parsing.  The caller is
-** guranteed that parsing may safely BEGIN with that style, but not that it
-** will continue at that level.
-**
-** This routine can be fooled if a continuous style run of more than one
-** context distance in length is produced by multiple pattern matches which
-** abut, rather than by a single continuous match.  In this  case the
-** position returned by this routine may be a bad starting point which will
-** result in an incorrect re-parse.  However this will happen very rarely,
-** and, if it does, is unlikely to result in incorrect highlighting.
-*/
-int SyntaxHighlighter::findSafeParseRestartPos(TextBuffer *buf, HighlightData *highlightData, int *pos) {
-    int checkBackTo;
-    int safeParseStart;
-
-    char_type *const parentStyles            = highlightData->parentStyles;
-    HighlightDataRecord *const pass1Patterns = highlightData->pass1Patterns;
-    ReparseContext *const context            = &highlightData->contextRequirements;
-
-    Q_ASSERT(pos);
-
-    /* We must begin at least one context distance back from the change */
-    *pos = backwardOneContext(buf, context, *pos);
-
-    /* If the new position is outside of any styles or at the beginning of
-       the buffer, this is a safe place to begin parsing, and we're done */
-    if (*pos == 0) {
-        return PLAIN_STYLE;
-    }
-
-    int startStyle = highlightData->styleBuffer->BufGetCharacter(*pos);
-    if (isPlain(startStyle)) {
-        return PLAIN_STYLE;
-    }
-
-    /*
-    ** The new position is inside of a styled region, meaning, its pattern
-    ** could potentially be affected by the modification.
-    **
-    ** Follow the style back by enough context to ensure that if we don't find
-    ** its beginning, at least we've found a safe place to begin parsing
-    ** within the styled region.
-    **
-    ** A safe starting position within a style is either at a style
-    ** boundary, or far enough from the beginning and end of the style run
-    ** to ensure that it's not within the start or end expression match
-    ** (unfortunately, abutting styles can produce false runs so we're not
-    ** really ensuring it, just making it likely).
-    */
-    if (patternIsParsable(patternOfStyle(pass1Patterns, startStyle))) {
-        safeParseStart = backwardOneContext(buf, context, *pos);
-        checkBackTo    = backwardOneContext(buf, context, safeParseStart);
-    } else {
-        safeParseStart = 0;
-        checkBackTo    = 0;
-    }
-
-    int runningStyle = startStyle;
-    for (int i = *pos - 1;; i--) {
-
-        /* The start of the buffer is certainly a safe place to parse from */
-        if (i == 0) {
-            *pos = 0;
-            return PLAIN_STYLE;
-        }
-
-        /* If the style is preceded by a parent style, it's safe to parse
-           with the parent style, provided that the parent is parsable. */
-        int style = highlightData->styleBuffer->BufGetCharacter(i);
-        if (isParentStyle(parentStyles, style, runningStyle)) {
-            if (patternIsParsable(patternOfStyle(pass1Patterns, style))) {
-                *pos = i + 1;
-                return style;
-            } else {
-                /* The parent is not parsable, so well have to continue
-                   searching. The parent now becomes the running style. */
-                runningStyle = style;
-            }
-        }
-
-        /* If the style is preceded by a child style, it's safe to resume
-           parsing with the running style, provided that the running
-           style is parsable. */
-        else if (isParentStyle(parentStyles, runningStyle, style)) {
-            if (patternIsParsable(patternOfStyle(pass1Patterns, runningStyle))) {
-                *pos = i + 1;
-                return runningStyle;
-            }
-            /* Else: keep searching; it's no use switching to the child style
-               because even the running one is not parsable. */
-        }
-
-        /* If the style is preceded by a sibling style, it's safe to resume
-           parsing with the common ancestor style, provided that the ancestor
-           is parsable. Checking for siblings is very hard; checking whether
-           the style has the same parent will probably catch 99% of the cases
-           in practice. */
-        else if (runningStyle != style && isParentStyle(parentStyles, parentStyleOf(parentStyles, runningStyle), style)) {
-            int parentStyle = parentStyleOf(parentStyles, runningStyle);
-            if (patternIsParsable(patternOfStyle(pass1Patterns, parentStyle))) {
-                *pos = i + 1;
-                return parentStyle;
-            } else {
-                /* Switch to the new style */
-                runningStyle = style;
-            }
-        }
-
-        /* If the style is preceded by an unrelated style, it's safe to
-           resume parsing with PLAIN_STYLE. (Actually, it isn't, because
-           we didn't really check for all possible sibling relations; but
-           it will be ok in practice.) */
-        else if (runningStyle != style) {
-            *pos = i + 1;
-            return PLAIN_STYLE;
-        }
-
-        /* If the style is parsable and didn't change for one whole context
-           distance on either side of safeParseStart, safeParseStart is a
-           reasonable guess at a place to start parsing.
-           Note: No 'else' here! We may come from one of the 'fall-through
-           cases' above. */
-        if (i == checkBackTo) {
-            *pos = safeParseStart;
-
-            /* We should never return a non-parsable style, because it will
-               result in an internal error. If the current style is not
-               parsable, the pattern set most probably contains a context
-               distance violation. In that case we can only avoid internal
-               errors (by climbing the pattern hierarchy till we find a
-               parsable ancestor) and hope that the highlighting errors are
-               minor. */
-            while (!patternIsParsable(patternOfStyle(pass1Patterns, runningStyle)))
-                runningStyle = parentStyleOf(parentStyles, runningStyle);
-
-            return runningStyle;
-        }
-    }
-}
-
 /*
 ** Search for a pattern in pattern list "patterns" with style "style"
 */
@@ -642,8 +992,8 @@ HighlightDataRecord *SyntaxHighlighter::patternOfStyle(HighlightDataRecord *patt
 ** pattern which does end and the end is reached).
 */
 int SyntaxHighlighter::parseBufferRange(const HighlightDataRecord *pass1Patterns, const HighlightDataRecord *pass2Patterns,
-                                        TextBuffer *buf, TextBuffer *styleBuf, ReparseContext *contextRequirements,
-                                        int beginParse, int endParse, const char_type *delimiters) {
+                                        TextBuffer *buf, StyleBuffer *styleBuf, ReparseContext *contextRequirements,
+                                        int beginParse, int endParse, const char_type *delimiters, CheckpointRecorder *checkpoints) {
     int endSafety;
     int endPass2Safety;
     int startPass2Safety;
@@ -699,7 +1049,11 @@ int SyntaxHighlighter::parseBufferRange(const HighlightDataRecord *pass1Patterns
     const char_type *stringPtr = &string[beginParse - beginSafety];
     char_type *stylePtr        = &styleString[beginParse - beginSafety];
 
-    parseString(pass1Patterns, &stringPtr, &stylePtr, endParse - beginParse, &prevChar, MatchFlags::FlagNone, delimiters, string.str, nullptr);
+    if (checkpoints) {
+        checkpoints->start(string.str, beginSafety, beginParse, endParse, getPrevChar(buf, beginSafety));
+    }
+
+    parseString(pass1Patterns, &stringPtr, &stylePtr, endParse - beginParse, &prevChar, MatchFlags::FlagNone, delimiters, string.str, nullptr, checkpoints);
 
     /* On non top-level patterns, parsing can end early */
     endParse = qMin<long>(endParse, stringPtr - string.str + beginSafety);
@@ -793,7 +1147,7 @@ parseDone:
 ** by the convention used for conveying modification information to the
 ** text widget, which is selecting the text)
 */
-int SyntaxHighlighter::lastModified(TextBuffer *styleBuf) const {
+int SyntaxHighlighter::lastModified(StyleBuffer *styleBuf) const {
     if (styleBuf->BufGetPrimarySelection().selected) {
         return qMax(0, styleBuf->BufGetPrimarySelection().end);
     }
@@ -804,27 +1158,6 @@ int SyntaxHighlighter::parentStyleOf(const char_type *parentStyles, int style) {
     return parentStyles[(unsigned char)style - UNFINISHED_STYLE];
 }
 
-bool SyntaxHighlighter::isParentStyle(const char_type *parentStyles, int style1, int style2) {
-
-    for (int p = parentStyleOf(parentStyles, style2); p != '\0'; p = parentStyleOf(parentStyles, p)) {
-        if (style1 == p) {
-            return true;
-        }
-    }
-    return false;
-}
-
-/*
-** Discriminates patterns which can be used with parseString from those which
-** can't.  Leaf patterns are not suitable for parsing, because patterns
-** contain the expressions used for parsing within the context of their own
-** operation, i.e. the parent pattern initiates, and leaf patterns merely
-** confirm and color.  Returns TRUE if the pattern is suitable for parsing.
-*/
-int SyntaxHighlighter::patternIsParsable(const HighlightDataRecord *pattern) {
-    return pattern && pattern->subPatternRE;
-}
-
 /*
 ** Takes a string which has already been parsed through pass1 parsing and
 ** re-parses the areas where pass two patterns are applicable.  Parameters
@@ -837,13 +1170,13 @@ void SyntaxHighlighter::passTwoParseString(const HighlightDataRecord *pattern, c
 
     int firstPass2Style = (unsigned char)pattern[1].style;
 
+	bool inParseRegion = false;
+	const char_type *parseStart = nullptr;
+
 	char_type *s = styleString;
 	char_type *c = string;
 	for (;; c++, s++) {
 
-		bool inParseRegion = false;
-		const char_type *parseStart = nullptr;
-
         if (!inParseRegion && *c != _T('\0') &&
             (*s == UNFINISHED_STYLE || *s == PLAIN_STYLE || (unsigned char)*s >= firstPass2Style)) {
             parseStart = c;
@@ -900,9 +1233,8 @@ void SyntaxHighlighter::passTwoParseString(const HighlightDataRecord *pattern, c
 */
 bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const char_type **string, char_type **styleString, int length,
                                     char_type *prevChar, MatchFlags flags, const char_type *delimiters, const char_type *lookBehindTo,
-                                    const char_type *match_till) {
+                                    const char_type *match_till, CheckpointRecorder *checkpoints) {
     int i;
-    bool subExecuted;
     char_type succChar = match_till ? (*match_till) : '\0';
     HighlightDataRecord *subSubPat;
 
@@ -916,53 +1248,41 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
     const bool anchored = flags & FlagAnchored;
 
 
-    while (auto match = std::unique_ptr<RegexMatch>(pattern->subPatternRE->ExecRE(stringPtr, anchored ? *string + 1 : *string + length + 1, Direction::Forward, *prevChar, succChar, delimiters, lookBehindTo, match_till))) {
-		
-		/* Beware of the case where only one real branch exists, but that
-		   branch has sub-branches itself. In that case the top_branch refers
-		   to the matching sub-branch and must be ignored. */
-		int subIndex = (pattern->subPatternsRE.size() > 1) ? match->top_branch() : 0;		
+    int subIndex;
+    RegexSet::Scan scan;
+    while (auto match = std::unique_ptr<RegexMatch>(pattern->exec(stringPtr, anchored ? *string + 1 : *string + length + 1, *prevChar, succChar, delimiters, lookBehindTo, match_till, &subIndex, &scan))) {
 
-        /* Combination of all sub-patterns and end pattern matched */
+        /* One of the sub-patterns or the end pattern matched */
         /* qDebug("combined patterns RE matched at %d\n", pattern->startp(0) - *string); */
         const char_type *startingStringPtr = stringPtr;
 
         const Capture capture0 = match->capture(0);
 
+        /* The background job this is for was abandoned */
+        if (checkpoints && checkpoints->abandoned()) {
+            *string      = stringPtr;
+            *styleString = stylePtr;
+            return false;
+        }
+
         /* Fill in the pattern style for the text that was skipped over before
            the match, and advance the pointers to the start of the pattern */
+        if (checkpoints) {
+            checkpoints->gap(stringPtr, capture0.start, pattern->style);
+        }
         fillStyleString(stringPtr, stylePtr, capture0.start, pattern->style, prevChar);
 
-        /* If the combined pattern matched this pattern's end pattern, we're
-           done.  Fill in the style string, update the pointers, color the
-           end expression if there were coloring sub-patterns, and return */
-        const char_type *savedStartPtr = stringPtr;
-        char_type savedPrevChar = *prevChar;
+        /* If this pattern's end pattern matched, we're done.  Fill in the
+           style string, update the pointers, color the end expression if
+           there were coloring sub-patterns, and return */
         if (pattern->endRE) {
-		
-			std::unique_ptr<RegexMatch> end_match;
-		
             if (subIndex == 0) {
                 fillStyleString(stringPtr, stylePtr, capture0.end, pattern->style, prevChar);
 
-                subExecuted = false;
-
                 for(HighlightDataRecord *const subPat : pattern->subPatterns) {
-
                     if (subPat->colorOnly) {
-                        if (!subExecuted) {
-						
-							end_match = std::unique_ptr<RegexMatch>(pattern->endRE->ExecRE(savedStartPtr, savedStartPtr + 1, Direction::Forward, savedPrevChar, succChar, delimiters, lookBehindTo, match_till));
-						
-                            if (!end_match) {
-                                qDebug("Internal error, failed to recover end match in parseString");
-                                return false;
-                            }
-                            subExecuted = true;
-                        }
-
                         for(auto subExpr : subPat->endSubexprs) {
-                            recolorSubexpr(end_match, subExpr, subPat->style, *string, *styleString);
+                            recolorSubexpr(match, subExpr, subPat->style, *string, *styleString);
                         }
                     }
                 }
@@ -973,7 +1293,7 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
             --subIndex;
         }
 
-        /* If the combined pattern matched this pattern's error pattern, we're
+        /* If this pattern's error pattern matched, we're
            done.  Fill in the style string, update the pointers, and return */
         if (pattern->errorRE) {
             if (subIndex == 0) {
@@ -1002,7 +1322,7 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
         }
 
         /* the sub-pattern is a simple match, just color it */
-        if (!subPat->subPatternRE) {
+        if (subPat->subPatternSet.Empty()) {
             fillStyleString(stringPtr, stylePtr, capture0.end, /* subPat->startRE->capture(0).end,*/ subPat->style, prevChar);
 
             /* Parse the remainder of the sub-pattern */
@@ -1016,7 +1336,7 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
                 fillStyleString(stringPtr, stylePtr, capture0.end, /* subPat->startRE->capture(0).end,*/ subPat->style, prevChar);
 
             /* Parse to the end of the subPattern */
-            parseString(subPat, &stringPtr, &stylePtr, length - (stringPtr - *string), prevChar, MatchFlags::FlagNone, delimiters, lookBehindTo, match_till);
+            parseString(subPat, &stringPtr, &stylePtr, length - (stringPtr - *string), prevChar, MatchFlags::FlagNone, delimiters, lookBehindTo, match_till, checkpoints);
         } else {
             /* If the parent pattern is not a start/end pattern, the
                sub-pattern can between the boundaries of the parent's
@@ -1029,27 +1349,12 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
         }
 
         /* If the sub-pattern has color-only sub-sub-patterns, add color
-       based on the coloring sub-expression references */
-        subExecuted = false;
+       based on the coloring sub-expression references of its start match */
         for (i = 0; i < subPat->subPatterns.size(); i++) {
             subSubPat = subPat->subPatterns[i];
             if (subSubPat->colorOnly) {
-			
-				std::unique_ptr<RegexMatch> start_match;
-			
-                if (!subExecuted) {
-				
-					start_match = std::unique_ptr<RegexMatch>(subPat->startRE->ExecRE(savedStartPtr, savedStartPtr + 1, Direction::Forward, savedPrevChar, succChar, delimiters, lookBehindTo, match_till));
-				
-                    if (!start_match) {
-                        qDebug("Internal error, failed to recover start match in parseString");
-                        return false;
-                    }
-                    subExecuted = true;
-                }
-				
 				for(auto &subExpr : subSubPat->startSubexprs) {
-                    recolorSubexpr(start_match, subExpr, subSubPat->style, *string, *styleString);
+                    recolorSubexpr(match, subExpr, subSubPat->style, *string, *styleString);
 				}
             }
         }
@@ -1072,6 +1377,9 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
 
     /* Reached end of string, fill in the remaining text with pattern style
        (unless this was an anchored match) */
+    if (checkpoints && !anchored) {
+        checkpoints->gap(stringPtr, *string + length, pattern->style);
+    }
     if (!anchored)
         fillStyleString(stringPtr, stylePtr, *string + length, pattern->style, prevChar);
 
@@ -1088,7 +1396,7 @@ bool SyntaxHighlighter::parseString(const HighlightDataRecord *pattern, const ch
 ** for distinguishing pass 2 styles which compare as equal to the unfinished
 ** style in the original buffer, from pass1 styles which signal a change.
 */
-void SyntaxHighlighter::modifyStyleBuf(TextBuffer *styleBuf, char_type *styleString, int startPos, int endPos,
+void SyntaxHighlighter::modifyStyleBuf(StyleBuffer *styleBuf, char_type *styleString, int startPos, int endPos,
                                        int firstPass2Style) {
     char_type *c;
     char_type bufChar;
@@ -1198,7 +1506,7 @@ HighlightData *SyntaxHighlighter::createHighlightData(PatternSet *patSet) {
     int nPass1Patterns;
     int nPass2Patterns;
     QString parentName;
-    TextBuffer *styleBuf;
+    StyleBuffer *styleBuf;
     HighlightData *highlightData;
 
     /* The highlighting code can't handle empty pattern sets, quietly say no */
@@ -1435,7 +1743,7 @@ HighlightData *SyntaxHighlighter::createHighlightData(PatternSet *patSet) {
     delete[] pass2PatternSrc;
 
     /* Create the style buffer */
-    styleBuf = new TextBuffer();
+    styleBuf = new StyleBuffer();
 
     /* Collect all of the highlighting information in a single structure */
     highlightData = new HighlightData;
@@ -1703,68 +2011,37 @@ HighlightDataRecord *SyntaxHighlighter::compilePatterns(HighlightPattern *patter
         }
     }
 
-    /* Construct and compile the great hairy pattern to match the OR of the
-       end pattern, the error pattern, and all of the start patterns of the
-       sub-patterns */
+    /* Gather the end pattern, the error pattern, and all of the start
+       patterns of the sub-patterns into the set parseString searches with.
+       The expressions are the ones compiled above, in the order parseString
+       relies on to tell them apart */
     for (int patternNum = 0; patternNum < nPatterns; patternNum++) {
-        if (patternSrc[patternNum].endRE.isNull()  && patternSrc[patternNum].errorRE.isNull() && compiledPats[patternNum].subPatterns.empty()) {
-            compiledPats[patternNum].subPatternRE = nullptr;
-            continue;
-        }
-
-        size_t length = (compiledPats[patternNum].colorOnly || patternSrc[patternNum].endRE.isNull()) ? 0 : patternSrc[patternNum].endRE.size() + 5;
-        length += (compiledPats[patternNum].colorOnly || patternSrc[patternNum].errorRE.isNull()) ? 0 : patternSrc[patternNum].errorRE.size() + 5;
+        HighlightDataRecord &pattern = compiledPats[patternNum];
 
-        for (int i = 0; i < compiledPats[patternNum].subPatterns.size(); i++) {
-            int subPatIndex = compiledPats[patternNum].subPatterns[i] - compiledPats;
-            length += compiledPats[subPatIndex].colorOnly ? 0 : patternSrc[subPatIndex].startRE.size() + 5;
-        }
-
-        if (length == 0) {
-            compiledPats[patternNum].subPatternRE = nullptr;
+        if (pattern.colorOnly) {
             continue;
         }
 
-		QStringList bigPatternList;
-		
-        if (!patternSrc[patternNum].endRE.isNull()) {		
-            bigPatternList << QString("(?:%1)").arg(patternSrc[patternNum].endRE);
+        if (pattern.endRE) {
+            pattern.subPatternSet.Add(pattern.endRE);
         }
 
-        if (!patternSrc[patternNum].errorRE.isNull()) {		
-            bigPatternList << QString("(?:%1)").arg(patternSrc[patternNum].errorRE);
+        if (pattern.errorRE) {
+            pattern.subPatternSet.Add(pattern.errorRE);
         }
 
-        for (int i = 0; i < compiledPats[patternNum].subPatterns.size(); i++) {
-            int subPatIndex = compiledPats[patternNum].subPatterns[i] - compiledPats;
-            if (compiledPats[subPatIndex].colorOnly) {
+        for(HighlightDataRecord *const subPat : pattern.subPatterns) {
+            if (subPat->colorOnly) {
                 continue;
-			}
-			
-			bigPatternList << QString("(?:%1)").arg(patternSrc[subPatIndex].startRE);
-        }
-
-		// join together the sub patterns
-		QString bigPattern = bigPatternList.join(QChar::fromLatin1('|'));
+            }
 
-		try {
-			for(QString pattern : bigPatternList) {
-				compiledPats[patternNum].subPatternsRE.push_back(new Regex(qPrintable(pattern), REDFLT_STANDARD));
-			}
-		} catch (const std::exception &e) {
-			compiledPats[patternNum].subPatternsRE.clear();
-			qDebug("Error compiling syntax highlight patterns:\n%s", e.what());
-			return nullptr;
-		}
+            if (!subPat->startRE) {
+                qDebug("Error compiling syntax highlight patterns:\npattern '%s' has no start expression", qPrintable(patternSrc[subPat - compiledPats].name));
+                return nullptr;
+            }
 
-        try {
-            compiledPats[patternNum].subPatternRE = new Regex(qPrintable(bigPattern), REDFLT_STANDARD);
-        } catch (const std::exception &e) {
-            compiledPats[patternNum].subPatternRE = nullptr;
-            qDebug("Error compiling syntax highlight patterns:\n%s", e.what());
-            return nullptr;
+            pattern.subPatternSet.Add(subPat->startRE);
         }
-
     }
 
     /* Copy remaining parameters from pattern template to compiled tree */
@@ -1792,13 +2069,15 @@ int SyntaxHighlighter::IndexOfNamedStyle(const QString &styleName) const {
 
 /*
 ** compile a regular expression and present a user friendly dialog on failure.
+** Expressions are shared through the regex cache, so loading the same
+** language mode again (or in another window) doesn't recompile anything.
 */
-Regex *SyntaxHighlighter::compileREAndWarn(const QString &re) {
+std::shared_ptr<const Regex> SyntaxHighlighter::compileREAndWarn(const QString &re) {
     try {
 #ifdef USE_WCHAR
-        return new Regex(re.toStdWString().c_str(), REDFLT_STANDARD);
+        return RegexCache::Compile(re.toStdWString().c_str(), REDFLT_STANDARD);
 #else	
-        return new Regex(re.toStdString().c_str(), REDFLT_STANDARD);
+        return RegexCache::Compile(re.toStdString().c_str(), REDFLT_STANDARD);
 #endif
     } catch (const std::exception &e) {
 
@@ -1890,17 +2169,17 @@ StyleTableEntry *SyntaxHighlighter::styleEntry(int index) const {
 /*
 ** Callback to parse an "unfinished" region of the buffer.  "unfinished" means
 ** that the buffer has been parsed with pass 1 patterns, but this section has
-** not yet been exposed, and thus never had pass 2 patterns applied.  This
-** callback is invoked when the text widget's display routines encounter one
-** of these unfinished regions.  "pos" is the first position encountered which
-** needs re-parsing.  This routine applies pass 2 patterns to a chunk of
+** not yet had pass 2 patterns applied.  This is invoked for the unfinished
+** regions left by an incremental reparse, and when the highlight style at a
+** position is asked for; the display draws them plain and never parses.
+** "pos" is the first position encountered which needs re-parsing.  This routine applies pass 2 patterns to a chunk of
 ** the buffer of size PASS_2_REPARSE_CHUNK_SIZE beyond pos.
 */
 void SyntaxHighlighter::unfinishedHighlightEncountered(const HighlightEvent *event) {
 
     TextBuffer *buf = event->buffer;
 	
-	TextBuffer *styleBuf                     = highlightData_->styleBuffer;
+	StyleBuffer *styleBuf                    = highlightData_->styleBuffer;
 	ReparseContext *context                  = &highlightData_->contextRequirements;
 	const HighlightDataRecord *pass2Patterns = highlightData_->pass2Patterns;
     
@@ -2009,11 +2288,440 @@ void* SyntaxHighlighter::GetHighlightInfo(int pos) {
 	return reinterpret_cast<void *>(pattern->userStyleIndex);
 }
 
-void SyntaxHighlighter::handleUnparsedRegion(TextBuffer *styleBuffer, int pos) {
+void SyntaxHighlighter::handleUnparsedRegion(StyleBuffer *styleBuffer, int pos) {
+	Q_UNUSED(styleBuffer);
+
+	/* Only text the background worker hasn't got to yet is unfinished */
+	if (!buffer_) {
+		return;
+	}
+
 	HighlightEvent event;
-	event.buffer = styleBuffer;
+	event.buffer = buffer_;
 	event.pos    = pos;
 
 	unfinishedHighlightEncountered(&event);
 
 }
+
+/*
+** Apply pass 2 patterns between "start" and "end", if reparsing left any of it
+** with the unfinished style, which the display shows as plain text.  All of it
+** is parsed again, with a context distance to spare on either side, as an
+** unfinished stretch can end in the middle of a word finished before.
+*/
+void SyntaxHighlighter::finishPass2(TextBuffer *buf, int start, int end) {
+
+    const HighlightDataRecord *const pass2Patterns = highlightData_->pass2Patterns;
+    StyleBuffer *const styleBuf                    = highlightData_->styleBuffer;
+    ReparseContext *const context                  = &highlightData_->contextRequirements;
+
+    if (!pass2Patterns || start >= end) {
+        return;
+    }
+
+    const std::vector<StyleRun> runs = styleBuf->BufGetRuns(start, end);
+    if (std::none_of(runs.begin(), runs.end(), [](const StyleRun &run) { return run.style == UNFINISHED_STYLE; })) {
+        return;
+    }
+
+    const int beginSafety = backwardOneContext(buf, context, start);
+    const int endSafety   = forwardOneContext(buf, context, end);
+
+    String string      = buf->BufGetRange(beginSafety, endSafety);
+    String styleString = styleBuf->BufGetRange(beginSafety, endSafety);
+
+    char_type prevChar = getPrevChar(buf, beginSafety);
+    passTwoParseString(pass2Patterns, string.str, styleString.str, endSafety - beginSafety, &prevChar, delimiters, string.str, nullptr);
+
+    styleString[end - beginSafety] = _T('\0');
+    styleBuf->BufReplace(start, end, &styleString[start - beginSafety], end - start);
+}
+
+/*
+** Have the background worker highlight the document from "pos" on (or from
+** where it already is, if that comes first), until the parse settles past
+** "settledAfter_".  Anything the worker is busy with is abandoned.
+*/
+void SyntaxHighlighter::startBackgroundHighlight(int pos) {
+    backgroundPos_ = (backgroundPos_ == -1) ? pos : qMin(backgroundPos_, pos);
+    speculating_   = 0;
+    ++generation_;
+
+    /* Wait for the event loop, so edits coming in a burst start one window */
+    backgroundTimer_->start();
+}
+
+void SyntaxHighlighter::finishBackgroundHighlight() {
+    backgroundPos_ = -1;
+    settledAfter_  = 0;
+    unverified_.clear();
+    joinHelpers();
+
+#ifdef REGEX_PROFILE
+    if (reportWhenIdle_) {
+        reportExpensivePatterns(PROFILE_REPORT_SIZE);
+        reportWhenIdle_ = false;
+    }
+#endif
+}
+
+/*
+** Give the background worker the next window of the document, from
+** "backgroundPos_".  Parsing starts from the checkpoint before it, as for an
+** incremental reparse.  A new document, with nothing highlighted yet, is
+** split into chunks for the worker and its helpers instead.  Whatever they
+** were given before is abandoned.
+*/
+void SyntaxHighlighter::startBackgroundWindow() {
+
+    if (backgroundPos_ == -1 || !buffer_) {
+        return;
+    }
+
+    /* Results still on their way would otherwise be taken as this job's */
+    ++generation_;
+
+    TextBuffer *const buf         = buffer_;
+    ReparseContext *const context = &highlightData_->contextRequirements;
+    const int length              = buf->BufGetLength();
+
+    if (backgroundPos_ >= length) {
+        finishBackgroundHighlight();
+        return;
+    }
+
+    if (highlightData_->pass1Patterns && backgroundPos_ == 0 && highlightData_->checkpoints.empty() && length >= 2 * SPECULATIVE_CHUNK_SIZE && std::thread::hardware_concurrency() > 1) {
+        startSpeculativeHighlight();
+        return;
+    }
+
+    int parseStart       = backgroundPos_;
+    char_type startStyle = PLAIN_STYLE;
+
+    if (highlightData_->pass1Patterns) {
+        parseStart = checkpointBefore(backwardOneContext(buf, context, backgroundPos_), &startStyle);
+    }
+
+    std::unique_ptr<HighlightJob> job = copyWindow(parseStart, startStyle, qMin(length, backgroundPos_ + BACKGROUND_WINDOW_SIZE));
+
+    {
+        std::lock_guard<std::mutex> lock(workerLock_);
+        jobs_.clear();
+        jobs_.push_back(std::move(job));
+    }
+
+    workerWake_.notify_one();
+}
+
+/*
+** Split a new document into a chunk for each processor, starting at line
+** starts, and have them all highlighted at once, each as though it began
+** outside of any pattern, by the worker and a helper thread for each of the
+** others.  Only the first one is sure to be right, the others are checked in
+** order once they are all done (see checkNextChunk).
+*/
+void SyntaxHighlighter::startSpeculativeHighlight() {
+
+    TextBuffer *const buf = buffer_;
+    const int length      = buf->BufGetLength();
+    const int nChunks     = qMin(static_cast<int>(std::thread::hardware_concurrency()), length / SPECULATIVE_CHUNK_SIZE);
+
+    std::vector<int> starts;
+    for (int i = 0; i < nChunks; ++i) {
+        const int start = (i == 0) ? 0 : buf->BufStartOfLine(static_cast<int>(static_cast<long long>(length) * i / nChunks));
+        if (starts.empty() || start > starts.back()) {
+            starts.push_back(start);
+        }
+    }
+
+    std::deque<std::unique_ptr<HighlightJob>> jobs;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        jobs.push_back(copyWindow(starts[i], PLAIN_STYLE, (i + 1 < starts.size()) ? starts[i + 1] : length));
+        jobs.back()->speculative = true;
+    }
+
+    unverified_.assign(starts.begin() + 1, starts.end());
+    speculating_ = static_cast<int>(jobs.size());
+
+    /* Helpers still at the chunks of an abandoned document stop at once */
+    {
+        std::lock_guard<std::mutex> lock(workerLock_);
+        jobs_.clear();
+    }
+
+    joinHelpers();
+
+    {
+        std::lock_guard<std::mutex> lock(workerLock_);
+        jobs_.swap(jobs);
+    }
+
+    workerWake_.notify_one();
+    for (size_t i = 1; i < starts.size(); ++i) {
+        helpers_.push_back(std::thread(&SyntaxHighlighter::backgroundWorker, this, true));
+    }
+}
+
+/*
+** Wait for the helper threads to run out of jobs and exit.  They only get
+** any while a new document is being split into chunks, and stop looking
+** for more once they are all taken.
+*/
+void SyntaxHighlighter::joinHelpers() {
+    for (std::thread &helper : helpers_) {
+        helper.join();
+    }
+
+    helpers_.clear();
+}
+
+/*
+** Copy the text from "parseStart" to "parseEnd" for the background worker,
+** with enough context on both sides for its styles to come out right, to
+** be parsed starting in the pattern with style "startStyle"
+*/
+std::unique_ptr<SyntaxHighlighter::HighlightJob> SyntaxHighlighter::copyWindow(int parseStart, char_type startStyle, int parseEnd) {
+
+    TextBuffer *const buf         = buffer_;
+    StyleBuffer *const styleBuf   = highlightData_->styleBuffer;
+    ReparseContext *const context = &highlightData_->contextRequirements;
+
+    std::unique_ptr<HighlightJob> job(new HighlightJob);
+    job->generation  = generation_;
+    job->parseStart  = parseStart;
+    job->startStyle  = startStyle;
+    job->parseEnd    = parseEnd;
+    job->safeEnd     = forwardOneContext(buf, context, parseEnd);
+    job->textStart   = backwardOneContext(buf, context, parseStart);
+    job->prevChar    = getPrevChar(buf, job->textStart);
+    job->speculative = false;
+
+    const int textEnd = forwardOneContext(buf, context, job->safeEnd);
+    job->text   = buf->BufGetRange(job->textStart, textEnd);
+    job->styles = styleBuf->BufGetRuns(job->textStart, textEnd);
+
+    const std::vector<ParseCheckpoint> &checkpoints = highlightData_->checkpoints;
+    auto byPosition = [](const ParseCheckpoint &c, int p) { return c.pos < p; };
+    job->checkpoints.assign(std::lower_bound(checkpoints.begin(), checkpoints.end(), job->parseStart, byPosition),
+                            std::lower_bound(checkpoints.begin(), checkpoints.end(), job->safeEnd + 1, byPosition));
+
+    return job;
+}
+
+/*
+** Body of the background worker thread, highlighting the windows it is
+** given one at a time, until the highlighter is destroyed.  A "helper" stops
+** once there is nothing left to do rather than waiting for more.
+*/
+void SyntaxHighlighter::backgroundWorker(bool helper) {
+
+    for (;;) {
+        std::unique_ptr<HighlightJob> job;
+        {
+            std::unique_lock<std::mutex> lock(workerLock_);
+            if (!helper) {
+                workerWake_.wait(lock, [this]() { return quit_ || !jobs_.empty(); });
+            }
+
+            if (quit_ || jobs_.empty()) {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        HighlightResult result;
+        if (!highlightWindow(job.get(), &result)) {
+            continue;
+        }
+
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(workerLock_);
+            first = results_.empty();
+            results_.push_back(std::move(result));
+        }
+
+        /* One notification covers everything queued before it is handled */
+        if (first) {
+            Q_EMIT backgroundStylesReady();
+        }
+    }
+}
+
+/*
+** Highlight the window of text in "job" with pass 1 and then pass 2 patterns,
+** the way parseBufferRange does for a range of the buffer, and fill in
+** "result" with the styles from job->parseStart to job->parseEnd, and the
+** checkpoints passed on the way.  Runs on
+** the worker thread, touching nothing but the job and the (unchanging)
+** compiled patterns.  Returns false if the job was abandoned.
+*/
+bool SyntaxHighlighter::highlightWindow(HighlightJob *job, HighlightResult *result) {
+
+    HighlightDataRecord *const pass1Patterns = highlightData_->pass1Patterns;
+    HighlightDataRecord *const pass2Patterns = highlightData_->pass2Patterns;
+    char_type *const parentStyles            = highlightData_->parentStyles;
+
+    /* The parser fills in styles one character at a time */
+    std::vector<char_type> styleString;
+    styleString.reserve(job->text.len + 1);
+    for (const StyleRun &run : job->styles) {
+        styleString.insert(styleString.end(), run.length, run.style);
+    }
+    styleString.push_back(_T('\0'));
+
+    char_type *const text   = job->text.str;
+    char_type *const styles = styleString.data();
+
+    /* Parse with pass 1 patterns.  Parsing in a sub-pattern stops where it
+       ends, carry on one level up in the pattern hierarchy from there */
+    if (pass1Patterns) {
+        const char_type *const end = &text[job->safeEnd - job->textStart];
+        const char_type *stringPtr = &text[job->parseStart - job->textStart];
+        char_type *stylePtr        = &styles[job->parseStart - job->textStart];
+        char_type prevChar         = (stringPtr == text) ? job->prevChar : stringPtr[-1];
+        int style                  = job->startStyle;
+
+        CheckpointRecorder recorder(job->checkpoints.data(), job->checkpoints.data() + job->checkpoints.size());
+        recorder.start(text, job->textStart, job->parseStart, job->safeEnd, job->prevChar);
+        recorder.watch(&generation_, job->generation);
+
+        while (stringPtr < end) {
+            HighlightDataRecord *pattern = patternOfStyle(pass1Patterns, style);
+            if (!pattern) {
+                pattern = pass1Patterns;
+            }
+
+            parseString(pattern, &stringPtr, &stylePtr, static_cast<int>(end - stringPtr), &prevChar, MatchFlags::FlagNone, delimiters, text, nullptr, &recorder);
+
+            if (pattern == pass1Patterns || job->generation != generation_) {
+                break;
+            }
+
+            style = parentStyleOf(parentStyles, style);
+        }
+
+        for (const ParseCheckpoint &checkpoint : recorder.found) {
+            if (checkpoint.pos > job->parseEnd) {
+                break;
+            }
+            result->checkpoints.push_back(checkpoint);
+        }
+    }
+
+    if (job->generation != generation_) {
+        return false;
+    }
+
+    /* Then with pass 2 patterns, wherever they apply */
+    if (pass2Patterns) {
+        char_type prevChar = job->prevChar;
+        passTwoParseString(pass2Patterns, text, styles, job->parseEnd - job->textStart, &prevChar, delimiters, text, nullptr);
+    }
+
+    result->generation  = job->generation;
+    result->start       = job->parseStart;
+    result->speculative = job->speculative;
+
+    for (int i = job->parseStart - job->textStart; i < job->parseEnd - job->textStart; ++i) {
+        if (result->runs.empty() || result->runs.back().style != styles[i]) {
+            result->runs.push_back(StyleRun{ 1, styles[i] });
+        } else {
+            ++result->runs.back().length;
+        }
+    }
+
+    return true;
+}
+
+/*
+** Copy the styles the background worker found into the style buffer, and
+** give it the next window, until the parser is back in the state it was in
+** before a context distance past all the changes, or the document ends.
+** Without pass 1 patterns, there is no state, the styles are compared.
+*/
+void SyntaxHighlighter::publishBackgroundStyles() {
+
+    std::deque<HighlightResult> results;
+    {
+        std::lock_guard<std::mutex> lock(workerLock_);
+        results.swap(results_);
+    }
+
+    for (const HighlightResult &result : results) {
+
+        /* The text changed since the window was copied */
+        if (result.generation != generation_ || backgroundPos_ == -1) {
+            continue;
+        }
+
+        StyleBuffer *const styleBuf   = highlightData_->styleBuffer;
+        ReparseContext *const context = &highlightData_->contextRequirements;
+
+        int length = 0;
+        for (const StyleRun &run : result.runs) {
+            length += run.length;
+        }
+
+        const int start = result.start;
+        const int end   = start + length;
+        const int from  = qMax(start, settledAfter_);
+
+        const std::vector<StyleRun> old = styleBuf->BufGetRuns(start, end);
+
+        /* The chunks of a new document have nothing to compare with */
+        bool settled;
+        if (result.speculative) {
+            settled = mergeCheckpoints(result.checkpoints, start, end, end + 1, start);
+        } else if (highlightData_->pass1Patterns) {
+            settled = mergeCheckpoints(result.checkpoints, start, end, forwardOneContext(buffer_, context, settledAfter_), backwardOneContext(buffer_, context, end));
+        } else {
+            settled = from < end && end >= forwardOneContext(buffer_, context, settledAfter_) &&
+                      sameStyles(old, result.runs, from - start);
+        }
+
+        if (!sameStyles(old, result.runs, 0)) {
+            styleBuf->BufReplace(start, end, result.runs);
+            Q_EMIT stylesChanged(start, end);
+        }
+
+        if (result.speculative) {
+            if (--speculating_ == 0) {
+                checkNextChunk(0, 0);
+            }
+        } else if (end >= buffer_->BufGetLength()) {
+            finishBackgroundHighlight();
+        } else if (settled) {
+            checkNextChunk(start, end);
+        } else {
+            backgroundPos_ = end;
+            startBackgroundWindow();
+        }
+    }
+}
+
+/*
+** Check the next chunk of a new document highlighted ahead of time, after the
+** window from "start" to "end" settled.  The parse agreeing with the chunk it
+** settled in makes that one right up to the start of the next, which is
+** where to go on from, or from "end" if the window went past it.  Once none
+** are left, background highlighting is done.
+*/
+void SyntaxHighlighter::checkNextChunk(int start, int end) {
+
+    auto next = std::upper_bound(unverified_.begin(), unverified_.end(), start);
+    if (next == unverified_.end()) {
+        finishBackgroundHighlight();
+        return;
+    }
+
+    /* The checkpoints up to "end" are new ones, settling on them means nothing */
+    backgroundPos_ = qMax(*next, end);
+    settledAfter_  = backgroundPos_;
+    unverified_.erase(unverified_.begin(), std::upper_bound(unverified_.begin(), unverified_.end(), backgroundPos_));
+
+    startBackgroundWindow();
+}
@@ -5,6 +5,7 @@
 #include "regex/Regex.h"
 #include "IBufferModifiedHandler.h"
 #include "IHighlightHandler.h"
+#include "StyleBuffer.h"
 #include "Types.h"
 #include <QObject>
 #include <QTextCharFormat>
@@ -12,7 +13,15 @@
 #include <QVector>
 #include <QMap>
 #include <QStringList>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class QTimer;
 
 /* Maximum allowed number of styles (also limited by representation of
    styles as a byte - 'b') */
@@ -53,6 +62,7 @@ struct HighlightPattern;
 struct PatternSet;
 struct StyleTableEntry;
 struct HighlightDataRecord;
+struct CheckpointRecorder;
 
 struct StyleTableEntry {
 	QString highlightName;
@@ -71,6 +81,14 @@ struct ReparseContext {
 	int nChars;
 };
 
+/* A position at which pass 1 parsing was between matches of the pattern with
+   style "style", so that parsing from there with that pattern (and its
+   parents once it ends) goes on exactly as it did */
+struct ParseCheckpoint {
+	int       pos;
+	char_type style;
+};
+
 enum MatchFlags {
 	FlagNone     = 0x00,
 	FlagAnchored = 0x01,
@@ -87,9 +105,34 @@ public:
     virtual void unfinishedHighlightEncountered(const HighlightEvent *event) override;
 
 public:
-	TextBuffer *styleBuffer() const;
+	StyleBuffer *styleBuffer() const;
 	StyleTableEntry *styleEntry(int index) const;
 	void* GetHighlightInfo(int pos);
+	void reportExpensivePatterns(int n) const;
+
+Q_SIGNALS:
+	/* Styles between "start" and "end" were changed by the background
+	   highlighter, outside of any buffer modification */
+	void stylesChanged(int start, int end);
+
+	/* Raised by the background worker when it has results to publish */
+	void backgroundStylesReady();
+
+private Q_SLOTS:
+	void publishBackgroundStyles();
+	void startBackgroundWindow();
+
+private:
+	struct HighlightJob;
+
+	/* Styles the background worker found for one window of the document */
+	struct HighlightResult {
+		int                          generation;
+		int                          start;
+		bool                         speculative;
+		std::vector<StyleRun>        runs;
+		std::vector<ParseCheckpoint> checkpoints;
+	};
 
 private:
 	HighlightData *createHighlightData(PatternSet *patSet);
@@ -101,28 +144,39 @@ private:
 	QString BgColorOfNamedStyle(const QString &styleName);
 	QString ColorOfNamedStyle(const QString &styleName) const;
 	QString LanguageModeName(int mode);
-	Regex *compileREAndWarn(const QString &re);
+	std::shared_ptr<const Regex> compileREAndWarn(const QString &re);
 	bool FontOfNamedStyleIsBold(const QString &styleName);
 	bool FontOfNamedStyleIsItalic(const QString &styleName);
 	bool NamedStyleExists(const QString &styleName);
-	bool isParentStyle(const char_type *parentStyles, int style1, int style2);
-	bool parseString(const HighlightDataRecord *pattern, const char_type **string, char_type **styleString, int length, char_type *prevChar, MatchFlags flags, const char_type *delimiters, const char_type *lookBehindTo, const char_type *match_till);
+	bool parseString(const HighlightDataRecord *pattern, const char_type **string, char_type **styleString, int length, char_type *prevChar, MatchFlags flags, const char_type *delimiters, const char_type *lookBehindTo, const char_type *match_till, CheckpointRecorder *checkpoints = nullptr);
 	int IndexOfNamedStyle(const QString &styleName) const;
 	int backwardOneContext(TextBuffer *buf, ReparseContext *context, int fromPos);
-	int findSafeParseRestartPos(TextBuffer *buf, HighlightData *highlightData, int *pos);
+	int checkpointBefore(int pos, char_type *style) const;
+	int checkpointAfter(int pos) const;
 	int findTopLevelParentIndex(const QVector<HighlightPattern> &patList, int nPats, int index) const;
 	int forwardOneContext(TextBuffer *buf, ReparseContext *context, int fromPos);
 	int indexOfNamedPattern(const HighlightPattern *patList, int nPats, const QString &patName) const;
 	int indexOfNamedPattern(const QVector<HighlightPattern> &patList, int nPats, const QString &patName) const;
-	int lastModified(TextBuffer *styleBuf) const;
+	int lastModified(StyleBuffer *styleBuf) const;
 	int parentStyleOf(const char_type *parentStyles, int style);
-	int parseBufferRange(const HighlightDataRecord *pass1Patterns, const HighlightDataRecord *pass2Patterns, TextBuffer *buf, TextBuffer *styleBuf, ReparseContext *contextRequirements, int beginParse, int endParse, const char_type *delimiters);
-	int patternIsParsable(const HighlightDataRecord *pattern);
+	int parseBufferRange(const HighlightDataRecord *pass1Patterns, const HighlightDataRecord *pass2Patterns, TextBuffer *buf, StyleBuffer *styleBuf, ReparseContext *contextRequirements, int beginParse, int endParse, const char_type *delimiters, CheckpointRecorder *checkpoints);
 	static HighlightDataRecord *patternOfStyle(HighlightDataRecord *patterns, int style);
+	static void collectExpressions(const HighlightDataRecord *pattern, std::vector<std::shared_ptr<const Regex>> *regexes);
+	void resetPatternProfiles();
 	void fillStyleString(const char_type *&stringPtr, char_type *&stylePtr, const char_type *toPtr, char_type style, char_type *prevChar);
-	void handleUnparsedRegion(TextBuffer *styleBuffer, int pos);
-	void incrementalReparse(HighlightData *highlightData, TextBuffer *buf, int pos, int nInserted, const char_type *delimiters);
-	void modifyStyleBuf(TextBuffer *styleBuf, char_type *styleString, int startPos, int endPos, int firstPass2Style);
+	void handleUnparsedRegion(StyleBuffer *styleBuffer, int pos);
+	bool incrementalReparse(HighlightData *highlightData, TextBuffer *buf, int pos, int nInserted, const char_type *delimiters);
+	bool mergeCheckpoints(const std::vector<ParseCheckpoint> &found, int start, int end, int settleFrom, int settleTo);
+	void finishPass2(TextBuffer *buf, int start, int end);
+	void startBackgroundHighlight(int pos);
+	void startSpeculativeHighlight();
+	std::unique_ptr<HighlightJob> copyWindow(int parseStart, char_type startStyle, int parseEnd);
+	void checkNextChunk(int start, int end);
+	void finishBackgroundHighlight();
+	void joinHelpers();
+	void backgroundWorker(bool helper);
+	bool highlightWindow(HighlightJob *job, HighlightResult *result);
+	void modifyStyleBuf(StyleBuffer *styleBuf, char_type *styleString, int startPos, int endPos, int firstPass2Style);
 	void passTwoParseString(const HighlightDataRecord *pattern, char_type *string, char_type *styleString, int length, char_type *prevChar, const char_type *delimiters, const char_type *lookBehindTo, const char_type *match_till);
 	void recolorSubexpr(const std::unique_ptr<RegexMatch> &match, int subexpr, int style, const char_type *string, char_type *styleString);
 
@@ -141,6 +195,30 @@ private:
 
 	/* list of available highlight styles */
 	QVector<HighlightStyleRec *> highlightStyles_;
+
+	/* Background highlighting.  The worker thread highlights one window of
+	   the document at a time, from a copy of its text, and hands the styles
+	   back in results_.  A new document is split into chunks first, which
+	   helper threads, started for them and joined once they are done, help
+	   it highlight all at once.  Everything else is only touched on the GUI
+	   thread. */
+	TextBuffer *                                buffer_;            // Text buffer last modified.
+	QTimer *                                    backgroundTimer_;   // Starts the next window.
+	int                                         backgroundPos_;     // Where the next window starts, -1 when idle.
+	int                                         settledAfter_;      // The parse settling past here means the job is done.
+	int                                         speculating_;       // Chunks still being highlighted.
+	std::vector<int>                            unverified_;        // Chunk starts not checked yet, in order.
+	std::atomic<int>                            generation_;        // Current job, results of older ones are dropped.
+	std::thread                                 worker_;
+	std::vector<std::thread>                    helpers_;           // Take jobs until there are none left.
+	std::mutex                                  workerLock_;
+	std::condition_variable                     workerWake_;
+	std::deque<std::unique_ptr<HighlightJob>>   jobs_;              // Jobs waiting for a worker.
+	std::deque<HighlightResult>                 results_;
+	bool                                        quit_;
+#ifdef REGEX_PROFILE
+	bool                                        reportWhenIdle_;
+#endif
 };
 
 #endif
@@ -2,6 +2,9 @@
 #include "TextBuffer.h"
 #include "IBufferModifiedHandler.h"
 #include "IPreDeleteHandler.h"
+#include "regex/Regex.h"
+#include "regex/RegexIterator.h"
+#include "regex/RegexParallelSearch.h"
 //#include "Rangeset.h"
 
 #include <cstdio>
@@ -180,6 +183,179 @@ const char_type *TextBuffer::BufAsString() {
 	return text;
 }
 
+/*
+** Search the buffer with the compiled expression "re" in place, stepping over
+** the gap instead of moving it.  A forward search finds the first match that
+** begins at or after "start" and before "end", a backward search the last one
+** that begins between "start" and "end".  Matches may extend to the end of the
+** buffer and look-behind may look back to its beginning.  Returns nullptr if
+** nothing matched.  The match points into the buffer and is only valid until
+** it is modified; BufPositionOf translates its captures to positions.
+*/
+RegexMatch *TextBuffer::BufSearchRE(const Regex &re, int start, int end, Direction direction, const char_type *delimiters) const {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+
+	return re.ExecRE(textAt(start), textAt(end), direction, prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap);
+}
+
+/*
+** Same as above, but gives up once "budget" is spent, so that an interactive
+** search can return to the event loop.  "status" tells whether a match was
+** found, there is none, or the budget ran out; in the latter case "stoppedAt"
+** is set to the position the search got to and may be resumed from (as the
+** new "start" of a forward search or "end" of a backward one).  A status of
+** NoProgress means a single attempt at "start" ("end" going backward) takes
+** more than the budget; resuming with the same budget stops there again, so
+** the caller must grow it to get any further.
+*/
+RegexMatch *TextBuffer::BufSearchRE(const Regex &re, int start, int end, Direction direction, const char_type *delimiters, const ExecBudget &budget, ExecStatus *status, int *stoppedAt) const {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+	const char_type *stoppedText;
+
+	RegexMatch *match = re.ExecRE(textAt(start), textAt(end), direction, prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap, budget, status, &stoppedText);
+
+	if (stoppedAt) {
+		*stoppedAt = stoppedText ? BufPositionOf(stoppedText) : -1;
+	}
+
+	return match;
+}
+
+/*
+** Count the non-overlapping matches of "re" that begin between "start" and
+** "end", searching in place like BufSearchRE.
+*/
+size_t TextBuffer::BufCountRE(const Regex &re, int start, int end, const char_type *delimiters) const {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+
+	return RegexIterator::Count(re, textAt(start), textAt(end), prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap);
+}
+
+/*
+** Find all non-overlapping matches of "re" that begin between "start" and
+** "end", searching the buffer in place on several threads.  The matches point
+** into the buffer like those of BufSearchRE.
+*/
+std::vector<Capture> TextBuffer::BufFindAllRE(const Regex &re, int start, int end, const char_type *delimiters) const {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+
+	return RegexParallelSearch::FindAll(re, textAt(start), textAt(end), prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap);
+}
+
+/*
+** Find the non-overlapping matches of "re" that begin between "start" and
+** "end" like BufFindAllRE, but on the calling thread and stopping after
+** "maxMatches" of them, which are appended to "matches".  Returns where a
+** later call should start to carry on with the following matches: "end" (or
+** the end of a match that runs past it) once the range has been searched.
+*/
+int TextBuffer::BufFindRE(const Regex &re, int start, int end, const char_type *delimiters, size_t maxMatches, std::vector<Capture> *matches) const {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+
+	/* '\0' after the buffer, like the other searches here, so that $ matches
+	   at its end and the matches are the ones BufFindAllRE would find */
+	RegexIterator it(re, textAt(start), textAt(end), prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap);
+	it.SetRecordCaptures(false);
+
+	int searchedTo = end;
+	Capture last = { nullptr, nullptr };
+
+	for (size_t n = 0; n < maxMatches; ++n) {
+		if (!it.Next()) {
+			return searchedTo;
+		}
+
+		last = it.Match().capture(0);
+		matches->push_back(last);
+		searchedTo = std::max(end, BufPositionOf(last.end));
+	}
+
+	if (!last.start) {
+		return start;
+	}
+
+	/* Stopped short, carry on after the last match (past it if it's empty) */
+	return BufPositionOf(last.end) + (last.end == last.start ? 1 : 0);
+}
+
+/*
+** Replace all non-overlapping matches of "re" that begin between "start" and
+** "end" with "replaceWith", in which & and \1 to \9 stand for the text of the
+** match and its captures as in SubstituteRE.  The new text is built in one
+** pass over the buffer and replaces the range from the start of the first to
+** the end of the last match in a single modification, so modify callbacks run
+** (and undo is recorded) once however many matches there are.  Returns the
+** number of replacements made.
+*/
+int TextBuffer::BufReplaceAllRE(const Regex &re, int start, int end, const char_type *replaceWith, const char_type *delimiters) {
+	const TextGap gap = { &buf_[gapStart_], &buf_[gapEnd_] };
+	const char_type prevChar = BufGetCharacter(start - 1);
+
+	RegexIterator it(re, textAt(start), textAt(end), prevChar, '\0', delimiters, textAt(0), textAt(length_), &gap);
+
+	std::string replaced;
+	int rangeStart = 0;
+	int copiedTo = 0;
+	int nReplaced = 0;
+
+	while (it.Next()) {
+		const Capture match = it.Match().capture(0);
+		const int matchStart = BufPositionOf(match.start);
+
+		if (nReplaced == 0) {
+			rangeStart = copiedTo = matchStart;
+		}
+
+		/* Copy the text between the matches, which may be split by the gap */
+		if (copiedTo < gapStart_) {
+			const int part = std::min(matchStart, gapStart_);
+			replaced.append(&buf_[copiedTo], part - copiedTo);
+			copiedTo = part;
+		}
+		replaced.append(textAt(copiedTo), matchStart - copiedTo);
+
+		it.Match().SubstituteRE(replaceWith, &replaced);
+		copiedTo = BufPositionOf(match.end);
+		++nReplaced;
+	}
+
+	if (nReplaced != 0) {
+		BufReplace(rangeStart, copiedTo, replaced.data(), static_cast<int>(replaced.size()));
+	}
+
+	return nReplaced;
+}
+
+/*
+** Return the buffer position of "text", a pointer into the buffer such as
+** the captures of a match returned by BufSearchRE.
+*/
+int TextBuffer::BufPositionOf(const char_type *text) const {
+	if (text < &buf_[gapStart_]) {
+		return text - buf_;
+	} else {
+		return text - buf_ - (gapEnd_ - gapStart_);
+	}
+}
+
+/*
+** Return a pointer to the character at buffer position "pos", where the
+** position at the gap is the first character after it.  The text after the
+** gap is always followed by a terminating null.
+*/
+const char_type *TextBuffer::textAt(int pos) const {
+	if (pos < gapStart_) {
+		return &buf_[pos];
+	} else {
+		return &buf_[pos + gapEnd_ - gapStart_];
+	}
+}
+
 /*
 ** Replace the entire contents of the text buffer
 */
@@ -1756,7 +1932,7 @@ void TextBuffer::moveGap(int pos) {
 void TextBuffer::reallocateBuf(int newGapStart, int newGapLen) {
 
 	auto newBuf = new char_type[length_ + newGapLen + 1];
-	newBuf[length_ + PREFERRED_GAP_SIZE] = '\0';
+	newBuf[length_ + newGapLen] = '\0';
 	int newGapEnd = newGapStart + newGapLen;
 #ifdef USE_MEMCPY
 	if (newGapStart <= gapStart_) {
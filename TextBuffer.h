@@ -4,11 +4,14 @@
 
 #include "Types.h"
 #include "Selection.h"
+#include "regex/RegexMatch.h"
 #include <deque>
 #include <string>
+#include <vector>
 
 class IBufferModifiedHandler;
 class IPreDeleteHandler;
+class Regex;
 
 /* Maximum length in characters of a tab or control character expansion
    of a single buffer character */
@@ -104,6 +107,12 @@ public:
 	char_type BufGetCharacter(int pos) const;
 	char_type BufGetNullSubsChar() const;
 	const char_type *BufAsString();
+	RegexMatch *BufSearchRE(const Regex &re, int start, int end, Direction direction, const char_type *delimiters) const;
+	RegexMatch *BufSearchRE(const Regex &re, int start, int end, Direction direction, const char_type *delimiters, const ExecBudget &budget, ExecStatus *status, int *stoppedAt) const;
+	size_t BufCountRE(const Regex &re, int start, int end, const char_type *delimiters) const;
+	std::vector<Capture> BufFindAllRE(const Regex &re, int start, int end, const char_type *delimiters) const;
+	int BufFindRE(const Regex &re, int start, int end, const char_type *delimiters, size_t maxMatches, std::vector<Capture> *matches) const;
+	int BufReplaceAllRE(const Regex &re, int start, int end, const char_type *replaceWith, const char_type *delimiters);
 	int BufCmp(int pos, int len, const char_type *cmpText) const;
 	int BufCountBackwardNLines(int startPos, int nLines) const;
 	int BufCountDispChars(int lineStartPos, int targetPos) const;
@@ -115,6 +124,7 @@ public:
 	int BufGetExpandedChar(int pos, int indent, char_type *outStr) const;
 	int BufGetLength() const;
 	int BufGetTabDistance() const;
+	int BufPositionOf(const char_type *text) const;
 	int BufStartOfLine(int pos) const;
 	void BufAddHighPriorityModifyCB(IBufferModifiedHandler *handler);
 	void BufAddModifyCB(IBufferModifiedHandler *handler);
@@ -158,6 +168,7 @@ public:
 private:
 	bool searchBackward(int startPos, char_type searchChar, int *foundPos) const;
 	bool searchForward(int startPos, char_type searchChar, int *foundPos) const;
+	const char_type *textAt(int pos) const;
 	String getSelectionText(const Selection &sel) const;
 	int insert(int pos, const char_type *text);
 	int insert(int pos, const char_type *text, int length);
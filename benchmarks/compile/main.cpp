@@ -0,0 +1,135 @@
+/*
+ * Startup benchmark: compiles every expression the syntax highlighter
+ * builds from a language definition file, i.e. the start, end and error
+ * patterns (the sub-pattern sets parseString searches reuse these), and
+ * reports how long a full set takes to compile.
+ *
+ * usage: compile-bench [language file] [iterations]
+ */
+
+#include "regex/Regex.h"
+#include "QJson4/QJsonArray.h"
+#include "QJson4/QJsonDocument.h"
+#include "QJson4/QJsonObject.h"
+#include "QJson4/QJsonParseError.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringList>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+struct Pattern {
+	QString startRE;
+	QString endRE;
+	QString errorRE;
+};
+
+QString stringOf(const QJsonObject &obj, const char *key) {
+	if (obj.contains(key) && !obj[key].isNull()) {
+		return obj[key].toString();
+	}
+
+	return QString();
+}
+
+//------------------------------------------------------------------------------
+// Name: loadPatterns
+//------------------------------------------------------------------------------
+std::vector<Pattern> loadPatterns(const QString &filename) {
+
+	std::vector<Pattern> patterns;
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return patterns;
+	}
+
+	QJsonParseError e;
+	QJsonDocument d = QJsonDocument::fromJson(file.readAll(), &e);
+
+	for (QJsonValue entry : d.array()) {
+		QJsonObject obj = entry.toObject();
+
+		Pattern pattern;
+		pattern.startRE = stringOf(obj, "start");
+		pattern.endRE   = stringOf(obj, "end");
+		pattern.errorRE = stringOf(obj, "error");
+		patterns.push_back(pattern);
+	}
+
+	return patterns;
+}
+
+//------------------------------------------------------------------------------
+// Name: expressionsFor
+// Desc: the same set of expressions SyntaxHighlighter::compilePatterns builds
+//------------------------------------------------------------------------------
+QStringList expressionsFor(const std::vector<Pattern> &patterns) {
+
+	QStringList expressions;
+
+	for (const Pattern &pattern : patterns) {
+		for (const QString &re : {pattern.startRE, pattern.endRE, pattern.errorRE}) {
+			if (!re.isNull()) {
+				expressions << re;
+			}
+		}
+	}
+
+	return expressions;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+
+	const QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1]) : QString(":/DefaultLanguages.json");
+	const int iterations   = (argc > 2) ? atoi(argv[2]) : 200;
+
+	const QStringList expressions = expressionsFor(loadPatterns(filename));
+	if (expressions.isEmpty()) {
+		fprintf(stderr, "no patterns found in %s\n", qPrintable(filename));
+		return 1;
+	}
+
+	std::vector<std::string> sources;
+	size_t sourceSize = 0;
+	for (const QString &re : expressions) {
+		sources.push_back(re.toStdString());
+		sourceSize += sources.back().size();
+	}
+
+	size_t compiled = 0;
+	size_t failed   = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; i++) {
+		for (const std::string &re : sources) {
+			try {
+				Regex regex(re.c_str(), REDFLT_STANDARD);
+				compiled++;
+			} catch (const RegexException &) {
+				failed++;
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	const double totalUs = std::chrono::duration<double, std::micro>(end - start).count();
+
+	printf("expressions:      %zu\n", sources.size());
+	printf("source bytes:     %zu\n", sourceSize);
+	printf("iterations:       %d\n", iterations);
+	printf("compiled:         %zu\n", compiled);
+	printf("failed:           %zu\n", failed);
+	printf("total time (us):  %.1f\n", totalUs);
+	printf("per set (us):     %.2f\n", totalUs / iterations);
+	printf("per regex (us):   %.3f\n", totalUs / (iterations * sources.size()));
+}
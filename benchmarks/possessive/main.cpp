@@ -0,0 +1,131 @@
+/*
+ * Atomic group benchmark: searches long unterminated strings and comments,
+ * the worst case for a highlighter pattern whose end never comes, once with
+ * the usual backtracking form of each pattern and once with its atomic or
+ * possessive form, and reports the time each search took. Searches are run
+ * without memoization, as older patterns were, and with the default
+ * automatic memoization; each one gives up after a time limit.
+ *
+ * usage: possessive-bench [input length] [time limit in ms]
+ */
+
+#include "regex/Regex.h"
+#include "regex/RegexException.h"
+#include "regex/RegexMatch.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+struct Case {
+	const char *name;
+	const char *backtracking;
+	const char *atomic;
+	std::string (*input)(size_t length);
+};
+
+//------------------------------------------------------------------------------
+// Name: repeat
+//------------------------------------------------------------------------------
+std::string repeat(const char *prefix, const char *unit, size_t length) {
+	std::string text = prefix;
+	while (text.size() < length) {
+		text += unit;
+	}
+
+	return text;
+}
+
+std::string unterminatedString(size_t length) {
+	return repeat("s = \"", "abc def \\\" ghi ", length);
+}
+
+std::string unterminatedComment(size_t length) {
+	return repeat("/* ", "int x = a * b; ** ", length);
+}
+
+std::string unterminatedWords(size_t length) {
+	return repeat("'", "xyz uvw ", length);
+}
+
+const Case Cases[] = {
+	{ "string",      "\"([^\"\\\\]+|\\\\.)*\"",              "\"(?>[^\"\\\\]+|\\\\.)*+\"",          unterminatedString     },
+	{ "string-2",    "\"([^\"\\\\]|\\\\.)*\"",               "\"([^\"\\\\]++|\\\\.)*+\"",           unterminatedString     },
+	{ "comment",     "/\\*([^*]+|\\*+[^*/])*\\*+/",          "/\\*(?>[^*]++|\\*++[^*/])*+\\*+/",    unterminatedComment    },
+	{ "words",       "'([a-z]+ ?)*'",                        "'(?>[a-z]+ ?)*+'",                    unterminatedWords      },
+};
+
+//------------------------------------------------------------------------------
+// Name: timeSearch
+// Desc: searches 'text' from its start, returns the time taken in ms or a
+//       negative number if the search ran out of time
+//------------------------------------------------------------------------------
+double timeSearch(Regex &regex, const std::string &text, Memoization mode, unsigned long limit, bool *matched) {
+
+	regex.SetMemoization(mode);
+
+	ExecBudget budget;
+	budget.milliseconds = limit;
+
+	ExecStatus status;
+
+	auto start = std::chrono::steady_clock::now();
+	RegexMatch *match = regex.ExecRE(text.c_str(), text.c_str() + text.size(), Direction::Forward, '\0', '\0', nullptr, nullptr, nullptr, nullptr, budget, &status, nullptr);
+	auto end = std::chrono::steady_clock::now();
+
+	*matched = (match != nullptr);
+	delete match;
+
+	if (status == ExecStatus::BudgetExceeded || status == ExecStatus::NoProgress || status == ExecStatus::NoProgress) {
+		return -1.0;
+	}
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//------------------------------------------------------------------------------
+// Name: report
+//------------------------------------------------------------------------------
+void report(const char *name, const char *form, const char *mode, double ms, bool matched, unsigned long limit) {
+	if (ms < 0) {
+		printf("%-12s %-13s %-5s  > %lu ms (gave up)\n", name, form, mode, limit);
+	} else {
+		printf("%-12s %-13s %-5s  %10.3f ms%s\n", name, form, mode, ms, matched ? " (matched)" : "");
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	const size_t length        = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 2000;
+	const unsigned long limit  = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 5000;
+
+	printf("input length:     %zu\n", length);
+	printf("time limit (ms):  %lu\n", limit);
+	printf("\n");
+
+	for (const Case &c : Cases) {
+		const std::string text = c.input(length);
+
+		for (const char *form : { "backtracking", "atomic" }) {
+			const char *source = (form[0] == 'b') ? c.backtracking : c.atomic;
+
+			try {
+				Regex regex(source, REDFLT_STANDARD);
+
+				bool matched;
+				double ms = timeSearch(regex, text, Memoization::Off, limit, &matched);
+				report(c.name, form, "off", ms, matched, limit);
+
+				ms = timeSearch(regex, text, Memoization::Auto, limit, &matched);
+				report(c.name, form, "auto", ms, matched, limit);
+			} catch (const RegexException &e) {
+				fprintf(stderr, "%s: %s\n", source, e.what());
+				return 1;
+			}
+		}
+	}
+}
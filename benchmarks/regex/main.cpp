@@ -0,0 +1,501 @@
+/*
+ * Regex engine benchmark: compiles a fixed corpus of expressions, the start,
+ * end and error patterns of a language definition file plus a set of
+ * typical search patterns, and searches generated C++ source, log, minified
+ * JavaScript and pathological texts for every match of each, front to back
+ * and back to front. Each search of a text gives up after a time limit.
+ *
+ * The results are written as CSV, one row per measurement, so that runs of
+ * different builds can be compared by a script:
+ *
+ *   kind,name,pattern,input,direction,bytes,matches,us,bytes_per_sec,matches_per_sec,status
+ *
+ * 'kind' is "compile", "search" or "set". Compile rows give the pattern's
+ * length in 'bytes' and the average time of one compile in 'us'. 'status' is
+ * "ok", "timeout" (the figures cover the text searched until then) or "error".
+ *
+ * Set rows search a RegexSet token by token over a text of an eighth of the
+ * size and of the full size, as the highlighter does, with the expressions
+ * separated by " | " in 'pattern'. The full size row's 'status' is
+ * "nonlinear" when it took more than four times as long per byte.
+ *
+ * usage: regex-bench [--size bytes] [--limit ms] [--iterations n] [language file]
+ */
+
+#include "regex/Regex.h"
+#include "regex/RegexException.h"
+#include "regex/RegexMatch.h"
+#include "regex/RegexSet.h"
+#include "QJson4/QJsonArray.h"
+#include "QJson4/QJsonDocument.h"
+#include "QJson4/QJsonObject.h"
+#include "QJson4/QJsonParseError.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Pattern {
+	std::string name;
+	std::string source;
+	int         flags;
+};
+
+struct Input {
+	const char *name;
+	std::string text;
+};
+
+struct Result {
+	size_t bytes;   // Text searched.
+	size_t matches;
+	double us;
+	bool   timeout;
+};
+
+/* Searches people commonly type into a find dialog. */
+const Pattern SearchPatterns[] = {
+	{ "literal",        "return",                          REDFLT_STANDARD         },
+	{ "literal-ci",     "error",                           REDFLT_CASE_INSENSITIVE },
+	{ "absent",         "zyzzyva",                         REDFLT_STANDARD         },
+	{ "word",           "<int>",                           REDFLT_STANDARD         },
+	{ "identifier",     "[A-Za-z_][A-Za-z0-9_]*",          REDFLT_STANDARD         },
+	{ "number",         "[0-9]+(\\.[0-9]+)?",              REDFLT_STANDARD         },
+	{ "keywords",       "<(if|else|while|for|switch)>",    REDFLT_STANDARD         },
+	{ "keywords-ci",    "<(if|else|while|for|switch)>",    REDFLT_CASE_INSENSITIVE },
+	{ "line-start",     "^#include",                       REDFLT_STANDARD         },
+	{ "whole-line",     "^.*ms$",                          REDFLT_STANDARD         },
+	{ "trailing-space", "[ \\t]+$",                        REDFLT_STANDARD         },
+	{ "date",           "\\d{4}-\\d{2}-\\d{2}",            REDFLT_STANDARD         },
+	{ "address",        "(\\d{1,3}\\.){3}\\d{1,3}",        REDFLT_STANDARD         },
+	{ "quoted",         "\"([^\"\\\\]|\\\\.)*\"",          REDFLT_STANDARD         },
+	{ "call",           "\\w+\\s*\\(",                     REDFLT_STANDARD         },
+};
+
+struct SetPattern {
+	const char *name;
+	std::vector<const char *> sources;
+	const char *unit; // Repeated to make the text.
+};
+
+/* Sets whose members match rarely and often, each searched again after
+   every match of the other. */
+const SetPattern SetPatterns[] = {
+	{ "rare-first", { "#if 0", "int" },           "int x; "       },
+	{ "rare-last",  { "int", "#if 0" },           "int x; "       },
+	{ "absent",     { "zyzzyva", "\\w+", "\\s" }, "word1 word2\n" },
+};
+
+/* The word delimiters SyntaxHighlighter sets up. */
+const char Delimiters[] = ".,/\\`'!|@#%^&*()-=+{}[]\":;<>?";
+
+//------------------------------------------------------------------------------
+// Name: repeat
+// Desc: 'unit()' over and over until the text is 'size' bytes long
+//------------------------------------------------------------------------------
+template <class F>
+std::string repeat(size_t size, F unit) {
+	std::string text;
+	text.reserve(size + 256);
+
+	for (unsigned int i = 0; text.size() < size; i++) {
+		text += unit(i);
+	}
+
+	text.resize(size);
+	return text;
+}
+
+std::string cppSource(size_t size) {
+	return repeat(size, [](unsigned int i) {
+		char line[512];
+		snprintf(line, sizeof(line),
+			"#include <vector>\n"
+			"\n"
+			"/* Sums the weights of node %u, see\n"
+			" * the notes in \"graph.h\". */\n"
+			"template <class T>\n"
+			"double Graph<T>::weight%u(const std::vector<int> &edges) const {\n"
+			"    double total = 0.0; // running sum\n"
+			"    for (size_t i = 0; i < edges.size(); ++i) {\n"
+			"        if (edges[i] > 0x%x && flags_ & 0%o) {\n"
+			"            total += edges[i] * 1.5e-3;\n"
+			"        } else {\n"
+			"            qDebug(\"skipped edge %%d: \\\"%%s\\\"\", i, name_);\n"
+			"        }\n"
+			"    }\n"
+			"    return total;  \n"
+			"}\n"
+			"\n",
+			i, i, i % 4096, i % 512);
+		return std::string(line);
+	});
+}
+
+std::string logFile(size_t size) {
+	static const char *const levels[] = { "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+
+	return repeat(size, [](unsigned int i) {
+		const unsigned int r = i * 2654435761u;
+		char line[256];
+		snprintf(line, sizeof(line),
+			"2024-%02u-%02u %02u:%02u:%02u.%03u [%s] worker-%u: request %u from 10.%u.%u.%u took %u ms\n",
+			1 + r % 12, 1 + (r >> 4) % 28, (r >> 8) % 24, (r >> 12) % 60, (r >> 16) % 60, (r >> 20) % 1000,
+			levels[(r >> 7) % 5], (r >> 3) % 8, i, (r >> 9) % 256, (r >> 17) % 256, (r >> 25) % 256, (r >> 5) % 500);
+		return std::string(line);
+	});
+}
+
+std::string minifiedJs(size_t size) {
+	// A single line, as minified code is.
+	return repeat(size, [](unsigned int i) {
+		char chunk[512];
+		snprintf(chunk, sizeof(chunk),
+			"function f%u(a,b){var c=a.length,d=[];for(var e=0;e<c;e++){if(a[e]!==b)d.push(\"k%u\"+a[e]);"
+			"else if(/^[a-z]+\\d*$/.test(a[e]))return null}return d.length?d.join(','):void 0}"
+			"var g%u=f%u([%u,\"x\\\"y\",3.14],'z');",
+			i, i, i, i, i);
+		return std::string(chunk);
+	});
+}
+
+std::string pathological(size_t size) {
+	// Unterminated strings and comments on one long line, long runs of
+	// word characters and spaces, the worst case for patterns whose end
+	// never comes.
+	std::string text = repeat(size, [](unsigned int i) {
+		switch (i % 4) {
+		case 0:
+			return std::string("\"abc def \\\" ghi \\\\ jkl ");
+		case 1:
+			return std::string("/* int x = a * b; ** ");
+		case 2:
+			return std::string(200, 'a');
+		default:
+			return std::string(200, ' ');
+		}
+	});
+
+	return text;
+}
+
+QString stringOf(const QJsonObject &obj, const char *key) {
+	if (obj.contains(key) && !obj[key].isNull()) {
+		return obj[key].toString();
+	}
+
+	return QString();
+}
+
+//------------------------------------------------------------------------------
+// Name: loadPatterns
+// Desc: the start, end and error expressions of a language definition file
+//------------------------------------------------------------------------------
+bool loadPatterns(const QString &filename, std::vector<Pattern> *patterns) {
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		fprintf(stderr, "%s: can't open\n", qPrintable(filename));
+		return false;
+	}
+
+	QJsonParseError e;
+	QJsonDocument d = QJsonDocument::fromJson(file.readAll(), &e);
+	if (d.isNull()) {
+		fprintf(stderr, "%s: %s\n", qPrintable(filename), qPrintable(e.errorString()));
+		return false;
+	}
+
+	for (QJsonValue entry : d.array()) {
+		QJsonObject obj = entry.toObject();
+		const QString name = stringOf(obj, "name");
+
+		for (const char *field : { "start", "end", "error" }) {
+			const QString re = stringOf(obj, field);
+			if (!re.isNull()) {
+				patterns->push_back(Pattern{ QString("%1 %2").arg(name, field).toStdString(), re.toStdString(), REDFLT_STANDARD });
+			}
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: csv
+// Desc: quotes a field if it has to be
+//------------------------------------------------------------------------------
+std::string csv(const std::string &field) {
+	if (field.find_first_of(",\"\n") == std::string::npos) {
+		return field;
+	}
+
+	std::string quoted = "\"";
+	for (char ch : field) {
+		if (ch == '"') {
+			quoted += '"';
+		}
+		quoted += ch;
+	}
+
+	return quoted + "\"";
+}
+
+//------------------------------------------------------------------------------
+// Name: elapsedUs
+//------------------------------------------------------------------------------
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+//------------------------------------------------------------------------------
+// Name: searchForward
+// Desc: finds every non-overlapping match from the start of the text, as
+//       "find all" does
+//------------------------------------------------------------------------------
+Result searchForward(const Regex &regex, const std::string &text, unsigned long limit) {
+
+	const char *const begin = text.c_str();
+	const char *const end   = begin + text.size();
+
+	Result result = { 0, 0, 0.0, false };
+	const char *p = begin;
+	char prev     = '\0';
+
+	auto start = std::chrono::steady_clock::now();
+
+	while (p < end) {
+		ExecBudget budget;
+		budget.milliseconds = limit - std::min<unsigned long>(limit - 1, static_cast<unsigned long>(elapsedUs(start) / 1000));
+
+		ExecStatus status;
+		const char *stoppedAt;
+		std::unique_ptr<RegexMatch> match(regex.ExecRE(p, end, Direction::Forward, prev, '\0', nullptr, begin, nullptr, nullptr, budget, &status, &stoppedAt));
+
+		if (status == ExecStatus::BudgetExceeded || status == ExecStatus::NoProgress || elapsedUs(start) / 1000 >= limit) {
+			result.timeout = true;
+			p = stoppedAt ? stoppedAt : p;
+			break;
+		}
+
+		if (!match) {
+			p = end;
+			break;
+		}
+
+		const Capture whole = match->capture(0);
+		if (whole.start >= end) {
+			p = end;
+			break;
+		}
+
+		result.matches++;
+
+		// Don't find the same empty match again.
+		p    = (whole.end != whole.start) ? whole.end : whole.end + 1;
+		prev = p[-1];
+	}
+
+	result.us    = elapsedUs(start);
+	result.bytes = std::min(p, end) - begin;
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// Name: searchBackward
+// Desc: finds every match starting before the previous one's, from the end of
+//       the text, as repeated "find previous" does
+//------------------------------------------------------------------------------
+Result searchBackward(const Regex &regex, const std::string &text, unsigned long limit) {
+
+	const char *const begin = text.c_str();
+	const char *const end   = begin + text.size();
+
+	Result result = { 0, 0, 0.0, false };
+	const char *p = end; // Last position a match may start at, NULL once past the start.
+
+	auto start = std::chrono::steady_clock::now();
+
+	while (p) {
+		ExecBudget budget;
+		budget.milliseconds = limit - std::min<unsigned long>(limit - 1, static_cast<unsigned long>(elapsedUs(start) / 1000));
+
+		ExecStatus status;
+		const char *stoppedAt;
+		std::unique_ptr<RegexMatch> match(regex.ExecRE(begin, p, Direction::Backward, '\0', '\0', nullptr, begin, end, nullptr, budget, &status, &stoppedAt));
+
+		if (status == ExecStatus::BudgetExceeded || status == ExecStatus::NoProgress || elapsedUs(start) / 1000 >= limit) {
+			result.timeout = true;
+			p = stoppedAt ? stoppedAt : p;
+			break;
+		}
+
+		if (!match) {
+			p = nullptr;
+			break;
+		}
+
+		result.matches++;
+
+		const char *const found = match->capture(0).start;
+		p = (found != begin) ? found - 1 : nullptr;
+	}
+
+	result.us    = elapsedUs(start);
+	result.bytes = p ? end - p : text.size();
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// Name: searchSet
+// Desc: finds every match of a set from the start of the text, each search
+//       starting where the last match ended, as SyntaxHighlighter does
+//------------------------------------------------------------------------------
+Result searchSet(const RegexSet &set, const std::string &text) {
+
+	const char *const begin = text.c_str();
+	const char *const end   = begin + text.size();
+
+	Result result = { 0, 0, 0.0, false };
+	const char *p = begin;
+	char prev     = '\n';
+	RegexSet::Scan scan;
+	int id;
+
+	auto start = std::chrono::steady_clock::now();
+
+	while (p < end) {
+		std::unique_ptr<RegexMatch> match(set.ExecRE(p, end, prev, '\0', Delimiters, begin, nullptr, &id, &scan));
+		if (!match) {
+			break;
+		}
+
+		result.matches++;
+
+		const Capture whole = match->capture(0);
+		p    = (whole.end != whole.start) ? whole.end : whole.end + 1;
+		prev = p[-1];
+	}
+
+	result.us    = elapsedUs(start);
+	result.bytes = text.size();
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// Name: rate
+//------------------------------------------------------------------------------
+double rate(size_t count, double us) {
+	return (us > 0) ? count / (us / 1e6) : 0.0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+
+	size_t size              = 1 << 20;
+	unsigned long limit      = 2000;
+	int iterations           = 100;
+	QString filename         = ":/DefaultLanguages.json";
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			size = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+			limit = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else {
+			filename = QString::fromLocal8Bit(argv[i]);
+		}
+	}
+
+	if (limit == 0 || iterations <= 0) {
+		fprintf(stderr, "usage: regex-bench [--size bytes] [--limit ms] [--iterations n] [language file]\n");
+		return 1;
+	}
+
+	std::vector<Pattern> patterns;
+	if (!loadPatterns(filename, &patterns)) {
+		return 1;
+	}
+
+	patterns.insert(patterns.end(), std::begin(SearchPatterns), std::end(SearchPatterns));
+
+	const Input inputs[] = {
+		{ "cpp",          cppSource(size)    },
+		{ "log",          logFile(size)      },
+		{ "minified-js",  minifiedJs(size)   },
+		{ "pathological", pathological(size) },
+	};
+
+	Regex::SetDefaultWordDelimiters(Delimiters);
+
+	printf("kind,name,pattern,input,direction,bytes,matches,us,bytes_per_sec,matches_per_sec,status\n");
+
+	for (const Pattern &pattern : patterns) {
+		const std::string name   = csv(pattern.name);
+		const std::string source = csv(pattern.source);
+
+		std::unique_ptr<Regex> regex;
+
+		try {
+			auto start = std::chrono::steady_clock::now();
+
+			for (int i = 0; i < iterations; i++) {
+				regex.reset(new Regex(pattern.source.c_str(), pattern.flags));
+			}
+
+			printf("compile,%s,%s,,,%zu,,%.3f,,,ok\n", name.c_str(), source.c_str(), pattern.source.size(), elapsedUs(start) / iterations);
+		} catch (const RegexException &e) {
+			printf("compile,%s,%s,,,%zu,,,,,error\n", name.c_str(), source.c_str(), pattern.source.size());
+			fprintf(stderr, "%s: %s\n", pattern.source.c_str(), e.what());
+			continue;
+		}
+
+		for (const Input &input : inputs) {
+			for (Direction direction : { Direction::Forward, Direction::Backward }) {
+				const Result r = (direction == Direction::Forward) ? searchForward(*regex, input.text, limit) : searchBackward(*regex, input.text, limit);
+
+				printf("search,%s,%s,%s,%s,%zu,%zu,%.1f,%.0f,%.0f,%s\n",
+					name.c_str(), source.c_str(), input.name, (direction == Direction::Forward) ? "forward" : "backward",
+					r.bytes, r.matches, r.us, rate(r.bytes, r.us), rate(r.matches, r.us), r.timeout ? "timeout" : "ok");
+				fflush(stdout);
+			}
+		}
+	}
+
+	for (const SetPattern &pattern : SetPatterns) {
+		RegexSet set;
+		std::string source;
+
+		for (const char *member : pattern.sources) {
+			set.Add(std::make_shared<Regex>(member, REDFLT_STANDARD));
+			source += source.empty() ? member : std::string(" | ") + member;
+		}
+
+		double smallUsPerByte = 0.0;
+
+		for (size_t bytes : { size / 8, size }) {
+			const Result r = searchSet(set, repeat(bytes, [&pattern](unsigned int) { return std::string(pattern.unit); }));
+			const double usPerByte = (r.bytes != 0) ? r.us / r.bytes : 0.0;
+			const bool nonlinear   = (bytes == size && smallUsPerByte > 0.0 && usPerByte > 4 * smallUsPerByte);
+
+			printf("set,%s,%s,tokens,forward,%zu,%zu,%.1f,%.0f,%.0f,%s\n",
+				pattern.name, csv(source).c_str(), r.bytes, r.matches, r.us, rate(r.bytes, r.us), rate(r.matches, r.us), nonlinear ? "nonlinear" : "ok");
+			fflush(stdout);
+
+			smallUsPerByte = usPerByte;
+		}
+	}
+}
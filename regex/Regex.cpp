@@ -2,6 +2,7 @@
 #include "Regex.h"
 #include "RegexOpcodes.h"
 #include "RegexCommon.h"
+#include <algorithm>
 #include <cctype>
 #include <climits>
 #include <cstdio>
@@ -45,60 +46,66 @@ const char Default_Meta_Char[] = "{.*+?[(|)^<>$";
 const char ASCII_Digits[]      = "0123456789"; // Same for all locales.
 
 /*--------------------------------------------------------------------*
- * init_ansi_classes
+ * build_ansi_classes
  *
  * Generate character class sets using locale aware ANSI C functions.
  *
  *--------------------------------------------------------------------*/
-bool init_ansi_classes() {
-
-	static bool initialized = false;
+bool build_ansi_classes() {
 
-	if (!initialized) {
-		initialized = true; // Only need to generate character sets once.
-		int word_count   = 0;
-		int letter_count = 0;
-		int space_count  = 0;
+	int word_count   = 0;
+	int letter_count = 0;
+	int space_count  = 0;
 
-		for (int i = 1; i < UCHAR_MAX; i++) {
+	for (int i = 1; i < UCHAR_MAX; i++) {
 
-			const char ch = i;
+		const char ch = i;
 
-			if (isalnum(ch) || ch == '_') {
-				WordChar[word_count++] = ch;
-			}
+		if (isalnum(ch) || ch == '_') {
+			WordChar[word_count++] = ch;
+		}
 
-			if (isalpha(ch)) {
-				LetterChar[letter_count++] = ch;
-			}
+		if (isalpha(ch)) {
+			LetterChar[letter_count++] = ch;
+		}
 
-			/* Note: Whether or not newline is considered to be whitespace is
-			handled by switches within the original regex and is thus omitted
-			here. */
+		/* Note: Whether or not newline is considered to be whitespace is
+		handled by switches within the original regex and is thus omitted
+		here. */
 
-			if (isspace(ch) && (ch != '\n')) {
-				WhiteSpace[space_count++] = ch;
-			}
+		if (isspace(ch) && (ch != '\n')) {
+			WhiteSpace[space_count++] = ch;
+		}
 
-			/* Make sure arrays are big enough.  ("- 2" because of zero array
-			origin and we need to leave room for the NULL terminator.) */
+		/* Make sure arrays are big enough.  ("- 2" because of zero array
+		origin and we need to leave room for the NULL terminator.) */
 
-			if (word_count > (AlnumCharSize - 2) || space_count > (WhiteSpaceSize - 2) ||
-				letter_count > (AlnumCharSize - 2)) {
+		if (word_count > (AlnumCharSize - 2) || space_count > (WhiteSpaceSize - 2) ||
+			letter_count > (AlnumCharSize - 2)) {
 
-				qDebug("internal error #9 'init_ansi_classes'");
-				return false;
-			}
+			qDebug("internal error #9 'init_ansi_classes'");
+			return false;
 		}
-
-		WordChar[word_count]    = '\0';
-		LetterChar[word_count]  = '\0';
-		WhiteSpace[space_count] = '\0';
 	}
 
+	WordChar[word_count]    = '\0';
+	LetterChar[word_count]  = '\0';
+	WhiteSpace[space_count] = '\0';
+
 	return true;
 }
 
+/*--------------------------------------------------------------------*
+ * init_ansi_classes
+ *
+ * Only need to generate character sets once. Expressions may be compiled
+ * from several threads (see RegexCache), hence the function local static.
+ *--------------------------------------------------------------------*/
+bool init_ansi_classes() {
+	static const bool initialized = build_ansi_classes();
+	return initialized;
+}
+
 /*--------------------------------------------------------------------*
  * literal_escape
  *
@@ -133,72 +140,6 @@ char literal_escape(char c) {
 	return '\0';
 }
 
-/*----------------------------------------------------------------------*
- * tail - Set the next-pointer at the end of a node chain.
- *----------------------------------------------------------------------*/
-void tail(prog_type *search_from, prog_type *point_to) {
-
-	prog_type *next;
-
-	if (search_from == &Compute_Size) {
-		return;
-	}
-
-	// Find the last node in the chain (node with a null NEXT pointer)
-
-	prog_type *scan = search_from;
-
-	for (;;) {
-		next = next_ptr(scan);
-
-		if (!next)
-			break;
-
-		scan = next;
-	}
-
-	ptrdiff_t offset;
-	if (getOpcode(scan) == BACK) {
-		offset = scan - point_to;
-	} else {
-		offset = point_to - scan;
-	}
-
-	// Set NEXT pointer
-
-	*(scan + 1) = putOffsetL(offset);
-	*(scan + 2) = putOffsetR(offset);
-}
-
-/*--------------------------------------------------------------------*
- * offset_tail
- *
- * Perform a tail operation on (ptr + offset).
- *--------------------------------------------------------------------*/
-void offset_tail(prog_type *ptr, int offset, prog_type *val) {
-
-	if (ptr == &Compute_Size || ptr == nullptr)
-		return;
-
-	tail(ptr + offset, val);
-}
-
-/*--------------------------------------------------------------------*
- * branch_tail
- *
- * Perform a tail operation on (ptr + offset) but only if 'ptr' is a
- * BRANCH node.
- *--------------------------------------------------------------------*/
-void branch_tail(prog_type *ptr, int offset, prog_type *val) {
-
-	if (ptr == &Compute_Size || ptr == nullptr || getOpcode(ptr) != BRANCH) {
-		return;
-	}
-
-	tail(ptr + offset, val);
-}
-
-
 /*--------------------------------------------------------------------*
  * numeric_escape
  *
@@ -321,6 +262,187 @@ bool *makeDelimiterTable(const char *delimiters, bool *table) {
 	return table;
 }
 
+/* Limit on the number of nodes 'first_chars' visits before giving up. */
+const int FirstCharsBudget = 1000;
+
+/*----------------------------------------------------------------------*
+ * atom_first_chars
+ *
+ * Adds the characters the SIMPLE node 'node' can match to 'members'.
+ * Returns false if 'node' isn't one the analysis understands.
+ *----------------------------------------------------------------------*/
+bool atom_first_chars(prog_type *node, bool *members) {
+
+	prog_type *operand = getOperand(node);
+	const prog_type op = getOpcode(node);
+	const prog_type *class_operand = (op == ANY_OF || op == ANY_BUT) ? operand : shortcutClass(op);
+
+	if (class_operand) {
+		for (int c = 1; c <= UCHAR_MAX; c++) {
+			members[c] = members[c] || classMember(class_operand, static_cast<char>(c));
+		}
+		return true;
+	}
+
+	// Same comparisons the matcher uses for the first character.
+	for (int c = 1; c <= UCHAR_MAX; c++) {
+		const char ch = static_cast<char>(c);
+
+		if ((op == EXACTLY && static_cast<prog_type>(ch) == *operand) || (op == SIMILAR && static_cast<prog_type>(tolower(ch)) == *operand)) {
+			members[c] = true;
+		} else if (op != EXACTLY && op != SIMILAR) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*----------------------------------------------------------------------*
+ * simple_sequence
+ *
+ * Returns true if the body of the look-behind node 'node' is a single
+ * alternative made only of literal strings and nodes matching exactly one
+ * character, which can be compared against the text without backtracking.
+ *----------------------------------------------------------------------*/
+bool simple_sequence(prog_type *node) {
+
+	prog_type *const branch = next_ptr(node);
+
+	if (getOpcode(branch) != BRANCH || getOpcode(next_ptr(branch)) != LOOK_BEHIND_CLOSE) {
+		return false;
+	}
+
+	for (prog_type *scan = getOperand(branch); getOpcode(scan) != LOOK_BEHIND_CLOSE; scan = next_ptr(scan)) {
+		const prog_type op = getOpcode(scan);
+
+		if (op != EXACTLY && op != SIMILAR && op != ANY_OF && op != ANY_BUT && !shortcutClass(op)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*----------------------------------------------------------------------*
+ * first_chars
+ *
+ * Adds the characters that a match of the program starting at node
+ * 'scan' can begin with to 'members'. Returns false if that can't be
+ * worked out or the match may be empty, in which case a match could
+ * start anywhere.
+ *----------------------------------------------------------------------*/
+bool first_chars(prog_type *scan, bool *members, int *budget) {
+
+	while (scan) {
+
+		if (--*budget < 0) {
+			return false;
+		}
+
+		const prog_type op = getOpcode(scan);
+
+		switch (op) {
+		case BOL:
+		case BOWORD:
+		case EOWORD:
+		case NOT_BOUNDARY:
+		case NOTHING:
+			break;
+
+		case EXACTLY:
+		case SIMILAR:
+		case ANY_OF:
+		case ANY_BUT:
+		case ANY:
+		case EVERY:
+		case DIGIT:
+		case NOT_DIGIT:
+		case LETTER:
+		case NOT_LETTER:
+		case SPACE:
+		case SPACE_NL:
+		case NOT_SPACE:
+		case NOT_SPACE_NL:
+		case WORD_CHAR:
+		case NOT_WORD_CHAR:
+			return atom_first_chars(scan, members);
+
+		case PLUS:
+		case LAZY_PLUS:
+		case POSSESSIVE_PLUS:
+			return atom_first_chars(getOperand(scan), members);
+
+		case STAR:
+		case LAZY_STAR:
+		case POSSESSIVE_STAR:
+		case QUESTION:
+		case LAZY_QUESTION:
+		case POSSESSIVE_QUESTION:
+			// The atom may be skipped, so what follows can start the match too.
+			if (!atom_first_chars(getOperand(scan), members)) {
+				return false;
+			}
+			break;
+
+		case BRACE:
+		case LAZY_BRACE:
+		case POSSESSIVE_BRACE:
+			if (!atom_first_chars(getOperand(scan + (2 * Regex::NextPtrSize)), members)) {
+				return false;
+			}
+
+			if (getOffset(scan + Regex::NextPtrSize) != REG_ZERO) {
+				return true;
+			}
+			break;
+
+		case BRANCH: {
+			prog_type *next = next_ptr(scan);
+			if (!next || getOpcode(next) != BRANCH) {
+				// A lone branch, i.e. the operand is all there is.
+				scan = getOperand(scan);
+				continue;
+			}
+
+			for (prog_type *branch = scan; branch && getOpcode(branch) == BRANCH; branch = next_ptr(branch)) {
+				if (!first_chars(getOperand(branch), members, budget)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		case ATOMIC_OPEN:
+			// A match starts like one of the group's branches.
+			return first_chars(getOperand(scan), members, budget);
+
+		case POS_BEHIND_OPEN:
+		case NEG_BEHIND_OPEN:
+		case POS_BEHIND_SIMPLE:
+		case NEG_BEHIND_SIMPLE:
+			// Looks at text before the match only, skip it and its close.
+			scan = next_ptr(getOperand(scan) + Regex::LengthSize);
+			while (getOpcode(scan) == BRANCH) {
+				scan = next_ptr(scan);
+			}
+			break;
+
+		default:
+			if (op >= OPEN && op < LAST_PAREN) {
+				break;
+			}
+
+			// END, EOL, look-around, back-references, counters...
+			return false;
+		}
+
+		scan = next_ptr(scan);
+	}
+
+	return false;
+}
+
 }
 
 /* Default table for determining whether a character is a word delimiter. */
@@ -342,12 +464,22 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
 /* OPCODE NOTES:
    ------------
 
-   All nodes consist of an 8 bit op code followed by 2 bytes that make up a 16
-   bit NEXT pointer.  Some nodes have a null terminated character string operand
-   following the NEXT pointer.  Other nodes may have an 8 bit index operand.
-   The TEST_COUNT node has an index operand followed by a 16 bit test value.
-   The BRACE and LAZY_BRACE nodes have two 16 bit values for min and max but no
-   index value.
+   All nodes consist of a 32 bit op code unit followed by a 32 bit signed NEXT
+   offset.  Some nodes have a null terminated character string operand
+   following the NEXT offset.  Other nodes may have an index operand.  The
+   TEST_COUNT node has an index operand followed by a test value.  The BRACE,
+   LAZY_BRACE and POSSESSIVE_BRACE nodes have min and max values but no index
+   value.
+
+   ANY_OF, ANY_BUT
+      Operand(s): 8 x 32 bit membership bitmap, stop character count,
+                  ClassStopSize stop characters
+
+      Implements character classes. Membership is a single bit test, the
+      bitmap of an ANY_BUT node holds the complement of the class as written
+      (and never '\0').  If no more than ClassStopSize characters are NOT
+      members, they are listed after the bitmap so that greedy runs can scan
+      for them directly.
 
    SIMILAR
       Operand(s): null terminated string
@@ -394,10 +526,18 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
       implemented separately for speed and to minimize recursion.
 
    BRACE, LAZY_BRACE
-      Operand(s): minimum value (2 bytes), maximum value (2 bytes)
+      Operand(s): minimum value, maximum value
 
       Implements the {m,n} construct for atoms that are SIMPLE.
 
+   POSSESSIVE_STAR, POSSESSIVE_PLUS, POSSESSIVE_QUESTION, POSSESSIVE_BRACE
+      Operand(s): as STAR, PLUS, QUESTION and BRACE
+
+      Implement '*+', '++', '?+' and '{m,n}+' for atoms that are SIMPLE.  The
+      longest run is taken and never given back, so what follows is tried
+      once instead of once per shorter run.  Possessive quantifiers of other
+      atoms are compiled as the greedy construct inside an atomic group.
+
    BRANCH
       Operand(s): None
 
@@ -415,19 +555,19 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
       points backward.  BACK exists to make loop structures possible.
 
    INIT_COUNT
-      Operand(s): index (1 byte)
+      Operand(s): index
 
       Initializes the count array element referenced by the index operand.
       This node is used to build general (i.e. parenthesized) {m,n} constructs.
 
    INC_COUNT
-      Operand(s): index (1 byte)
+      Operand(s): index
 
       Increments the count array element referenced by the index operand.
       This node is used to build general (i.e. parenthesized) {m,n} constructs.
 
    TEST_COUNT
-      Operand(s): index (1 byte), test value (2 bytes)
+      Operand(s): index, test value
 
       Tests the current value of the count array element specified by the
       index operand against the test value.  If the current value is less than
@@ -465,7 +605,7 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
 
    POS_BEHIND_OPEN, NEG_BEHIND_OPEN, LOOK_BEHIND_CLOSE
 
-      Operand(s): 2x2 bytes for OPEN (match boundaries), None for CLOSE
+      Operand(s): lower and upper match length for OPEN, None for CLOSE
 
       Implements positive and negative look behind.  Look behind is an assertion
       that something is either there or not there in front of the current
@@ -474,6 +614,26 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
       efficiency reasons; note that most other implementation even impose
       fixed length).
 
+   POS_BEHIND_SIMPLE, NEG_BEHIND_SIMPLE
+
+      Operand(s): as POS_BEHIND_OPEN and NEG_BEHIND_OPEN
+
+      Look behind whose body is a single alternative of literal strings and
+      single character classes, so it always has the same length.  The
+      compiler turns POS_BEHIND_OPEN and NEG_BEHIND_OPEN nodes of that form
+      into these.  The matcher compares the text that length back directly,
+      without trying the body as a regex.  The nodes are otherwise laid out
+      like the general ones.
+
+   ATOMIC_OPEN, ATOMIC_CLOSE
+
+      Operand(s): None
+
+      Implements atomic groups, (?>...).  The group is matched on its own and
+      what follows carries on from where its first match ended; on failure
+      there is no backtracking into the group for a shorter or different
+      match.
+
    OPEN, CLOSE
 
       Operand(s): None
@@ -498,7 +658,7 @@ bool Regex::DefaultDelimiters[UCHAR_MAX + 1] = { 0 };
  * Beware that the optimization and preparation code in here knows about
  * some of the structure of the compiled regexp.
  *----------------------------------------------------------------------*/
-Regex::Regex(const char *exp, int defaultFlags) : match_start_(0), anchor_(0), program_(nullptr), Total_Paren(0), Num_Braces(0) {
+Regex::Regex(const char *exp, int defaultFlags) : match_start_(0), anchor_(0), has_first_chars_(false), program_(nullptr), Total_Paren(0), Num_Braces(0), Has_Back_Refs(false), memoMode_(Memoization::Auto), memoTriggered_(false) {
 
 	prog_type *scan;
 	int flags_local;
@@ -523,62 +683,50 @@ Regex::Regex(const char *exp, int defaultFlags) : match_start_(0), anchor_(0), p
 
 	regex_ = QString::fromLatin1(exp);
 
-	Code_Emit_Ptr = &Compute_Size;
-	Reg_Size = 0UL;
-
-	/* We can't allocate space until we know how big the compiled form will be,
-	  but we can't compile it (and thus know how big it is) until we've got a
-	  place to put the code.  So we cheat: we compile it twice, once with code
-	  generation turned off and size counting turned on, and once "for real".
-	  This also means that we don't allocate space until we are sure that the
-	  thing really will compile successfully, and we never have to move the
-	  code and thus invalidate pointers into it.  (Note that it has to be in
-	  one piece because free() must be able to free it all.) */
-
-	for (int pass = 1; pass <= 2; pass++) {
-		/*-------------------------------------------*
-		 * FIRST  PASS: Determine size and legality. *
-		 * SECOND PASS: Emit code.                   *
-		 *-------------------------------------------*/
-
-		/*  Schwarzenberg:
-		 * If defaultFlags = 0 use standard defaults:
-		 *   Is_Case_Insensitive: Case sensitive is the default
-		 *   Match_Newline:       Newlines are NOT matched by default
-		 *                        in character classes
-		 */
-		Is_Case_Insensitive = ((defaultFlags & REDFLT_CASE_INSENSITIVE) ? true : false);
-		Match_Newline       = false; // ((defaultFlags & REDFLT_MATCH_NEWLINE)   ? true : false); Currently not used. Uncomment if needed.
-        Reg_Parse           = exp;
-		Total_Paren         = 1;
-		Num_Braces          = 0;
-		Closed_Parens       = 0;
-		Paren_Has_Width     = 0;
-
-		emit_byte(MAGIC);
-		emit_byte('%'); // Placeholder for num of capturing parentheses.
-		emit_byte('%'); // Placeholder for num of general {m,n} constructs.
-
-		if (chunk(NO_PAREN, &flags_local, &range_local) == nullptr) {
-			throw RegexException("Internal Error"); // Something went wrong
-		}
-
-		if (pass == 1) {
-			if (Reg_Size >= MaxCompiledSize) {
-				/* Too big for NEXT pointers NEXT_PTR_SIZE bytes long to span.
-		         * This is a real issue since the first BRANCH node usually points
-		         * to the end of the compiled regex code.
-				 */
-				throw RegexException("regexp > %lu bytes", MaxCompiledSize);
-			}
+	/* The code is emitted in a single pass into a growable buffer. While
+	  compiling, nodes are referred to by their offset into the buffer rather
+	  than by address, so growing it never invalidates anything, and NEXT
+	  offsets are patched in place by 'tail' as soon as both ends are known.
+	  Most expressions compile to a couple of code units per character of
+	  source, reserve accordingly to avoid most reallocations. */
+
+	Code.clear();
+	Code.reserve(2 * strlen(exp) + 16);
+
+	/*  Schwarzenberg:
+	 * If defaultFlags = 0 use standard defaults:
+	 *   Is_Case_Insensitive: Case sensitive is the default
+	 *   Match_Newline:       Newlines are NOT matched by default
+	 *                        in character classes
+	 */
+	Is_Case_Insensitive = ((defaultFlags & REDFLT_CASE_INSENSITIVE) ? true : false);
+	Match_Newline       = false; // ((defaultFlags & REDFLT_MATCH_NEWLINE)   ? true : false); Currently not used. Uncomment if needed.
+	Reg_Parse           = exp;
+	Total_Paren         = 1;
+	Num_Braces          = 0;
+	Closed_Parens       = 0;
+	Paren_Has_Width     = 0;
+
+	emit_byte(MAGIC);
+	emit_byte('%'); // Placeholder for num of capturing parentheses.
+	emit_byte('%'); // Placeholder for num of general {m,n} constructs.
+
+	if (chunk(NO_PAREN, &flags_local, &range_local) == NoNode) {
+		throw RegexException("Internal Error"); // Something went wrong
+	}
 
-			// Allocate memory.
-			program_ = new prog_type[Reg_Size + 1];
+	Reg_Size = Code.size();
 
-			Code_Emit_Ptr = program_;
-		}
+	if (Reg_Size >= MaxCompiledSize) {
+		/* Too big for NEXT offsets to span. The first BRANCH node usually
+		 * points to the end of the compiled regex code.
+		 */
+		throw RegexException("regexp > %lu units", static_cast<unsigned long>(MaxCompiledSize));
 	}
 
+	Code.shrink_to_fit();
+	program_ = Code.data();
+
 	// fill in the placeholder values
 	program_[1] = static_cast<prog_type>(Total_Paren - 1);
 	program_[2] = static_cast<prog_type>(Num_Braces);
@@ -613,6 +761,31 @@ Regex::Regex(const char *exp, int defaultFlags) : match_start_(0), anchor_(0), p
 			anchor_++;
 		}
 	}
+
+	/* The characters a match can start with, so that searches only attempt a
+	   match where one can begin. */
+
+	bool members[UCHAR_MAX + 1] = {};
+	int budget = FirstCharsBudget;
+	has_first_chars_ = !anchor_ && match_start_ == '\0' && first_chars(program_ + RegexStartOffset, members, &budget);
+
+	first_char_list_[0] = 0;
+
+	if (has_first_chars_) {
+		makeClassOperand(first_chars_, members);
+
+		/* A case insensitive literal can start with one of just two characters,
+		   searches look for those the way they look for 'match_start_'. */
+		const auto count = static_cast<size_t>(std::count(members + 1, members + UCHAR_MAX + 1, true));
+
+		if (count <= ClassStopSize) {
+			for (int c = 1; c <= UCHAR_MAX; c++) {
+				if (members[c]) {
+					first_char_list_[++first_char_list_[0]] = static_cast<prog_type>(static_cast<char>(c));
+				}
+			}
+		}
+	}
 }
 
 /*----------------------------------------------------------------------*
@@ -627,11 +800,11 @@ Regex::Regex(const char *exp, int defaultFlags) : match_start_(0), anchor_(0), p
  * branches to what follows makes it hard to avoid.                     *
  *----------------------------------------------------------------------*/
 
-prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
+Regex::node_index Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 
-	prog_type *ret_val = nullptr;
-	prog_type *this_branch;
-	prog_type *ender = nullptr;
+	node_index ret_val = NoNode;
+	node_index this_branch;
+	node_index ender = NoNode;
 	
 	size_t this_paren = 0;
 	int flags_local;
@@ -641,7 +814,7 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 	bool old_newline = Match_Newline;
 	len_range range_local;
 	int look_only = 0;
-	prog_type *emit_look_behind_bounds = nullptr;
+	node_index emit_look_behind_bounds = NoNode;
 
 	*flag_param = HAS_WIDTH; // Tentatively.
 	range_param->lower = 0;  // Idem
@@ -667,6 +840,8 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 		// We'll overwrite the zero length later on, so we save the ptr
 		ret_val = emit_special(paren, 0, 0);
 		emit_look_behind_bounds = ret_val + NodeSize;
+	} else if (paren == ATOMIC_OPEN) {
+		ret_val = emit_node(ATOMIC_OPEN);
 	} else if (paren == INSENSITIVE) {
 		Is_Case_Insensitive = true;
 	} else if (paren == SENSITIVE) {
@@ -682,13 +857,13 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 	do {
 		this_branch = alternative(&flags_local, &range_local);
 
-		if (this_branch == nullptr)
-			return nullptr;
+		if (this_branch == NoNode)
+			return NoNode;
 
 		if (first) {
 			first = 0;
 			*range_param = range_local;
-			if (ret_val == nullptr)
+			if (ret_val == NoNode)
 				ret_val = this_branch;
 		} else if (range_param->lower >= 0) {
 			if (range_local.lower >= 0) {
@@ -732,6 +907,9 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 	} else if (paren == POS_BEHIND_OPEN || paren == NEG_BEHIND_OPEN) {
 		ender = emit_node(LOOK_BEHIND_CLOSE);
 
+	} else if (paren == ATOMIC_OPEN) {
+		ender = emit_node(ATOMIC_CLOSE);
+
 	} else {
 		ender = emit_node(NOTHING);
 	}
@@ -740,9 +918,9 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 
 	// Hook the tails of the branch alternatives to the closing node.
 
-	for (this_branch = ret_val; this_branch != nullptr;) {
+	for (this_branch = ret_val; this_branch != NoNode;) {
 		branch_tail(this_branch, NodeSize, ender);
-		this_branch = next_ptr(this_branch);
+		this_branch = next_node(this_branch);
 	}
 
 	// Check for proper termination.
@@ -766,11 +944,11 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
 		if (range_param->upper > 65535L) {
 			throw RegexException("max. look-behind size is too large (>65535)");
 		}
-		if (Code_Emit_Ptr != &Compute_Size) {
-			*emit_look_behind_bounds++ = putOffsetL(range_param->lower);
-			*emit_look_behind_bounds++ = putOffsetR(range_param->lower);
-			*emit_look_behind_bounds++ = putOffsetL(range_param->upper);
-			*emit_look_behind_bounds = putOffsetR(range_param->upper);
+		Code[emit_look_behind_bounds++] = putOffset(range_param->lower);
+		Code[emit_look_behind_bounds]   = putOffset(range_param->upper);
+
+		if (range_param->lower == range_param->upper && simple_sequence(&Code[ret_val])) {
+			Code[ret_val] = (paren == POS_BEHIND_OPEN) ? POS_BEHIND_SIMPLE : NEG_BEHIND_SIMPLE;
 		}
 	}
 
@@ -833,11 +1011,11 @@ prog_type *Regex::chunk(int paren, int *flag_param, len_range *range_param) {
  * Processes one alternative of an '|' operator.  Connects the NEXT
  * pointers of each regex atom together sequentialy.
  *----------------------------------------------------------------------*/
-prog_type *Regex::alternative(int *flag_param, len_range *range_param) {
+Regex::node_index Regex::alternative(int *flag_param, len_range *range_param) {
 
-	prog_type *ret_val;
-	prog_type *chain;
-	prog_type *latest;
+	node_index ret_val;
+	node_index chain;
+	node_index latest;
 	int flags_local;
 	len_range range_local;
 
@@ -846,7 +1024,7 @@ prog_type *Regex::alternative(int *flag_param, len_range *range_param) {
 	range_param->upper = 0;
 
 	ret_val = emit_node(BRANCH);
-	chain = nullptr;
+	chain = NoNode;
 
 	/* Loop until we hit the start of the next alternative, the end of this set
 	  of alternatives (end of parentheses), or the end of the regex. */
@@ -854,8 +1032,8 @@ prog_type *Regex::alternative(int *flag_param, len_range *range_param) {
     while (*Reg_Parse != '|' && *Reg_Parse != ')' && *Reg_Parse != '\0') {
 		latest = piece(&flags_local, &range_local);
 
-		if (latest == nullptr)
-			return nullptr; // Something went wrong.
+		if (latest == NoNode)
+			return NoNode; // Something went wrong.
 
 		*flag_param |= flags_local & HAS_WIDTH;
 		if (range_local.lower < 0) {
@@ -874,7 +1052,7 @@ prog_type *Regex::alternative(int *flag_param, len_range *range_param) {
 		chain = latest;
 	}
 
-	if (chain == nullptr) { // Loop ran zero times.
+	if (chain == NoNode) { // Loop ran zero times.
 		emit_node(NOTHING);
 	}
 
@@ -890,24 +1068,25 @@ prog_type *Regex::alternative(int *flag_param, len_range *range_param) {
  * body of the last branch. It might seem that this node could be
  * dispensed with entirely, but the endmarker role is not redundant.
  *----------------------------------------------------------------------*/
-prog_type *Regex::piece(int *flag_param, len_range *range_param) {
+Regex::node_index Regex::piece(int *flag_param, len_range *range_param) {
 
-	prog_type *ret_val;
-	prog_type *next;
+	node_index ret_val;
+	node_index next;
 	prog_type op_code;
 	unsigned long min_max[2] = {REG_ZERO, REG_INFINITY};
 	int flags_local;
 	int i;
 	int brace_present = 0;
 	int lazy = 0;
+	int possessive = 0;
 	int comma_present = 0;
 	int digit_present[2] = {0, 0};
 	len_range range_local;
 
 	ret_val = atom(&flags_local, &range_local);
 
-	if (ret_val == nullptr)
-		return nullptr; // Something went wrong.
+	if (ret_val == NoNode)
+		return NoNode; // Something went wrong.
 
     op_code = *Reg_Parse;
 
@@ -1000,6 +1179,10 @@ prog_type *Regex::piece(int *flag_param, len_range *range_param) {
     if (*Reg_Parse == '?') {
 		lazy = 1;
 		Reg_Parse++;
+	} else if (*Reg_Parse == '+') {
+		// Possessive, i.e. what is matched is never given back.
+		possessive = 1;
+		Reg_Parse++;
 	}
 
 	// Avoid overhead of counting if possible
@@ -1065,16 +1248,16 @@ prog_type *Regex::piece(int *flag_param, len_range *range_param) {
 	*---------------------------------------------------------------------*/
 
 	if (op_code == '*' && (flags_local & SIMPLE)) {
-		insert((lazy ? LAZY_STAR : STAR), ret_val, 0UL, 0UL, 0);
+		insert((lazy ? LAZY_STAR : possessive ? POSSESSIVE_STAR : STAR), ret_val, 0UL, 0UL, 0);
 
 	} else if (op_code == '+' && (flags_local & SIMPLE)) {
-		insert(lazy ? LAZY_PLUS : PLUS, ret_val, 0UL, 0UL, 0);
+		insert(lazy ? LAZY_PLUS : possessive ? POSSESSIVE_PLUS : PLUS, ret_val, 0UL, 0UL, 0);
 
 	} else if (op_code == '?' && (flags_local & SIMPLE)) {
-		insert(lazy ? LAZY_QUESTION : QUESTION, ret_val, 0UL, 0UL, 0);
+		insert(lazy ? LAZY_QUESTION : possessive ? POSSESSIVE_QUESTION : QUESTION, ret_val, 0UL, 0UL, 0);
 
 	} else if (op_code == '{' && (flags_local & SIMPLE)) {
-		insert(lazy ? LAZY_BRACE : BRACE, ret_val, min_max[0], min_max[1], 0);
+		insert(lazy ? LAZY_BRACE : possessive ? POSSESSIVE_BRACE : BRACE, ret_val, min_max[0], min_max[1], 0);
 
 	} else if ((op_code == '*' || op_code == '+') && lazy) {
 	/*  Node structure for (x)*?    Node structure for (x)+? construct.
@@ -1208,7 +1391,7 @@ prog_type *Regex::piece(int *flag_param, len_range *range_param) {
 
 			tail(ret_val, emit_special(INC_COUNT, 0UL, Num_Braces)); // 1
 
-			next = emit_special(TEST_COUNT, min_max[0], Num_Braces); // 2,7
+			next = emit_special(TEST_COUNT, min_max[1], Num_Braces); // 2,7
 
 			tail(ret_val, next);                                          // 2
 			insert(BRANCH, ret_val, 0UL, 0UL, Num_Braces);  // 4,6
@@ -1404,6 +1587,25 @@ prog_type *Regex::piece(int *flag_param, len_range *range_param) {
 		throw RegexException("internal error #2, 'piece\'");
 	}
 
+	if (possessive && !(flags_local & SIMPLE)) {
+		/* Node structure for (x)*+, (x)++, (x)?+ and (x){m,n}+ constructs,
+		 * i.e. the greedy construct as an atomic group, (?>(x)*) etc.
+		 *        __1_    ____2_______
+		 *       /    |  /            |
+		 *    AO~ B~ (...construct...)~ AC~
+		 *         \__________3_______|
+		 */
+
+		insert(BRANCH, ret_val, 0UL, 0UL, 0);      // 1,2,3
+		insert(ATOMIC_OPEN, ret_val, 0UL, 0UL, 0); // 1
+
+		next = emit_node(ATOMIC_CLOSE); // 2,3
+
+		tail(ret_val, ret_val + NodeSize);     // 1
+		tail(ret_val + (2 * NodeSize), next);  // 2
+		tail(ret_val + NodeSize, next);        // 3
+	}
+
 	if (isQuantifier(*Reg_Parse)) {
 		if (op_code == '{') {
 			throw RegexException("nested quantifiers, {m,n}%c", *Reg_Parse);
@@ -1425,9 +1627,9 @@ prog_type *Regex::piece(int *flag_param, len_range *range_param) {
  * is smaller to store and faster to run.
  *----------------------------------------------------------------------*/
 
-prog_type *Regex::atom(int *flag_param, len_range *range_param) {
+Regex::node_index Regex::atom(int *flag_param, len_range *range_param) {
 
-	prog_type *ret_val;
+	node_index ret_val;
 	prog_type test;
 	int flags_local;
 	len_range range_local;
@@ -1509,6 +1711,9 @@ prog_type *Regex::atom(int *flag_param, len_range *range_param) {
             } else if (*Reg_Parse == '!') {
 				Reg_Parse++;
 				ret_val = chunk(NEG_AHEAD_OPEN, &flags_local, &range_local);
+            } else if (*Reg_Parse == '>') {
+				Reg_Parse++;
+				ret_val = chunk(ATOMIC_OPEN, &flags_local, &range_local);
             } else if (*Reg_Parse == 'i') {
 				Reg_Parse++;
 				ret_val = chunk(INSENSITIVE, &flags_local, &range_local);
@@ -1539,8 +1744,8 @@ prog_type *Regex::atom(int *flag_param, len_range *range_param) {
 			ret_val = chunk(PAREN, &flags_local, &range_local);
 		}
 
-		if (ret_val == nullptr)
-			return nullptr; // Something went wrong.
+		if (ret_val == NoNode)
+			return NoNode; // Something went wrong.
 
 		// Add HAS_WIDTH flag if it was set by call to chunk.
 
@@ -1717,7 +1922,7 @@ prog_type *Regex::atom(int *flag_param, len_range *range_param) {
         if (*Reg_Parse != ']')
 			throw RegexException("missing right ']'");
 
-		emit_byte('\0');
+		emit_class_bitmap(ret_val + NodeSize);
 
 		/* NOTE: it is impossible to specify an empty class.  This is
 		       because [] would be interpreted as "begin character class"
@@ -1831,11 +2036,7 @@ prog_type *Regex::atom(int *flag_param, len_range *range_param) {
 				if (isQuantifier(*Reg_Parse) && len > 0) {
 					Reg_Parse = parse_save; // Point to previous regex token.
 
-					if (Code_Emit_Ptr == &Compute_Size) {
-						Reg_Size--;
-					} else {
-						Code_Emit_Ptr--; // Write over previously emitted byte.
-					}
+					Code.pop_back(); // Write over previously emitted byte.
 
 					break;
 				}
@@ -1862,27 +2063,19 @@ prog_type *Regex::atom(int *flag_param, len_range *range_param) {
 /*----------------------------------------------------------------------*
  * emit_node
  *
- * Emit (if appropriate) the op code for a regex node atom.
+ * Emit the op code for a regex node atom.
  *
- * The NEXT pointer is initialized to nullptr.
+ * The NEXT pointer is initialized to zero.
  *
- * Returns a pointer to the START of the emitted node.
+ * Returns the offset of the START of the emitted node.
  *----------------------------------------------------------------------*/
 
-prog_type *Regex::emit_node(prog_type op_code) {
-
-	prog_type *const ret_val = Code_Emit_Ptr; // Return address of start of node
+Regex::node_index Regex::emit_node(prog_type op_code) {
 
-	if (ret_val == &Compute_Size) {
-		Reg_Size += NodeSize;
-	} else {
-		prog_type *ptr = ret_val;
-		*ptr++ = op_code;
-		*ptr++ = '\0'; // Null "NEXT" pointer.
-		*ptr++ = '\0';
+	const node_index ret_val = Code.size(); // Return offset of start of node
 
-		Code_Emit_Ptr = ptr;
-	}
+	Code.push_back(op_code);
+	Code.push_back('\0'); // Null "NEXT" pointer.
 
 	return ret_val;
 }
@@ -1895,47 +2088,19 @@ prog_type *Regex::emit_node(prog_type op_code) {
  * Emit nodes that need special processing.
  *----------------------------------------------------------------------*/
 
-prog_type *Regex::emit_special(prog_type op_code, unsigned long test_val, int index) {
-
-	prog_type *ret_val = &Compute_Size;
-	prog_type *ptr;
-
-	if (Code_Emit_Ptr == &Compute_Size) {
-		switch (op_code) {
-		case POS_BEHIND_OPEN:
-		case NEG_BEHIND_OPEN:
-			Reg_Size += LengthSize; // Length of the look-behind match
-			Reg_Size += NodeSize;   // Make room for the node
-			break;
-
-		case TEST_COUNT:
-			Reg_Size += NextPtrSize; // Make room for a test value.
+Regex::node_index Regex::emit_special(prog_type op_code, unsigned long test_val, int index) {
 
-		case INC_COUNT:
-			Reg_Size += IndexSize; // Make room for an index value.
-
-		default:
-			Reg_Size += NodeSize; // Make room for the node.
-		}
-	} else {
-		ret_val = emit_node(op_code); // Return the address for start of node.
-		ptr = Code_Emit_Ptr;
+	const node_index ret_val = emit_node(op_code); // Return the offset for start of node.
 
-		if (op_code == INC_COUNT || op_code == TEST_COUNT) {
-			*ptr++ = static_cast<prog_type>(index);
+	if (op_code == INC_COUNT || op_code == TEST_COUNT) {
+		emit_byte(static_cast<prog_type>(index));
 
-			if (op_code == TEST_COUNT) {
-				*ptr++ = putOffsetL(test_val);
-				*ptr++ = putOffsetR(test_val);
-			}
-		} else if (op_code == POS_BEHIND_OPEN || op_code == NEG_BEHIND_OPEN) {
-			*ptr++ = putOffsetL(test_val);
-			*ptr++ = putOffsetR(test_val);
-			*ptr++ = putOffsetL(test_val);
-			*ptr++ = putOffsetR(test_val);
+		if (op_code == TEST_COUNT) {
+			emit_byte(putOffset(test_val));
 		}
-
-		Code_Emit_Ptr = ptr;
+	} else if (op_code == POS_BEHIND_OPEN || op_code == NEG_BEHIND_OPEN) {
+		emit_byte(putOffset(test_val));
+		emit_byte(putOffset(test_val));
 	}
 
 	return (ret_val);
@@ -1945,19 +2110,16 @@ prog_type *Regex::emit_special(prog_type op_code, unsigned long test_val, int in
  * insert
  *
  * Insert a node in front of already emitted node(s).  Means relocating
- * the operand.  cStateCode_Emit_Ptr points one byte past the just emitted
- * node and operand.  The parameter 'insert_pos' points to the location
- * where the new node is to be inserted.
+ * the operand.  The parameter 'insert_pos' is the offset where the new
+ * node is to be inserted, everything from there up to the end of the
+ * emitted code is moved up.
  *----------------------------------------------------------------------*/
 
-prog_type *Regex::insert(prog_type op, prog_type *insert_pos, long min, long max, int index) {
+Regex::node_index Regex::insert(prog_type op, node_index insert_pos, long min, long max, int index) {
 
-	prog_type *src;
-	prog_type *dst;
-	prog_type *place;
 	int insert_size = NodeSize;
 
-	if (op == BRACE || op == LAZY_BRACE) {
+	if (op == BRACE || op == LAZY_BRACE || op == POSSESSIVE_BRACE) {
 		// Make room for the min and max values.
 
 		insert_size += (2 * NextPtrSize);
@@ -1967,36 +2129,97 @@ prog_type *Regex::insert(prog_type op, prog_type *insert_pos, long min, long max
 		insert_size += IndexSize;
 	}
 
-	if (Code_Emit_Ptr == &Compute_Size) {
-		Reg_Size += insert_size;
-		return &Compute_Size;
+	// Relocate the existing emitted code to make room for the new node.
+
+	Code.insert(Code.begin() + insert_pos, insert_size, 0);
+
+	node_index place = insert_pos; // Where operand used to be.
+	Code[place++] = op;            // Inserted operand.
+	Code[place++] = '\0';          // NEXT pointer for inserted operand.
+
+	if (op == BRACE || op == LAZY_BRACE || op == POSSESSIVE_BRACE) {
+		Code[place++] = putOffset(min);
+		Code[place++] = putOffset(max);
+	} else if (op == INIT_COUNT) {
+		Code[place++] = static_cast<prog_type>(index);
+	}
+
+	return place; // Return the offset of the start of the code moved.
+}
+
+/*----------------------------------------------------------------------*
+ * next_node
+ *
+ * Compile time equivalent of 'next_ptr', works on offsets into the code
+ * being emitted. Returns NoNode at the end of a chain.
+ *----------------------------------------------------------------------*/
+Regex::node_index Regex::next_node(node_index node) const {
+
+	const int32_t offset = static_cast<int32_t>(Code[node + 1]);
+
+	if (offset == 0) {
+		return NoNode;
 	}
 
-	src = Code_Emit_Ptr;
-	Code_Emit_Ptr += insert_size;
-	dst = Code_Emit_Ptr;
+	return node + offset;
+}
 
-	// Relocate the existing emitted code to make room for the new node.
+/*----------------------------------------------------------------------*
+ * tail - Set the next-pointer at the end of a node chain.
+ *----------------------------------------------------------------------*/
+void Regex::tail(node_index search_from, node_index point_to) {
+
+	/* Offsets are stored as signed 32-bit units, refuse to go on before one
+	  gets truncated (and might link the chain into a loop). */
+
+	if (Code.size() >= MaxCompiledSize) {
+		throw RegexException("regexp > %lu units", static_cast<unsigned long>(MaxCompiledSize));
+	}
 
-	while (src > insert_pos)
-		*--dst = *--src;
+	// Find the last node in the chain (node with a null NEXT pointer)
 
-	place = insert_pos; // Where operand used to be.
-	*place++ = op;      // Inserted operand.
-	*place++ = '\0';    // NEXT pointer for inserted operand.
-	*place++ = '\0';
+	node_index scan = search_from;
 
-	if (op == BRACE || op == LAZY_BRACE) {
-		*place++ = putOffsetL(min);
-		*place++ = putOffsetR(min);
+	for (;;) {
+		const node_index next = next_node(scan);
 
-		*place++ = putOffsetL(max);
-		*place++ = putOffsetR(max);
-	} else if (op == INIT_COUNT) {
-		*place++ = static_cast<prog_type>(index);
+		if (next == NoNode)
+			break;
+
+		scan = next;
+	}
+
+	// Set NEXT pointer, BACK nodes get a negative offset
+
+	Code[scan + 1] = putOffset(static_cast<ptrdiff_t>(point_to) - static_cast<ptrdiff_t>(scan));
+}
+
+/*--------------------------------------------------------------------*
+ * offset_tail
+ *
+ * Perform a tail operation on (ptr + offset).
+ *--------------------------------------------------------------------*/
+void Regex::offset_tail(node_index ptr, int offset, node_index val) {
+
+	if (ptr == NoNode)
+		return;
+
+	tail(ptr + offset, val);
+}
+
+/*--------------------------------------------------------------------*
+ * branch_tail
+ *
+ * Perform a tail operation on (ptr + offset) but only if 'ptr' is a
+ * BRANCH node.
+ *--------------------------------------------------------------------*/
+void Regex::branch_tail(node_index ptr, int offset, node_index val) {
+
+	if (ptr == NoNode || Code[ptr] != BRANCH) {
+		return;
 	}
 
-	return place; // Return a pointer to the start of the code moved.
+	tail(ptr + offset, val);
 }
 
 /*--------------------------------------------------------------------*
@@ -2037,11 +2260,11 @@ prog_type *Regex::insert(prog_type op, prog_type *insert_pos, long min, long max
  *       a class.
  *
  *--------------------------------------------------------------------*/
-prog_type *Regex::shortcut_escape(char c, int *flag_param, EscapeFlags emitType) {
+Regex::node_index Regex::shortcut_escape(char c, int *flag_param, EscapeFlags emitType) {
 
 	const char *characterClass = nullptr;
 	static const char codes[] = "ByYdDlLsSwW";
-	prog_type *ret_val = reinterpret_cast<prog_type *>(1); // Assume success.
+	node_index ret_val = 1; // Assume success (any value but NoNode).
 	const char *valid_codes;
 
 	if (emitType == EscapeFlags::EMIT_CLASS_BYTES || emitType == EscapeFlags::CHECK_CLASS_ESCAPE) {
@@ -2051,7 +2274,7 @@ prog_type *Regex::shortcut_escape(char c, int *flag_param, EscapeFlags emitType)
 	}
 
 	if (!strchr(valid_codes, c)) {
-		return nullptr; // Not a valid shortcut escape sequence
+		return NoNode; // Not a valid shortcut escape sequence
 	} else if (emitType == EscapeFlags::CHECK_ESCAPE || emitType == EscapeFlags::CHECK_CLASS_ESCAPE) {
 		return ret_val; // Just checking if this is a valid shortcut escape.
 	}
@@ -2173,13 +2396,13 @@ prog_type *Regex::shortcut_escape(char c, int *flag_param, EscapeFlags emitType)
  * references and are used in syntax highlighting patterns to match
  * text previously matched by another regex. *** IMPLEMENT LATER ***
  *--------------------------------------------------------------------*/
-prog_type *Regex::back_ref(const char *c, int *flag_param, EscapeFlags emitType) {
+Regex::node_index Regex::back_ref(const char *c, int *flag_param, EscapeFlags emitType) {
 
 	int paren_no;
 	int c_offset = 0;
 	int is_cross_regex = 0;
 
-	prog_type *ret_val;
+	node_index ret_val;
 
 	// Implement cross regex backreferences later.
 #if 0
@@ -2194,7 +2417,7 @@ prog_type *Regex::back_ref(const char *c, int *flag_param, EscapeFlags emitType)
 	if (!isdigit(c[c_offset]) || // Only \1, \2, ... \9 are supported.
 	    paren_no == 0) {             // Should be caught by numeric_escape.
 
-		return nullptr;
+		return NoNode;
 	}
 
 	// Make sure parentheses for requested back-reference are complete.
@@ -2222,14 +2445,15 @@ prog_type *Regex::back_ref(const char *c, int *flag_param, EscapeFlags emitType)
 		}
 
 		emit_byte(static_cast<prog_type>(paren_no));
+		Has_Back_Refs = true;
 
 		if (is_cross_regex || Paren_Has_Width[paren_no]) {
 			*flag_param |= HAS_WIDTH;
 		}
 	} else if (emitType == EscapeFlags::CHECK_ESCAPE) {
-		ret_val = reinterpret_cast<prog_type *>(1);
+		ret_val = 1; // Any value but NoNode.
 	} else {
-		ret_val = nullptr;
+		ret_val = NoNode;
 	}
 
 	return ret_val;
@@ -2242,10 +2466,46 @@ prog_type *Regex::back_ref(const char *c, int *flag_param, EscapeFlags emitType)
 
 
 
-RegexMatch* Regex::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_to) {
+RegexMatch* Regex::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_to, const TextGap *gap) const {
+	auto match = new RegexMatch(this);
+	
+	const bool found = match->ExecRE(string, end, direction, prev_char, succ_char, delimiters, look_behind_to, match_to, gap, nullptr);
+	
+	reportMemoization(match);
+	reportProfile(match);
+	
+	if(found) {
+		return match;	
+	}
+	
+	delete match;
+	return nullptr;
+}
+
+RegexMatch* Regex::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_to, const TextGap *gap, const ExecBudget &budget, ExecStatus *status, const char **stopped_at) const {
 	auto match = new RegexMatch(this);
 	
-	if(match->ExecRE(string, end, direction, prev_char, succ_char, delimiters, look_behind_to, match_to)) {
+	const bool found = match->ExecRE(string, end, direction, prev_char, succ_char, delimiters, look_behind_to, match_to, gap, &budget);
+	
+	reportMemoization(match);
+	reportProfile(match);
+	
+	if (status) {
+		if (found) {
+			*status = ExecStatus::Matched;
+		} else if (!match->budgetExceeded_) {
+			*status = ExecStatus::NoMatch;
+		} else {
+			// Stopped in the very attempt a resumed search would start with.
+			*status = (match->attemptStart_ == (direction == Direction::Forward ? string : end)) ? ExecStatus::NoProgress : ExecStatus::BudgetExceeded;
+		}
+	}
+	
+	if (stopped_at) {
+		*stopped_at = match->budgetExceeded_ ? match->attemptStart_ : nullptr;
+	}
+	
+	if(found) {
 		return match;	
 	}
 	
@@ -2253,6 +2513,69 @@ RegexMatch* Regex::ExecRE(const char *string, const char *end, Direction directi
 	return nullptr;
 }
 
+/*----------------------------------------------------------------------*
+ * reportMemoization
+ *
+ * Warns, once per expression, that an execution had to fall back to
+ * memoization.
+ *----------------------------------------------------------------------*/
+void Regex::reportMemoization(const RegexMatch *match) const {
+	if (match->memoTriggered_ && !memoTriggered_.exchange(true)) {
+		qDebug("regex backtracks excessively, memoization enabled; please respecify expression: %s", qPrintable(regex_));
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * reportProfile
+ *
+ * Adds the counts of an execution to those of the expression.
+ *----------------------------------------------------------------------*/
+void Regex::reportProfile(const RegexMatch *match) const {
+#ifdef REGEX_PROFILE
+	std::lock_guard<std::mutex> lock(profileMutex_);
+	profile_.Add(match->profile_);
+#else
+	(void)match;
+#endif
+}
+
+/*----------------------------------------------------------------------*
+ * Profile
+ *----------------------------------------------------------------------*/
+RegexProfile Regex::Profile() const {
+	std::lock_guard<std::mutex> lock(profileMutex_);
+	return profile_;
+}
+
+/*----------------------------------------------------------------------*
+ * ResetProfile
+ *----------------------------------------------------------------------*/
+void Regex::ResetProfile() const {
+	std::lock_guard<std::mutex> lock(profileMutex_);
+	profile_ = RegexProfile();
+}
+
+/*----------------------------------------------------------------------*
+ * SetMemoization
+ *----------------------------------------------------------------------*/
+void Regex::SetMemoization(Memoization mode) const {
+	memoMode_ = mode;
+}
+
+/*----------------------------------------------------------------------*
+ * MemoizationTriggered
+ *----------------------------------------------------------------------*/
+bool Regex::MemoizationTriggered() const {
+	return memoTriggered_;
+}
+
+/*----------------------------------------------------------------------*
+ * Pattern
+ *----------------------------------------------------------------------*/
+QString Regex::Pattern() const {
+	return regex_;
+}
+
 
 
 
@@ -2270,41 +2593,55 @@ void Regex::SetDefaultWordDelimiters(const char *delimiters) {
 /*----------------------------------------------------------------------*
  * emit_byte
  *
- * Emit (if appropriate) a byte of code (usually part of an operand.)
+ * Emit a byte of code (usually part of an operand.)
  *----------------------------------------------------------------------*/
 void Regex::emit_byte(prog_type c) {
-
-	if (Code_Emit_Ptr == &Compute_Size) {
-		Reg_Size++;
-	} else {
-		*Code_Emit_Ptr++ = c;
-	}
+	Code.push_back(c);
 }
 
 /*----------------------------------------------------------------------*
  * emit_class_byte
  *
- * Emit (if appropriate) a byte of code (usually part of a character
- * class operand.)
+ * Emit a byte of code (usually part of a character class operand.)
  *----------------------------------------------------------------------*/
 void Regex::emit_class_byte(prog_type c) {
 
-	if (Code_Emit_Ptr == &Compute_Size) {
-		Reg_Size++;
-
-		if (Is_Case_Insensitive && isalpha(c))
-			Reg_Size++;
-	} else if (Is_Case_Insensitive && isalpha(c)) {
+	if (Is_Case_Insensitive && isalpha(c)) {
 		/* For case insensitive character classes, emit both upper and lower case
 		 versions of alphabetical characters. */
 
-		*Code_Emit_Ptr++ = tolower(c);
-		*Code_Emit_Ptr++ = toupper(c);
+		Code.push_back(tolower(c));
+		Code.push_back(toupper(c));
 	} else {
-		*Code_Emit_Ptr++ = c;
+		Code.push_back(c);
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * emit_class_bitmap
+ *
+ * Replace the class characters emitted since 'operand' with the bitmap
+ * form of the operand. For ANY_BUT the bitmap holds the characters the
+ * node DOES match, so both kinds of class are tested the same way.
+ *----------------------------------------------------------------------*/
+void Regex::emit_class_bitmap(node_index operand) {
+
+	bool members[UCHAR_MAX + 1] = {};
+
+	for (node_index i = operand; i < Code.size(); i++) {
+		members[static_cast<uint8_t>(Code[i])] = true;
 	}
+
+	if (Code[operand - NodeSize] == ANY_BUT) {
+		for (bool &member : members) {
+			member = !member;
+		}
+	}
+
+	Code.resize(operand + ClassSize);
+	makeClassOperand(&Code[operand], members);
 }
 
 bool Regex::isQuantifier(prog_type c) const {
-	return (c == '*' || c == '+' || c == '?' || c == Brace_Char);
+	return (c == '*' || c == '+' || c == '?' || c == static_cast<prog_type>(Brace_Char));
 }
@@ -7,6 +7,9 @@
 #include <cstdint>
 #include <cstddef>
 #include <bitset>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include <QString>
 #include "Types.h"
 #include "RegexMatch.h"
@@ -29,6 +32,8 @@ enum RE_DEFAULT_FLAG {
 
 class Regex {
 	friend class RegexMatch;
+	friend class RegexIterator;
+	friend class RegexAnalysis;
 public:
 	/* Number of bytes to offset from the beginning of the regex program to the
        start of the actual compiled regex code, i.e. skipping over the MAGIC 
@@ -36,28 +41,38 @@ public:
 	 */
 	static const int RegexStartOffset = 3;
 	
-	// Largest size a compiled regex can be. Probably could be 65535UL.
-	static const int MaxCompiledSize = 32767UL;
+	/* Largest size a compiled regex can be, in program units. NEXT offsets
+	   are signed 32-bit values. */
+	static const size_t MaxCompiledSize = INT32_MAX;
 	
 	/* The first byte of the Regex internal 'program' is a magic number to help
 	   gaurd against corrupted data; the compiled regex code really begins in the
 	   second byte. */	
 	static const prog_type MAGIC = 0x9c;
 	
-	/* A node is one char of opcode followed by two chars of NEXT pointer plus
-	 * any operands.  NEXT pointers are stored as two 8-bit pieces, high order
-	 * first.  The value is a positive offset from the opcode of the node
-	 * containing it.  An operand, if any, simply follows the node.  (Note that
-	 * much of the code generation knows about this implicit relationship.)
+	/* A node is one 32-bit unit of opcode followed by one unit of NEXT offset
+	 * plus any operands.  The NEXT offset is a signed count of units from the
+	 * opcode of the node containing it to the node that follows, negative for
+	 * BACK nodes and zero at the end of a chain, so following it is a single
+	 * add.  An operand, if any, simply follows the node.  (Note that much of
+	 * the code generation knows about this implicit relationship.)
 	 *
-	 * Using two bytes for NEXT_PTR_SIZE is vast overkill for most things,
-	 * but allows patterns to get big without disasters. */
-	static const int LengthSize  = 4;
+	 * Counts ({m,n} bounds, look-behind lengths) take one unit each. */
+	static const int LengthSize  = 2;
 	static const int IndexSize	 = 1;
 	static const int OpcodeSize  = 1;
-	static const int NextPtrSize = 2;
+	static const int NextPtrSize = 1;
 	static const int NodeSize	 = (NextPtrSize + OpcodeSize);
 
+	/* ANY_OF and ANY_BUT operands are a 256 bit membership bitmap, 32 bits to
+	 * a unit, followed by a count and list of the characters that are NOT
+	 * members, if there are no more than ClassStopSize of them (the count is
+	 * zero otherwise). The list lets runs like [^"]* be scanned for their few
+	 * stop characters instead of testing every character. */
+	static const int ClassBitmapSize = 8;
+	static const int ClassStopSize   = 4;
+	static const int ClassSize       = (ClassBitmapSize + 1 + ClassStopSize);
+
 	
 	// Flags for function shortcut_escape()
 	enum class EscapeFlags {
@@ -91,31 +106,87 @@ public:
 	 * @param delimiters - Word delimiters to use (NULL for default)
 	 * @param look_behind_to - Boundary for look-behind; defaults to "string" if NULL
 	 * @param match_till - Boundary to where match can extend. \0 is assumed to be the boundary if not set. Lookahead can cross the boundary.
+	 * @param gap - Gap the text continues after, e.g. in a gap buffer (NULL if the text is contiguous).
+	 * @return
+	 */
+	RegexMatch* ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char,
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap = nullptr) const;
+
+	/**
+	 * @brief ExecRE - Match a 'regexp' structure against a string within a budget, see above for the other parameters.
+	 * @param budget - Limits on the work done.
+	 * @param status - Set to the outcome, telling a search that ran out of budget from one that found nothing (may be NULL).
+	 *                 NoProgress means it ran out of budget before getting past 'string' ('end' for a backward search):
+	 *                 resuming with the same budget would stop there again, the caller has to grow the budget (or give up).
+	 * @param stopped_at - Set to where a search that ran out of budget got to, NULL otherwise (may be NULL). No match
+	 *                     starts before it (after it for a backward search), so the search can be resumed from there.
 	 * @return
 	 */
 	RegexMatch* ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char,
-	           const char *delimiters, const char *look_behind_to, const char *match_till);
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap,
+	           const ExecBudget &budget, ExecStatus *status, const char **stopped_at) const;
 
 private:
+	/* While compiling, nodes are referred to by their offset into 'Code' so
+	   that it can grow as code is emitted. Offset 0 holds the MAGIC number and
+	   never starts a node, so it doubles as "no node". */
+	typedef size_t node_index;
+	static const node_index NoNode = 0;
+
 	// for CompileRE
-	prog_type *alternative(int *flag_param, len_range *range_param);
-	prog_type *atom(int *flag_param, len_range *range_param);
-	prog_type *back_ref(const char *c, int *flag_param, EscapeFlags emitType);
-	prog_type *chunk(int paren, int *flag_param, len_range *range_param);
-	prog_type *emit_node(prog_type op_code);
-	prog_type *emit_special(prog_type op_code, unsigned long test_val, int index);
-	prog_type *piece(int *flag_param, len_range *range_param);
-	prog_type *shortcut_escape(char c, int *flag_param, EscapeFlags emitType);
-	prog_type *insert(prog_type op, prog_type *opnd, long min, long max, int index);
+	node_index alternative(int *flag_param, len_range *range_param);
+	node_index atom(int *flag_param, len_range *range_param);
+	node_index back_ref(const char *c, int *flag_param, EscapeFlags emitType);
+	node_index chunk(int paren, int *flag_param, len_range *range_param);
+	node_index emit_node(prog_type op_code);
+	node_index emit_special(prog_type op_code, unsigned long test_val, int index);
+	node_index piece(int *flag_param, len_range *range_param);
+	node_index shortcut_escape(char c, int *flag_param, EscapeFlags emitType);
+	node_index insert(prog_type op, node_index opnd, long min, long max, int index);
+	node_index next_node(node_index node) const;
+	void tail(node_index search_from, node_index point_to);
+	void offset_tail(node_index ptr, int offset, node_index val);
+	void branch_tail(node_index ptr, int offset, node_index val);
 	void emit_byte(prog_type c);
 	void emit_class_byte(prog_type c);
+	void emit_class_bitmap(node_index operand);
 	bool isQuantifier(prog_type c) const;
 
+	// for ExecRE
+	void reportMemoization(const RegexMatch *match) const;
+	void reportProfile(const RegexMatch *match) const;
+
 public:
 	/* Builds a default delimiter table that persists across 'ExecRE' calls that
 	   is identical to 'delimiters'.  Pass NULL for "default default" set of
 	   delimiters. */
 	static void SetDefaultWordDelimiters(const char *delimiters);
+
+public:
+	/* Selects the memoization mode used by subsequent 'ExecRE' calls. Patterns
+	   using back-references or general {m,n} counters carry state the memo
+	   can't capture and always run without it. The mode only changes how long
+	   a search takes, not its match or captures: groups inside look-arounds
+	   are only reported when the rest of the expression matched too, so a
+	   failure the memo skips can't leave captures behind. The mode may be
+	   changed on a shared expression (see RegexCache), it then applies to
+	   every user of it, and searches already running keep the mode they
+	   started with. */
+	void SetMemoization(Memoization mode) const;
+	
+	/* True once an 'Auto' mode execution of this expression had to fall back
+	   to memoization, i.e. the pattern backtracks catastrophically on some
+	   input and should be rewritten. */
+	bool MemoizationTriggered() const;
+	
+	// The source text this expression was compiled from.
+	QString Pattern() const;
+
+	/* Work done by all searches of this expression so far, see RegexProfile.
+	   All zero unless the matcher was built with REGEX_PROFILE. Searches
+	   from any thread are counted. */
+	RegexProfile Profile() const;
+	void ResetProfile() const;
 	
 	/* Default table for determining whether a character is a word delimiter. */
 	static bool DefaultDelimiters[UCHAR_MAX + 1];
@@ -123,7 +194,10 @@ public:
 private:
 	prog_type       match_start_;     // Internal use only.
 	char            anchor_;          // Internal use only.
-	prog_type *     program_;
+	bool            has_first_chars_; // Internal use only.
+	prog_type       first_chars_[ClassSize]; // Class operand of the characters a match can start with.
+	prog_type       first_char_list_[ClassStopSize + 1]; // Count and list of those characters if there are no more than ClassStopSize of them, the count is zero otherwise.
+	prog_type *     program_;    // Points into 'Code' once compiled.
 	size_t          Total_Paren; // Parentheses, (),  counter.
 	size_t          Num_Braces;  // Number of general {m,n} constructs. {m,n} quantifiers of SIMPLE atoms are not included in this
 	                             // count.
@@ -133,15 +207,22 @@ private:
 	std::bitset<32> Closed_Parens;   // Bit flags indicating () closure.
 	std::bitset<32> Paren_Has_Width; // Bit flags indicating ()'s that are known to not match the empty string
 	
-	prog_type *     Code_Emit_Ptr; // When Code_Emit_Ptr is set to &Compute_Size no code is emitted. Instead, the size of
-							       // code that WOULD have been generated is accumulated in Reg_Size.  Otherwise,
-							       // Code_Emit_Ptr points to where compiled regex code is to be written.
-
+	std::vector<prog_type> Code;   // Compiled regex code, grows while it is being emitted.
 	size_t          Reg_Size;      // Size of compiled regex code.
 	bool            Is_Case_Insensitive;
 	bool            Match_Newline;
 	char            Brace_Char;
 	const char *    Meta_Char;	
+	
+	bool                             Has_Back_Refs;   // Program contains BACK_REF nodes, memoization is unsound.
+	mutable std::atomic<Memoization> memoMode_;
+	mutable std::atomic<bool>        memoTriggered_;
+	mutable std::mutex               profileMutex_;
+	mutable RegexProfile             profile_;        // Sum of the profiles of all searches.
 };
 
+inline prog_type *getOperand(prog_type *p) {
+	return p + Regex::NodeSize;
+}
+
 #endif
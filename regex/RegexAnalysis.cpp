@@ -0,0 +1,1120 @@
+
+#include "RegexAnalysis.h"
+#include "Regex.h"
+#include "RegexOpcodes.h"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+namespace {
+
+typedef std::bitset<UCHAR_MAX + 1> CharSet;
+
+// Limit on the nodes visited while following the empty paths of a program.
+const int ClosureBudget = 100000;
+
+// Limit on the state pairs looked at while comparing paths.
+const size_t PairBudget = 4000000;
+
+/* A node (or one character of a string node) that reads a character. A
+   repetition of a SIMPLE atom is a single state with a loop back to itself.
+   What an atomic group or a possessive quantifier matches can't be matched
+   any other way, so it is a single state as well, read in one go. So is an
+   alternation of literal words, such as a keyword list: each word can only
+   be matched by its own alternative. */
+struct State {
+	State(prog_type *n, size_t p) : node(n), part(p), loops(false), chunk(false), nullable(false), expanded(false) {
+	}
+
+	prog_type *node;
+	size_t     part;     // Character of a string node.
+	CharSet    chars;    // Characters it reads.
+	bool       loops;    // Reads any number of characters.
+	bool       chunk;    // Atomic group, possessive quantifier or alternation of words.
+	bool       nullable; // Atomic group that may match the empty string.
+	bool       expanded;
+
+	// States that can read the next character, with the number of paths there (at most 2).
+	std::vector<std::pair<int, int>> next;
+};
+
+// States an empty path leads to, with the number of such paths (at most 2).
+struct Targets {
+	Targets() : accepts(false) {
+	}
+
+	std::map<int, int> paths;
+	bool               accepts;
+};
+
+size_t string_length(const prog_type *s) {
+	size_t n = 0;
+	while (s[n] != '\0') {
+		++n;
+	}
+	return n;
+}
+
+bool isSimpleQuantifier(prog_type op) {
+	switch (op) {
+	case STAR:
+	case LAZY_STAR:
+	case POSSESSIVE_STAR:
+	case PLUS:
+	case LAZY_PLUS:
+	case POSSESSIVE_PLUS:
+	case QUESTION:
+	case LAZY_QUESTION:
+	case POSSESSIVE_QUESTION:
+	case BRACE:
+	case LAZY_BRACE:
+	case POSSESSIVE_BRACE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: atomChars
+// Desc: the characters character 'part' of the SIMPLE node 'node' reads
+//------------------------------------------------------------------------------
+CharSet atomChars(prog_type *node, size_t part) {
+
+	CharSet chars;
+
+	const prog_type op = getOpcode(node);
+	const prog_type *operand = getOperand(node);
+	const prog_type *class_operand = (op == ANY_OF || op == ANY_BUT) ? operand : shortcutClass(op);
+
+	for (int c = 1; c <= UCHAR_MAX; c++) {
+		const char ch = static_cast<char>(c);
+
+		if (class_operand) {
+			chars[c] = classMember(class_operand, ch);
+		} else if (op == EXACTLY) {
+			chars[c] = (static_cast<prog_type>(ch) == operand[part]);
+		} else if (op == SIMILAR) {
+			chars[c] = (static_cast<prog_type>(tolower(ch)) == operand[part]);
+		} else {
+			// Delimiters are only known when searching, back-references read anything.
+			chars[c] = true;
+		}
+	}
+
+	return chars;
+}
+
+//------------------------------------------------------------------------------
+// Name: literalWords
+// Desc: if every alternative of the alternation starting at 'node' is a
+//       string node of the same kind leading to the same node, the words,
+//       sorted, otherwise nothing
+//------------------------------------------------------------------------------
+std::vector<std::vector<prog_type>> literalWords(prog_type *node) {
+
+	std::vector<std::vector<prog_type>> words;
+
+	const prog_type op = getOpcode(getOperand(node));
+	prog_type *const end = next_ptr(getOperand(node));
+
+	for (prog_type *branch = node; branch && getOpcode(branch) == BRANCH; branch = next_ptr(branch)) {
+		prog_type *word = getOperand(branch);
+
+		if ((op != EXACTLY && op != SIMILAR) || getOpcode(word) != op || next_ptr(word) != end) {
+			return std::vector<std::vector<prog_type>>();
+		}
+
+		const prog_type *operand = getOperand(word);
+		words.push_back(std::vector<prog_type>(operand, operand + string_length(operand)));
+	}
+
+	std::sort(words.begin(), words.end());
+	return words;
+}
+
+//------------------------------------------------------------------------------
+// Name: describeChars
+// Desc: a character class that reads like 'chars'
+//------------------------------------------------------------------------------
+std::string describeChars(const CharSet &chars) {
+
+	CharSet all;
+	for (int c = 1; c <= UCHAR_MAX; c++) {
+		all[c] = true;
+	}
+
+	if (chars == all) {
+		return "any character";
+	}
+
+	CharSet dot = all;
+	dot['\n'] = false;
+	if (chars == dot) {
+		return ".";
+	}
+
+	auto escaped = [](int c) {
+		char buf[8];
+		switch (c) {
+		case '\n': return std::string("\\n");
+		case '\t': return std::string("\\t");
+		case '\\': case ']': case '[': case '^': case '-':
+			buf[0] = '\\';
+			buf[1] = static_cast<char>(c);
+			buf[2] = '\0';
+			return std::string(buf);
+		default:
+			if (isprint(c)) {
+				return std::string(1, static_cast<char>(c));
+			}
+			snprintf(buf, sizeof(buf), "\\x%02x", c);
+			return std::string(buf);
+		}
+	};
+
+	if (chars.count() == 1) {
+		for (int c = 1; c <= UCHAR_MAX; c++) {
+			if (chars[c]) {
+				return "'" + escaped(c) + "'";
+			}
+		}
+	}
+
+	const bool negated = chars.count() > all.count() / 2;
+	const CharSet members = negated ? (all & ~chars) : chars;
+
+	std::string text = negated ? "[^" : "[";
+
+	for (int c = 1; c <= UCHAR_MAX; c++) {
+		if (!members[c]) {
+			continue;
+		}
+
+		int last = c;
+		while (last < UCHAR_MAX && members[last + 1]) {
+			++last;
+		}
+
+		text += escaped(c);
+		if (last > c + 1) {
+			text += "-";
+		}
+		if (last > c) {
+			text += escaped(last);
+		}
+
+		c = last;
+	}
+
+	return text + "]";
+}
+
+/* The program as an NFA of the states above, see RegexAnalysis. */
+class Automaton {
+public:
+	Automaton() : budget_(ClosureBudget), failed_(false) {
+	}
+
+public:
+	bool build(prog_type *start);
+
+	const std::vector<State> &states() const {
+		return states_;
+	}
+
+private:
+	int stateFor(prog_type *node, size_t part);
+	int chunkFor(prog_type *node);
+	int wordsFor(prog_type *node, const std::vector<std::vector<prog_type>> &words);
+	void closure(prog_type *node, Targets *targets);
+	void expand(int s);
+	void addTargets(int s, const Targets &targets);
+	bool hasLoop(size_t first, size_t last) const;
+	bool reaches(int from, int to) const;
+	static prog_type *after(prog_type *node);
+
+private:
+	std::vector<State>                          states_;
+	std::map<std::pair<prog_type *, size_t>, int> ids_;
+	std::vector<prog_type *>                    path_;
+	std::vector<prog_type *>                    bodies_;
+	std::vector<prog_type *>                    repeated_; // Alternations of words not to read in one go.
+	std::vector<int>                            prefixed_; // States of alternations of words that begin one another.
+	int                                         budget_;
+	bool                                        failed_;
+};
+
+//------------------------------------------------------------------------------
+// Name: after
+// Desc: the node following a look-around or atomic group, as the matcher
+//       finds it
+//------------------------------------------------------------------------------
+prog_type *Automaton::after(prog_type *node) {
+
+	const prog_type op = getOpcode(node);
+	const bool behind  = (op == POS_BEHIND_OPEN || op == NEG_BEHIND_OPEN || op == POS_BEHIND_SIMPLE || op == NEG_BEHIND_SIMPLE);
+
+	prog_type *next = next_ptr(getOperand(node) + (behind ? Regex::LengthSize : 0)); // Skip 1st branch
+	while (getOpcode(next) == BRANCH) {
+		next = next_ptr(next);
+	}
+
+	return next_ptr(next); // Skip the close
+}
+
+//------------------------------------------------------------------------------
+// Name: build
+// Desc: builds the states of the program starting at 'start' and of the
+//       look-around bodies in it. Returns false if the program is too large
+//       to analyse.
+//------------------------------------------------------------------------------
+bool Automaton::build(prog_type *start) {
+
+	bodies_.push_back(start);
+
+	for (size_t b = 0; b < bodies_.size() && !failed_; ++b) {
+		Targets targets;
+		closure(bodies_[b], &targets);
+
+		for (size_t s = 0; s < states_.size() && !failed_; ++s) {
+			expand(static_cast<int>(s));
+		}
+	}
+
+	if (failed_) {
+		return false;
+	}
+
+	/* Repeated alternations of words that begin one another, as in (a|aa)*,
+	   may split the same text more than one way; they are built again word
+	   by word, so that the paths through them are counted. */
+	const size_t nRepeated = repeated_.size();
+	for (int s : prefixed_) {
+		if (reaches(s, s)) {
+			repeated_.push_back(states_[s].node);
+		}
+	}
+
+	if (repeated_.size() == nRepeated) {
+		return true;
+	}
+
+	states_.clear();
+	ids_.clear();
+	bodies_.clear();
+	prefixed_.clear();
+	budget_ = ClosureBudget;
+	return build(start);
+}
+
+//------------------------------------------------------------------------------
+// Name: reaches
+// Desc: true if state 'to' can be read after state 'from'
+//------------------------------------------------------------------------------
+bool Automaton::reaches(int from, int to) const {
+
+	std::vector<bool> seen(states_.size());
+	std::vector<int> pending(1, from);
+
+	while (!pending.empty()) {
+		const int s = pending.back();
+		pending.pop_back();
+
+		for (const std::pair<int, int> &next : states_[s].next) {
+			if (next.first == to) {
+				return true;
+			}
+
+			if (!seen[next.first]) {
+				seen[next.first] = true;
+				pending.push_back(next.first);
+			}
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Name: stateFor
+//------------------------------------------------------------------------------
+int Automaton::stateFor(prog_type *node, size_t part) {
+
+	auto it = ids_.find(std::make_pair(node, part));
+	if (it != ids_.end()) {
+		return it->second;
+	}
+
+	if (states_.size() >= RegexAnalysis::MaxStates) {
+		failed_ = true;
+		return 0;
+	}
+
+	const int s = static_cast<int>(states_.size());
+	ids_[std::make_pair(node, part)] = s;
+	states_.push_back(State(node, part));
+
+	State &state = states_.back();
+	const prog_type op = getOpcode(node);
+
+	if (op == BRACE || op == LAZY_BRACE || op == POSSESSIVE_BRACE) {
+		const size_t max = getOffset(node + (2 * Regex::NextPtrSize));
+		state.chars = atomChars(getOperand(node + (2 * Regex::NextPtrSize)), 0);
+		state.loops = (max == REG_INFINITY || max > REG_ONE);
+		state.chunk = (op == POSSESSIVE_BRACE);
+	} else if (isSimpleQuantifier(op)) {
+		state.chars = atomChars(getOperand(node), 0);
+		state.loops = (op != QUESTION && op != LAZY_QUESTION && op != POSSESSIVE_QUESTION);
+		state.chunk = (op == POSSESSIVE_STAR || op == POSSESSIVE_PLUS || op == POSSESSIVE_QUESTION);
+	} else {
+		state.chars = atomChars(node, part);
+	}
+
+	return s;
+}
+
+//------------------------------------------------------------------------------
+// Name: chunkFor
+// Desc: the state of an atomic group, analysing its body as it goes
+//------------------------------------------------------------------------------
+int Automaton::chunkFor(prog_type *node) {
+
+	auto it = ids_.find(std::make_pair(node, size_t(0)));
+	if (it != ids_.end()) {
+		return it->second;
+	}
+
+	const int s = stateFor(node, 0);
+	if (failed_) {
+		return s;
+	}
+
+	// The body reads everything the group does. Its empty paths are not part of the enclosing one.
+	std::vector<prog_type *> path;
+	path_.swap(path);
+
+	const size_t first = states_.size();
+
+	Targets body;
+	closure(next_ptr(node), &body);
+
+	for (size_t b = first; b < states_.size() && !failed_; ++b) {
+		expand(static_cast<int>(b));
+	}
+
+	path_.swap(path);
+
+	CharSet chars;
+	for (size_t b = first; b < states_.size(); ++b) {
+		chars |= states_[b].chars;
+	}
+
+	State &state   = states_[s];
+	state.chars    = chars;
+	state.loops    = hasLoop(first, states_.size());
+	state.chunk    = true;
+	state.nullable = body.accepts;
+
+	return s;
+}
+
+//------------------------------------------------------------------------------
+// Name: wordsFor
+// Desc: the state of an alternation of literal words
+//------------------------------------------------------------------------------
+int Automaton::wordsFor(prog_type *node, const std::vector<std::vector<prog_type>> &words) {
+
+	auto it = ids_.find(std::make_pair(node, size_t(0)));
+	if (it != ids_.end()) {
+		return it->second;
+	}
+
+	const int s = stateFor(node, 0);
+	if (failed_) {
+		return s;
+	}
+
+	const bool similar = (getOpcode(getOperand(node)) == SIMILAR);
+
+	CharSet chars;
+	for (const std::vector<prog_type> &word : words) {
+		for (prog_type c : word) {
+			chars.set(c);
+			if (similar) {
+				chars.set(static_cast<unsigned char>(toupper(c)));
+			}
+		}
+	}
+
+	State &state   = states_[s];
+	state.chars    = chars;
+	state.loops    = false;
+	state.chunk    = true;
+	state.nullable = false;
+
+	/* Where one word begins another, the alternation can match more than once
+	   at the same place. Unless it is repeated, that costs no more than a
+	   constant, see build. */
+	for (size_t i = 1; i < words.size(); ++i) {
+		if (words[i].size() >= words[i - 1].size() && std::equal(words[i - 1].begin(), words[i - 1].end(), words[i].begin())) {
+			prefixed_.push_back(s);
+			break;
+		}
+	}
+
+	return s;
+}
+
+//------------------------------------------------------------------------------
+// Name: hasLoop
+// Desc: true if states 'first' up to 'last' can read any number of characters
+//------------------------------------------------------------------------------
+bool Automaton::hasLoop(size_t first, size_t last) const {
+
+	enum { Unseen, Open, Done };
+	std::vector<int> mark(last - first, Unseen);
+	std::vector<std::pair<size_t, size_t>> calls; // State and next edge to follow.
+
+	for (size_t root = first; root < last; ++root) {
+		if (states_[root].loops) {
+			return true;
+		}
+
+		if (mark[root - first] != Unseen) {
+			continue;
+		}
+
+		mark[root - first] = Open;
+		calls.push_back(std::make_pair(root, size_t(0)));
+
+		while (!calls.empty()) {
+			const size_t s = calls.back().first;
+			const size_t e = calls.back().second++;
+
+			if (e == states_[s].next.size()) {
+				mark[s - first] = Done;
+				calls.pop_back();
+				continue;
+			}
+
+			const size_t t = static_cast<size_t>(states_[s].next[e].first);
+			if (t < first || t >= last) {
+				continue;
+			}
+
+			if (mark[t - first] == Open) {
+				return true;
+			}
+
+			if (mark[t - first] == Unseen) {
+				mark[t - first] = Open;
+				calls.push_back(std::make_pair(t, size_t(0)));
+			}
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Name: closure
+// Desc: adds the states the empty paths from 'node' lead to, counting the
+//       paths to each. Empty loops are not followed round.
+//------------------------------------------------------------------------------
+void Automaton::closure(prog_type *node, Targets *targets) {
+
+	const size_t mark = path_.size();
+
+	while (node && !failed_) {
+
+		if (--budget_ < 0) {
+			failed_ = true;
+			break;
+		}
+
+		if (std::find(path_.begin(), path_.end(), node) != path_.end()) {
+			break;
+		}
+
+		path_.push_back(node);
+
+		const prog_type op = getOpcode(node);
+		int reads = -1;
+
+		switch (op) {
+		case END:
+		case LOOK_AHEAD_CLOSE:
+		case LOOK_BEHIND_CLOSE:
+		case ATOMIC_CLOSE:
+			targets->accepts = true;
+			node = nullptr;
+			break;
+
+		case EXACTLY:
+		case SIMILAR:
+		case ANY_OF:
+		case ANY_BUT:
+		case ANY:
+		case EVERY:
+		case DIGIT:
+		case NOT_DIGIT:
+		case LETTER:
+		case NOT_LETTER:
+		case SPACE:
+		case SPACE_NL:
+		case NOT_SPACE:
+		case NOT_SPACE_NL:
+		case WORD_CHAR:
+		case NOT_WORD_CHAR:
+		case IS_DELIM:
+		case NOT_DELIM:
+		case PLUS:
+		case LAZY_PLUS:
+		case POSSESSIVE_PLUS:
+			reads = stateFor(node, 0);
+			node = nullptr;
+			break;
+
+		case STAR:
+		case LAZY_STAR:
+		case POSSESSIVE_STAR:
+		case QUESTION:
+		case LAZY_QUESTION:
+		case POSSESSIVE_QUESTION:
+		case BACK_REF:
+		case BACK_REF_CI:
+		case X_REGEX_BR:
+		case X_REGEX_BR_CI:
+			// May read nothing at all.
+			reads = stateFor(node, 0);
+			node = next_ptr(node);
+			break;
+
+		case BRACE:
+		case LAZY_BRACE:
+		case POSSESSIVE_BRACE:
+			reads = stateFor(node, 0);
+			node = (getOffset(node + Regex::NextPtrSize) == REG_ZERO) ? next_ptr(node) : nullptr;
+			break;
+
+		case BRANCH: {
+			prog_type *next = next_ptr(node);
+			if (!next || getOpcode(next) != BRANCH) {
+				// No choice.
+				node = getOperand(node);
+				break;
+			}
+
+			const std::vector<std::vector<prog_type>> words = literalWords(node);
+			if (!words.empty() && std::find(repeated_.begin(), repeated_.end(), node) == repeated_.end()) {
+				reads = wordsFor(node, words);
+				node = nullptr;
+				break;
+			}
+
+			for (prog_type *branch = node; branch && getOpcode(branch) == BRANCH; branch = next_ptr(branch)) {
+				closure(getOperand(branch), targets);
+			}
+			node = nullptr;
+			break;
+		}
+
+		case TEST_COUNT: {
+			/* The count is not known, so both ways are open, but only one of
+			      them is for any given count. */
+			Targets below;
+			Targets reached;
+			closure(node + Regex::NodeSize + Regex::IndexSize + Regex::NextPtrSize, &below);
+			closure(next_ptr(node), &reached);
+
+			for (const std::pair<const int, int> &target : reached.paths) {
+				int &paths = below.paths[target.first];
+				paths = std::max(paths, target.second);
+			}
+
+			for (const std::pair<const int, int> &target : below.paths) {
+				int &paths = targets->paths[target.first];
+				paths = std::min(paths + target.second, 2);
+			}
+
+			targets->accepts = targets->accepts || below.accepts || reached.accepts;
+			node = nullptr;
+			break;
+		}
+
+		case POS_AHEAD_OPEN:
+		case NEG_AHEAD_OPEN:
+		case POS_BEHIND_OPEN:
+		case NEG_BEHIND_OPEN:
+		case POS_BEHIND_SIMPLE:
+		case NEG_BEHIND_SIMPLE:
+			// Zero width, its body is an expression of its own.
+			if (std::find(bodies_.begin(), bodies_.end(), next_ptr(node)) == bodies_.end()) {
+				bodies_.push_back(next_ptr(node));
+			}
+			node = after(node);
+			break;
+
+		case ATOMIC_OPEN:
+			reads = chunkFor(node);
+			node = (!failed_ && states_[reads].nullable) ? after(node) : nullptr;
+			break;
+
+		default:
+			// Anchors, parentheses, counters, NOTHING and BACK, all zero width.
+			node = next_ptr(node);
+			break;
+		}
+
+		if (reads >= 0 && !failed_) {
+			int &paths = targets->paths[reads];
+			paths = std::min(paths + 1, 2);
+		}
+	}
+
+	path_.resize(mark);
+}
+
+//------------------------------------------------------------------------------
+// Name: addTargets
+//------------------------------------------------------------------------------
+void Automaton::addTargets(int s, const Targets &targets) {
+	for (const std::pair<const int, int> &target : targets.paths) {
+		states_[s].next.push_back(target);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: expand
+// Desc: works out the states that can follow state 's'
+//------------------------------------------------------------------------------
+void Automaton::expand(int s) {
+
+	if (states_[s].expanded) {
+		return;
+	}
+
+	states_[s].expanded = true;
+
+	prog_type *node = states_[s].node;
+	const prog_type op = getOpcode(node);
+
+	if ((op == EXACTLY || op == SIMILAR) && states_[s].part + 1 < string_length(getOperand(node))) {
+		const int next = stateFor(node, states_[s].part + 1);
+		states_[s].next.push_back(std::make_pair(next, 1));
+		return;
+	}
+
+	Targets targets;
+
+	if (states_[s].loops && !states_[s].chunk) {
+		targets.paths[s] = 1;
+	}
+
+	if (op == ATOMIC_OPEN) {
+		closure(after(node), &targets);
+	} else if (op == BRANCH) {
+		closure(next_ptr(getOperand(node)), &targets);
+	} else {
+		closure(next_ptr(node), &targets);
+	}
+
+	addTargets(s, targets);
+}
+
+/* Pairs of states read along two paths through the same text, see
+   RegexAnalysis. Pair (i, j) is kept with i <= j. */
+class PairGraph {
+public:
+	explicit PairGraph(const std::vector<State> &states);
+
+public:
+	bool build();
+	void findComponents();
+
+	size_t id(int i, int j) const {
+		return (i <= j) ? size_t(i) * n_ + size_t(j) : size_t(j) * n_ + size_t(i);
+	}
+
+	int first(size_t id) const {
+		return static_cast<int>(id / n_);
+	}
+
+	int second(size_t id) const {
+		return static_cast<int>(id % n_);
+	}
+
+	std::vector<bool> reach(size_t from, bool backward) const;
+
+public:
+	std::vector<std::vector<size_t>> edges;     // By pair id, empty for pairs not visited.
+	std::vector<std::vector<size_t>> reverse;
+	std::vector<std::pair<size_t, size_t>> doubled; // Edges between equal pairs that two paths take.
+	std::vector<int> component;                 // Strongly connected component of each pair, -1 if not visited.
+	std::vector<bool> visited;
+
+private:
+	const std::vector<State> &states_;
+	size_t                    n_;
+	std::vector<bool>         overlap_;
+};
+
+PairGraph::PairGraph(const std::vector<State> &states) : states_(states), n_(states.size()) {
+
+	overlap_.resize(n_ * n_);
+	for (size_t i = 0; i < n_; ++i) {
+		for (size_t j = 0; j < n_; ++j) {
+			overlap_[i * n_ + j] = (states_[i].chars & states_[j].chars).any();
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: build
+// Desc: visits the pairs reachable from those of a state with itself.
+//       Returns false if there are too many to look at.
+//------------------------------------------------------------------------------
+bool PairGraph::build() {
+
+	edges.resize(n_ * n_);
+	reverse.resize(n_ * n_);
+	visited.resize(n_ * n_);
+
+	std::vector<size_t> pending;
+	for (size_t i = 0; i < n_; ++i) {
+		pending.push_back(id(int(i), int(i)));
+		visited[pending.back()] = true;
+	}
+
+	size_t work = 0;
+
+	while (!pending.empty()) {
+		const size_t from = pending.back();
+		pending.pop_back();
+
+		const int i = first(from);
+		const int j = second(from);
+
+		for (const std::pair<int, int> &a : states_[i].next) {
+			for (const std::pair<int, int> &b : states_[j].next) {
+
+				if (++work > PairBudget) {
+					return false;
+				}
+
+				// The same two steps taken the other way round.
+				if (i == j && b.first < a.first) {
+					continue;
+				}
+
+				if (!overlap_[size_t(a.first) * n_ + size_t(b.first)]) {
+					continue;
+				}
+
+				const size_t to = id(a.first, b.first);
+
+				if (i == j && a.first == b.first && a.second > 1) {
+					doubled.push_back(std::make_pair(from, to));
+				}
+
+				edges[from].push_back(to);
+				reverse[to].push_back(from);
+
+				if (!visited[to]) {
+					visited[to] = true;
+					pending.push_back(to);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: findComponents
+// Desc: Tarjan's algorithm, without recursion
+//------------------------------------------------------------------------------
+void PairGraph::findComponents() {
+
+	const size_t size = edges.size();
+	std::vector<int>    index(size, -1);
+	std::vector<int>    low(size, 0);
+	std::vector<bool>   onStack(size, false);
+	std::vector<size_t> stack;
+	std::vector<std::pair<size_t, size_t>> calls; // Pair and next edge to follow.
+
+	component.assign(size, -1);
+
+	int counter = 0;
+	int components = 0;
+
+	for (size_t root = 0; root < size; ++root) {
+		if (!visited[root] || index[root] != -1) {
+			continue;
+		}
+
+		calls.push_back(std::make_pair(root, size_t(0)));
+
+		while (!calls.empty()) {
+			const size_t v = calls.back().first;
+			size_t &edge   = calls.back().second;
+
+			if (edge == 0 && index[v] == -1) {
+				index[v] = low[v] = counter++;
+				stack.push_back(v);
+				onStack[v] = true;
+			}
+
+			if (edge < edges[v].size()) {
+				const size_t w = edges[v][edge++];
+
+				if (index[w] == -1) {
+					calls.push_back(std::make_pair(w, size_t(0)));
+				} else if (onStack[w]) {
+					low[v] = std::min(low[v], index[w]);
+				}
+				continue;
+			}
+
+			if (low[v] == index[v]) {
+				size_t w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					onStack[w]   = false;
+					component[w] = components;
+				} while (w != v);
+				++components;
+			}
+
+			calls.pop_back();
+			if (!calls.empty()) {
+				const size_t u = calls.back().first;
+				low[u] = std::min(low[u], low[v]);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: reach
+// Desc: the pairs reachable from (or, if 'backward', reaching) pair 'from'
+//------------------------------------------------------------------------------
+std::vector<bool> PairGraph::reach(size_t from, bool backward) const {
+
+	const std::vector<std::vector<size_t>> &graph = backward ? reverse : edges;
+
+	std::vector<bool> seen(graph.size());
+	std::vector<size_t> pending(1, from);
+	seen[from] = true;
+
+	while (!pending.empty()) {
+		const size_t v = pending.back();
+		pending.pop_back();
+
+		for (size_t w : graph[v]) {
+			if (!seen[w]) {
+				seen[w] = true;
+				pending.push_back(w);
+			}
+		}
+	}
+
+	return seen;
+}
+
+//------------------------------------------------------------------------------
+// Name: longestChain
+// Desc: the most states of 'chain' that can follow one another from 's',
+//       only counting those 'counted'
+//------------------------------------------------------------------------------
+int longestChain(int s, const std::vector<std::vector<int>> &chain, const std::vector<bool> &counted, std::vector<int> *memo, std::vector<int> *best) {
+
+	if ((*memo)[s] != 0) {
+		return (*memo)[s];
+	}
+
+	(*memo)[s] = 1; // Also guards against cycles.
+
+	int length = 1;
+	for (int t : chain[s]) {
+		if (counted[t]) {
+			const int l = 1 + longestChain(t, chain, counted, memo, best);
+			if (l > length) {
+				length = l;
+				if (best) {
+					(*best)[s] = t;
+				}
+			}
+		}
+	}
+
+	(*memo)[s] = length;
+	return length;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Name: StepsPerByte
+//------------------------------------------------------------------------------
+double RegexCost::StepsPerByte(size_t n) const {
+	if (exponential) {
+		return std::pow(2.0, static_cast<double>(n));
+	}
+
+	return std::pow(static_cast<double>(n), degree);
+}
+
+//------------------------------------------------------------------------------
+// Name: Cost
+//------------------------------------------------------------------------------
+RegexCost RegexAnalysis::Cost(const Regex &regex) {
+
+	RegexCost cost;
+
+	Automaton automaton;
+	if (!automaton.build(regex.program_ + Regex::RegexStartOffset)) {
+		return cost;
+	}
+
+	const std::vector<State> &states = automaton.states();
+	const int n = static_cast<int>(states.size());
+
+	PairGraph pairs(states);
+	if (!pairs.build()) {
+		return cost;
+	}
+
+	pairs.findComponents();
+
+	cost.analysed = true;
+	cost.states   = states.size();
+
+	/* Exponential: a pair of a state with itself that can be left along two
+	   different paths through the same text and be come back to. */
+	std::vector<bool> reported(states.size() * states.size());
+
+	for (const std::pair<size_t, size_t> &edge : pairs.doubled) {
+		const int c = pairs.component[edge.first];
+		if (c == pairs.component[edge.second] && !reported[c]) {
+			reported[c] = true;
+			cost.exponential = true;
+
+			RegexHazard hazard;
+			hazard.kind        = RegexHazard::Kind::NestedQuantifier;
+			hazard.description = "nested repetitions can both match " + describeChars(states[pairs.first(edge.second)].chars) + ", the search takes exponential time";
+			cost.hazards.push_back(hazard);
+		}
+	}
+
+	std::vector<bool> hasDiagonal(states.size() * states.size());
+	for (int i = 0; i < n; ++i) {
+		const size_t d = pairs.id(i, i);
+		if (pairs.component[d] >= 0) {
+			hasDiagonal[pairs.component[d]] = true;
+		}
+	}
+
+	for (size_t p = 0; p < pairs.component.size(); ++p) {
+		const int c = pairs.component[p];
+		const int i = pairs.first(p);
+		const int j = pairs.second(p);
+
+		if (c >= 0 && i != j && hasDiagonal[c] && !reported[c]) {
+			reported[c] = true;
+			cost.exponential = true;
+
+			RegexHazard hazard;
+			hazard.kind        = RegexHazard::Kind::OverlappingAlternation;
+			hazard.description = "alternatives of a repetition can both match " + describeChars(states[i].chars & states[j].chars) + ", the search takes exponential time";
+			cost.hazards.push_back(hazard);
+		}
+	}
+
+	/* Polynomial: repetitions p and q, q following p, that can read the same
+	   text along both, i.e. (p, p) leads to (p, q) and that on to (q, q). */
+	std::vector<int> size(pairs.component.size());
+	for (int c : pairs.component) {
+		if (c >= 0) {
+			++size[c];
+		}
+	}
+
+	std::vector<int> looping;
+	for (int i = 0; i < n; ++i) {
+		const size_t d = pairs.id(i, i);
+		const std::vector<size_t> &edges = pairs.edges[d];
+
+		if (states[i].loops || size[pairs.component[d]] > 1 || std::find(edges.begin(), edges.end(), d) != edges.end()) {
+			looping.push_back(i);
+		}
+	}
+
+	if (looping.empty()) {
+		return cost;
+	}
+
+	std::vector<std::vector<bool>> from(states.size());
+	std::vector<std::vector<bool>> to(states.size());
+	for (int p : looping) {
+		from[p] = pairs.reach(pairs.id(p, p), false);
+		to[p]   = pairs.reach(pairs.id(p, p), true);
+	}
+
+	std::vector<std::vector<int>> chain(states.size());
+	for (int p : looping) {
+		for (int q : looping) {
+			const size_t pq = pairs.id(p, q);
+			if (p != q && pairs.component[pq] != pairs.component[pairs.id(p, p)] && from[p][pq] && to[q][pq] && !from[q][pairs.id(p, p)]) {
+				chain[p].push_back(q);
+			}
+		}
+	}
+
+	std::vector<bool> counted(states.size(), true);
+	std::vector<bool> crossesLines(states.size());
+	for (int i = 0; i < n; ++i) {
+		crossesLines[i] = states[i].chars['\n'];
+	}
+
+	std::vector<int> memo(states.size());
+	std::vector<int> best(states.size(), -1);
+	std::vector<int> memoLines(states.size());
+
+	int start = looping.front();
+	int degreeLines = 0;
+	for (int p : looping) {
+		const int length = longestChain(p, chain, counted, &memo, &best);
+		if (length > cost.degree) {
+			cost.degree = length;
+			start = p;
+		}
+
+		if (crossesLines[p]) {
+			degreeLines = std::max(degreeLines, longestChain(p, chain, crossesLines, &memoLines, nullptr));
+		}
+	}
+
+	cost.lineBounded = degreeLines < cost.degree;
+
+	if (cost.degree > 1 && !cost.exponential) {
+		std::string repetitions;
+		for (int s = start; s != -1; s = best[s]) {
+			repetitions += (repetitions.empty() ? "" : ", ") + describeChars(states[s].chars);
+		}
+
+		RegexHazard hazard;
+		hazard.kind        = RegexHazard::Kind::AdjacentQuantifiers;
+		hazard.description = "repetitions of " + repetitions + " in sequence can match the same text, the search takes O(n^" + std::to_string(cost.degree) + ") steps per byte of a " + (cost.lineBounded ? "line" : "text") + " of length n";
+		cost.hazards.push_back(hazard);
+	}
+
+	return cost;
+}
@@ -0,0 +1,75 @@
+
+#ifndef REGEX_ANALYSIS_H_
+#define REGEX_ANALYSIS_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Regex;
+
+/* A construct that lets the matcher try the same text in many ways. */
+struct RegexHazard {
+	enum class Kind {
+		NestedQuantifier,       // A repetition inside another one, both able to match the same text.
+		OverlappingAlternation, // Alternatives of a repeated choice that can match the same text.
+		AdjacentQuantifiers     // Repetitions in sequence that can split the same text between them.
+	};
+
+	Kind        kind;
+	std::string description;
+};
+
+/* Static estimate of the worst case work of a search, see RegexAnalysis. */
+struct RegexCost {
+	RegexCost() : analysed(false), exponential(false), degree(0), lineBounded(false), states(0) {
+	}
+
+	/**
+	 * @brief StepsPerByte - Rough worst case matcher steps per byte of text searched.
+	 * @param n - Length of the text searched, of its longest line if 'lineBounded'.
+	 * @return the estimate, HUGE_VAL for an exponential expression past a few dozen bytes.
+	 */
+	double StepsPerByte(size_t n) const;
+
+	bool   analysed;    // False if the program was too large or complex to analyse, nothing else is set then.
+	bool   exponential; // Some inputs take time exponential in their length.
+	int    degree;      // Otherwise the steps per byte grow as n^degree, n being the length of the text.
+	bool   lineBounded; // The text shared by the repetitions behind 'degree' can't span lines, n is a line's length.
+	size_t states;      // Character matching states in the program.
+
+	std::vector<RegexHazard> hazards;
+};
+
+/* Works out from a compiled program how badly the backtracking matcher can
+   behave on it, before it ever sees any text. The program is read as an NFA
+   of its character matching nodes; the matcher retries a position once per
+   path the NFA has to it, so the cost follows from the NFA's ambiguity:
+
+     - two different loops back to the same state that read the same text,
+       as in (a+)+ or (a|a)*, double the paths with every repetition and make
+       the search exponential,
+     - a chain of k loops one after the other that can all read the same
+       text, as in \w*\w*\w*x, gives n^k paths per position.
+
+   Atomic groups and possessive quantifiers never give back what they
+   matched and only count once, as do alternations of literal words, such
+   as keyword lists, so that those stay well under MaxStates. Anchors,
+   counters and back-references are taken at their most permissive, so the
+   estimate errs on the side of cost.
+   Look-around bodies are analysed as expressions of their own. */
+class RegexAnalysis {
+public:
+	// Programs with more character matching states than this are not analysed.
+	static const size_t MaxStates = 256;
+
+public:
+	/**
+	 * @brief Cost - Analyses a compiled expression.
+	 * @param regex - Compiled expression.
+	 * @return the estimated cost and the constructs responsible for it.
+	 */
+	static RegexCost Cost(const Regex &regex);
+};
+
+#endif
@@ -0,0 +1,121 @@
+
+#include "RegexCache.h"
+#include "Regex.h"
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace {
+
+typedef std::pair<std::string, int> Key;
+typedef std::pair<Key, std::shared_ptr<const Regex>> Entry;
+
+/* Entries are kept in most recently used order, the map points into the
+   list so that lookups and promotions are O(log n). */
+struct Cache {
+	std::mutex                                   mutex;
+	std::list<Entry>                             entries;
+	std::map<Key, std::list<Entry>::iterator>    index;
+	size_t                                       capacity = RegexCache::DefaultCapacity;
+};
+
+Cache &cache() {
+	static Cache instance;
+	return instance;
+}
+
+//------------------------------------------------------------------------------
+// Name: trim
+// Desc: drops least recently used entries until the cache fits its capacity.
+//       Caller must hold the mutex.
+//------------------------------------------------------------------------------
+void trim(Cache &c) {
+	while (c.entries.size() > c.capacity) {
+		c.index.erase(c.entries.back().first);
+		c.entries.pop_back();
+	}
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Name: Compile
+//------------------------------------------------------------------------------
+std::shared_ptr<const Regex> RegexCache::Compile(const char *exp, int defaultFlags) {
+
+	if (!exp) {
+		throw RegexException("NULL argument, 'RegexCache::Compile'");
+	}
+
+	Cache &c = cache();
+	Key key(exp, defaultFlags);
+
+	{
+		std::lock_guard<std::mutex> lock(c.mutex);
+
+		auto it = c.index.find(key);
+		if (it != c.index.end()) {
+			c.entries.splice(c.entries.begin(), c.entries, it->second);
+			return it->second->second;
+		}
+	}
+
+	/* Compile outside of the lock, a slow compile shouldn't stall lookups of
+	   other expressions. If another thread raced us here, keep its result so
+	   that everybody shares the same instance. */
+	std::shared_ptr<const Regex> regex = std::make_shared<const Regex>(exp, defaultFlags);
+
+	std::lock_guard<std::mutex> lock(c.mutex);
+
+	auto it = c.index.find(key);
+	if (it != c.index.end()) {
+		c.entries.splice(c.entries.begin(), c.entries, it->second);
+		return it->second->second;
+	}
+
+	c.entries.emplace_front(key, regex);
+	c.index.insert(std::make_pair(key, c.entries.begin()));
+	trim(c);
+
+	return regex;
+}
+
+//------------------------------------------------------------------------------
+// Name: SetCapacity
+//------------------------------------------------------------------------------
+void RegexCache::SetCapacity(size_t capacity) {
+	Cache &c = cache();
+	std::lock_guard<std::mutex> lock(c.mutex);
+	c.capacity = capacity;
+	trim(c);
+}
+
+//------------------------------------------------------------------------------
+// Name: Capacity
+//------------------------------------------------------------------------------
+size_t RegexCache::Capacity() {
+	Cache &c = cache();
+	std::lock_guard<std::mutex> lock(c.mutex);
+	return c.capacity;
+}
+
+//------------------------------------------------------------------------------
+// Name: Size
+//------------------------------------------------------------------------------
+size_t RegexCache::Size() {
+	Cache &c = cache();
+	std::lock_guard<std::mutex> lock(c.mutex);
+	return c.entries.size();
+}
+
+//------------------------------------------------------------------------------
+// Name: Clear
+//------------------------------------------------------------------------------
+void RegexCache::Clear() {
+	Cache &c = cache();
+	std::lock_guard<std::mutex> lock(c.mutex);
+	c.index.clear();
+	c.entries.clear();
+}
@@ -0,0 +1,36 @@
+
+#ifndef REGEX_CACHE_H_
+#define REGEX_CACHE_H_
+
+#include <cstddef>
+#include <memory>
+
+class Regex;
+
+/* Process wide cache of compiled expressions, keyed by the expression text
+   and the default flags it was compiled with. Compiled programs are never
+   modified by 'ExecRE', so one instance can be shared by every highlighter
+   and search that uses the same expression, on any thread. The cache holds
+   at most 'Capacity()' entries and evicts the least recently used one;
+   evicted programs stay alive as long as someone still references them. */
+class RegexCache {
+public:
+	static const size_t DefaultCapacity = 1024;
+
+public:
+	/**
+	 * @brief Compile - Returns the compiled form of 'exp', compiling it on first use.
+	 * @param exp - String containing the regex specification.
+	 * @param defaultFlags - Flags for default RE-operation
+	 * @return shared, immutable compiled expression. Throws RegexException on error,
+	 *         failures are not cached.
+	 */
+	static std::shared_ptr<const Regex> Compile(const char *exp, int defaultFlags);
+
+	static void   SetCapacity(size_t capacity);
+	static size_t Capacity();
+	static size_t Size();
+	static void   Clear();
+};
+
+#endif
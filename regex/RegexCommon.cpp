@@ -2,66 +2,130 @@
 #include "RegexCommon.h"
 #include "RegexOpcodes.h"
 #include "Regex.h"
+#include <algorithm>
+#include <cctype>
 
-/* Address of this used as flag. */
-prog_type Compute_Size;
+namespace {
 
-/*----------------------------------------------------------------------*
- * next_ptr - compute the address of a node's "NEXT" pointer.
- * Note: a simplified inline version is available via the NEXT_PTR() macro,
- *       but that one is only to be used at time-critical places (see the
- *       description of the macro).
- *----------------------------------------------------------------------*/
-prog_type *next_ptr(prog_type *ptr) {
+/* Class operands (see Regex::ClassSize) equivalent to the shortcut escapes
+   and '.', so that greedy runs of them share the class scanning code. Like
+   the class tables the compiler uses, they follow the locale in effect when
+   they are first needed. */
+struct ShortcutClasses {
+	prog_type any[Regex::ClassSize];
+	prog_type every[Regex::ClassSize];
+	prog_type digit[Regex::ClassSize];
+	prog_type notDigit[Regex::ClassSize];
+	prog_type letter[Regex::ClassSize];
+	prog_type notLetter[Regex::ClassSize];
+	prog_type space[Regex::ClassSize];
+	prog_type spaceNL[Regex::ClassSize];
+	prog_type notSpace[Regex::ClassSize];
+	prog_type notSpaceNL[Regex::ClassSize];
+	prog_type wordChar[Regex::ClassSize];
+	prog_type notWordChar[Regex::ClassSize];
 
-	if (ptr == &Compute_Size) {
-		return nullptr;
+	ShortcutClasses() {
+		build(any,         [](int c) { return c != '\n'; });
+		build(every,       [](int)   { return true; });
+		build(digit,       [](int c) { return isdigit(c) != 0; });
+		build(notDigit,    [](int c) { return !isdigit(c) && c != '\n'; });
+		build(letter,      [](int c) { return isalpha(c) != 0; });
+		build(notLetter,   [](int c) { return !isalpha(c) && c != '\n'; });
+		build(space,       [](int c) { return isspace(c) && c != '\n'; });
+		build(spaceNL,     [](int c) { return isspace(c) != 0; });
+		build(notSpace,    [](int c) { return !isspace(c); });
+		build(notSpaceNL,  [](int c) { return !isspace(c) || c == '\n'; });
+		build(wordChar,    [](int c) { return isalnum(c) || c == '_'; });
+		build(notWordChar, [](int c) { return !isalnum(c) && c != '_' && c != '\n'; });
 	}
 
-	const size_t offset = getOffset(ptr);
-
-	if (offset == 0) {
-		return nullptr;
+	template <class Pred>
+	static void build(prog_type *operand, Pred pred) {
+		bool members[UCHAR_MAX + 1];
+		for (int c = 0; c <= UCHAR_MAX; c++) {
+			members[c] = pred(static_cast<char>(c));
+		}
+		makeClassOperand(operand, members);
 	}
+};
 
-	if (getOpcode(ptr) == BACK) {
-		return (ptr - offset);
-	} else {
-		return (ptr + offset);
+/* tolower() of every character, so that case insensitive matching costs a
+   table lookup instead of a library call per character. Follows the locale
+   in effect when it is first needed, like the classes above. */
+struct CaseFold {
+	char lower[UCHAR_MAX + 1];
+
+	CaseFold() {
+		for (int c = 0; c <= UCHAR_MAX; c++) {
+			lower[c] = static_cast<char>(tolower(static_cast<char>(c)));
+		}
 	}
-}
+};
 
-//------------------------------------------------------------------------------
-// Name: 
-//------------------------------------------------------------------------------
-prog_type getOpcode(const prog_type *p) {
-	return *p;
 }
 
 //------------------------------------------------------------------------------
-// Name: 
+// Name: makeClassOperand
+// Desc: Builds an ANY_OF/ANY_BUT operand (see Regex::ClassSize) from a 256
+//       entry membership table. '\0' terminates every run and is never made
+//       a member.
 //------------------------------------------------------------------------------
-prog_type *getOperand(prog_type *p) {
-	return p + Regex::NodeSize;
-}
+void makeClassOperand(prog_type *operand, const bool *members) {
 
-//------------------------------------------------------------------------------
-// Name: 
-//------------------------------------------------------------------------------
-size_t getOffset(prog_type *p) {
-	return ((p[1] & 0xff) << 8) + (p[2] & 0xff);
+	prog_type *stops = operand + Regex::ClassBitmapSize;
+	int nStops = 1;
+
+	std::fill_n(operand, Regex::ClassSize, 0);
+	stops[1] = '\0';
+
+	for (int c = 1; c <= UCHAR_MAX; c++) {
+		if (members[c]) {
+			operand[c >> 5] |= static_cast<prog_type>(1u << (c & 0x1f));
+		} else {
+			if (nStops < Regex::ClassStopSize) {
+				stops[1 + nStops] = static_cast<prog_type>(c);
+			}
+			nStops++;
+		}
+	}
+
+	stops[0] = (nStops <= Regex::ClassStopSize) ? static_cast<prog_type>(nStops) : 0;
 }
 
 //------------------------------------------------------------------------------
-// Name: 
+// Name: shortcutClass
+// Desc: returns the class operand equivalent to a shortcut node, nullptr if
+//       there is none.
 //------------------------------------------------------------------------------
-prog_type putOffsetL(ptrdiff_t v) {
-	return static_cast<prog_type>((v >> 8) & 0xff);
+const prog_type *shortcutClass(prog_type op) {
+
+	static const ShortcutClasses classes;
+
+	switch (op) {
+	case ANY:           return classes.any;
+	case EVERY:         return classes.every;
+	case DIGIT:         return classes.digit;
+	case NOT_DIGIT:     return classes.notDigit;
+	case LETTER:        return classes.letter;
+	case NOT_LETTER:    return classes.notLetter;
+	case SPACE:         return classes.space;
+	case SPACE_NL:      return classes.spaceNL;
+	case NOT_SPACE:     return classes.notSpace;
+	case NOT_SPACE_NL:  return classes.notSpaceNL;
+	case WORD_CHAR:     return classes.wordChar;
+	case NOT_WORD_CHAR: return classes.notWordChar;
+	default:
+		return nullptr;
+	}
 }
 
 //------------------------------------------------------------------------------
-// Name: 
+// Name: caseFoldTable
+// Desc: returns tolower() of every character, indexed by the character as an
+//       unsigned char.
 //------------------------------------------------------------------------------
-prog_type putOffsetR(ptrdiff_t v) {
-	return static_cast<prog_type>(v & 0xff);
+const char *caseFoldTable() {
+	static const CaseFold fold;
+	return fold.lower;
 }
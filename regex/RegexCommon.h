@@ -13,17 +13,42 @@
 #define REG_ZERO     0UL
 #define REG_ONE      1UL
 
-typedef uint16_t prog_type;
-
-/* Address of this used as flag. */
-extern prog_type Compute_Size;
-
-prog_type *getOperand(prog_type *p);
-prog_type *next_ptr(prog_type *ptr);
-prog_type  getOpcode(const prog_type *p);
-prog_type  putOffsetL(ptrdiff_t v);
-prog_type  putOffsetR(ptrdiff_t v);
-size_t     getOffset(prog_type *p);
+typedef uint32_t prog_type;
+
+void       makeClassOperand(prog_type *operand, const bool *members);
+const prog_type *shortcutClass(prog_type op);
+const char *caseFoldTable();
+
+/* The program is a sequence of 32-bit units, see Regex.h for the node layout.
+   These are called for nearly every node visited while matching, so they are
+   kept inline. */
+
+inline prog_type getOpcode(const prog_type *p) {
+	return *p;
+}
+
+/* Unsigned value stored in the unit following 'p', e.g. a {m,n} count. */
+inline size_t getOffset(const prog_type *p) {
+	return p[1];
+}
+
+inline prog_type putOffset(ptrdiff_t v) {
+	return static_cast<prog_type>(v);
+}
+
+/* Address of the node a node's NEXT offset leads to, NULL at the end of a
+   chain. The offset is signed, BACK nodes lead backwards. */
+inline prog_type *next_ptr(prog_type *ptr) {
+	const int32_t offset = static_cast<int32_t>(ptr[1]);
+	return offset ? ptr + offset : nullptr;
+}
+
+/* Tests a character against the bitmap of an ANY_OF/ANY_BUT operand. '\0' is
+   never a member. */
+inline bool classMember(const prog_type *operand, char c) {
+	const unsigned char uc = static_cast<unsigned char>(c);
+	return (operand[uc >> 5] >> (uc & 0x1f)) & 1;
+}
 
 
 #endif
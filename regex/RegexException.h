@@ -2,6 +2,8 @@
 #ifndef REGEX_EXCEPTION_H_
 #define REGEX_EXCEPTION_H_
 
+#include <cstdarg>
+#include <cstdio>
 #include <stdexcept>
 
 class RegexException : public std::exception {
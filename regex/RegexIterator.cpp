@@ -0,0 +1,92 @@
+
+#include "RegexIterator.h"
+#include "Regex.h"
+
+//------------------------------------------------------------------------------
+// Name: RegexIterator
+//------------------------------------------------------------------------------
+RegexIterator::RegexIterator(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap) : regex_(regex), match_(new RegexMatch(&regex)), next_(string), end_(end), prevChar_(prev_char), succChar_(succ_char), delimiters_(delimiters), lookBehindTo_(look_behind_to ? look_behind_to : string), matchTill_(match_till), gap_(), hasGap_(gap && gap->start != gap->end) {
+
+	if (hasGap_) {
+		gap_ = *gap;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: ~RegexIterator
+//------------------------------------------------------------------------------
+RegexIterator::~RegexIterator() {
+}
+
+//------------------------------------------------------------------------------
+// Name: Next
+// Desc: Searches from where the previous match ended. The character before
+//       the new start is real text from then on, as the range never starts in
+//       the middle of a match.
+//------------------------------------------------------------------------------
+bool RegexIterator::Next() {
+
+	if (!next_) {
+		return false;
+	}
+
+	const bool found = match_->ExecRE(next_, end_, Direction::Forward, prevChar_, succChar_, delimiters_, lookBehindTo_, matchTill_, hasGap_ ? &gap_ : nullptr, nullptr);
+
+	regex_.reportMemoization(match_.get());
+	regex_.reportProfile(match_.get());
+
+	const char *const start = match_->startp_[0];
+	const char *const stop  = match_->endp_[0];
+
+	// An anchored search may report a match that begins right at the end of the range.
+	if (!found || (end_ && start >= end_)) {
+		next_ = nullptr;
+		return false;
+	}
+
+	if (stop != start) {
+		next_     = stop;
+		prevChar_ = (hasGap_ && stop == gap_.end) ? gap_.start[-1] : stop[-1];
+	} else if (stop == end_ || stop == matchTill_ || *stop == '\0') {
+		// An empty match at the end of the text, nothing can follow it.
+		next_ = nullptr;
+	} else {
+		// Don't find the same empty match again.
+		prevChar_ = *stop;
+		next_     = (hasGap_ && stop + 1 == gap_.start) ? gap_.end : stop + 1;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: Match
+//------------------------------------------------------------------------------
+const RegexMatch &RegexIterator::Match() const {
+	return *match_;
+}
+
+//------------------------------------------------------------------------------
+// Name: SetRecordCaptures
+//------------------------------------------------------------------------------
+void RegexIterator::SetRecordCaptures(bool record) {
+	// Back-references read the captures while matching.
+	match_->captures_ = record || regex_.Has_Back_Refs;
+}
+
+//------------------------------------------------------------------------------
+// Name: Count
+//------------------------------------------------------------------------------
+size_t RegexIterator::Count(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap) {
+
+	RegexIterator it(regex, string, end, prev_char, succ_char, delimiters, look_behind_to, match_till, gap);
+
+	it.SetRecordCaptures(false);
+
+	size_t count = 0;
+	while (it.Next()) {
+		++count;
+	}
+
+	return count;
+}
@@ -0,0 +1,70 @@
+
+#ifndef REGEX_ITERATOR_H_
+#define REGEX_ITERATOR_H_
+
+#include "RegexMatch.h"
+#include <cstddef>
+#include <memory>
+
+class Regex;
+
+/* Streams the non-overlapping matches of an expression over a range of text,
+   front to back, as a "find all" or "highlight all" would. The character
+   before each search and the look-behind boundary are carried forward from
+   the previous match, so every match is found exactly as a single search
+   starting at the beginning of the range would find it. An empty match moves
+   the next search on by one character. One match object is reused for the
+   whole range instead of being allocated per match. */
+class RegexIterator {
+public:
+	/**
+	 * @brief RegexIterator - Prepares to search 'regex' over a range, see Regex::ExecRE for the parameters.
+	 * The expression and the text must outlive the iterator.
+	 */
+	RegexIterator(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char,
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap = nullptr);
+	~RegexIterator();
+
+private:
+	RegexIterator(const RegexIterator &) = delete;
+	RegexIterator &operator=(const RegexIterator &) = delete;
+
+public:
+	/**
+	 * @brief Next - Finds the next match.
+	 * @return false once the range holds no more matches.
+	 */
+	bool Next();
+
+	/* The current match, valid after 'Next' returned true and until it is
+	   called again. */
+	const RegexMatch &Match() const;
+
+	/* Capturing parentheses are recorded by default. Callers that only want
+	   the extent of each match can switch that off, which is considerably
+	   cheaper. Expressions with back-references always record them. */
+	void SetRecordCaptures(bool record);
+
+public:
+	/**
+	 * @brief Count - Counts the non-overlapping matches over a range, see Regex::ExecRE for the parameters.
+	 * Capturing parentheses are not recorded, see 'SetRecordCaptures'.
+	 */
+	static size_t Count(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char,
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap = nullptr);
+
+private:
+	const Regex &               regex_;
+	std::unique_ptr<RegexMatch> match_;
+	const char *                next_;         // Where the next search starts, NULL once done.
+	const char *                end_;
+	char                        prevChar_;     // Character before 'next_'.
+	char                        succChar_;
+	const char *                delimiters_;
+	const char *                lookBehindTo_;
+	const char *                matchTill_;
+	TextGap                     gap_;
+	bool                        hasGap_;
+};
+
+#endif
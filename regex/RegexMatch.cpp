@@ -4,7 +4,15 @@
 #include "RegexCommon.h"
 #include "Regex.h"
 #include <QtDebug>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGEX_HAVE_SSE2
+#endif
 
 #define MATCH_RETURN(X)           \
 	{                             \
@@ -16,28 +24,44 @@
 	if (Recursion_Limit_Exceeded) \
 		MATCH_RETURN(false);
 
-/* The next_ptr () function can consume up to 30% of the time during matching
-   because it is called an immense number of times (an average of 25
-   next_ptr() calls per match() call was witnessed for Perl syntax
-   highlighting). Therefore it is well worth removing some of the function
-   call overhead by selectively inlining the next_ptr() calls. Moreover,
-   the inlined code can be simplified for matching because one of the tests,
-   only necessary during compilation, can be left out.
-   The net result of using this inlined version at two critical places is
-   a 25% speedup (again, witnesses on Perl syntax highlighting). */
-#define NEXT_PTR(in_ptr, out_ptr)                         \
-	do {                                                  \
-		const size_t next_ptr_offset = getOffset(in_ptr); \
-		if (next_ptr_offset == 0) {                       \
-			out_ptr = nullptr;                            \
-		} else {                                          \
-			if (getOpcode(in_ptr) == BACK) {              \
-				out_ptr = in_ptr - next_ptr_offset;       \
-			} else {                                      \
-				out_ptr = in_ptr + next_ptr_offset;       \
-			}                                             \
-		}                                                 \
+/* Counting for RegexProfile, compiled out unless REGEX_PROFILE is defined.
+   Parentheses of all numbers are counted as one OPEN and one CLOSE. */
+#ifdef REGEX_PROFILE
+#define PROFILE(X) X
+#define PROFILE_NODE(p) (++profile_.nodes[getOpcode(p) < OPEN ? getOpcode(p) : getOpcode(p) < CLOSE ? OPEN : OPEN + 1])
+#else
+#define PROFILE(X)
+#define PROFILE_NODE(p)
+#endif
+
+/* Dispatch from one node of the matching loop straight to the code of the
+   next with a computed goto where the compiler supports it, giving every
+   opcode its own indirect jump to predict instead of the single one of the
+   switch. Nodes that carry on with 'next' finish with DISPATCH() instead of
+   'break' (never from inside a loop of their own). */
+#if defined(__GNUC__)
+#define REGEX_COMPUTED_GOTO
+#endif
+
+#ifdef REGEX_COMPUTED_GOTO
+#define DISPATCH_INDEX(p) (getOpcode(p) < OPEN ? getOpcode(p) : 0)
+#define TARGET(op) case op: target_##op
+#define TARGET_DEFAULT default: target_default
+#define DISPATCH()                                  \
+	do {                                            \
+		scan = next;                                \
+		if (scan == nullptr) {                      \
+			goto dispatch_done;                     \
+		}                                           \
+		next = next_ptr(scan);                      \
+		PROFILE_NODE(scan);                         \
+		goto *dispatch_table[DISPATCH_INDEX(scan)]; \
 	} while(0)
+#else
+#define TARGET(op) case op
+#define TARGET_DEFAULT default
+#define DISPATCH() break
+#endif
 
 
 namespace {
@@ -53,18 +77,50 @@ namespace {
  */
 const int RegexRecursionLimit = 10000;
 
+/* Number of match() steps a single attempt may take before 'Auto'
+   memoization kicks in. Well behaved patterns stay far below this even on
+   long lines; catastrophic ones blow through it within a few dozen
+   characters. */
+const unsigned long MemoTriggerSteps = 50000;
+
+/* Number of match() steps between looks at the clock and the cancel flag of
+   an execution budget. */
+const unsigned long BudgetCheckInterval = 1024;
+
+/* Upper bound on the size of the memoization bitset (4 MB). Input windows
+   that would need more are covered piecewise, following the attempts. */
+const size_t MemoMaxBits = size_t(1) << 25;
+
+#ifdef REGEX_PROFILE
+/* Counts a search and the time it took. */
+class SearchTimer {
+public:
+	explicit SearchTimer(RegexProfile *profile) : profile_(profile), start_(std::chrono::steady_clock::now()) {
+		++profile_->searches;
+	}
+
+	~SearchTimer() {
+		profile_->nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+	}
+
+private:
+	RegexProfile *                        profile_;
+	std::chrono::steady_clock::time_point start_;
+};
+#endif
+
 //------------------------------------------------------------------------------
 // Name: get_lower
 //------------------------------------------------------------------------------
 int get_lower(prog_type *p) {
-	return ((p[Regex::NodeSize] & 0xff) << 8) + (p[Regex::NodeSize + 1] & 0xff);
+	return static_cast<int>(p[Regex::NodeSize]);
 }
 
 //------------------------------------------------------------------------------
 // Name: get_upper
 //------------------------------------------------------------------------------
 int get_upper(prog_type *p) {
-	return ((p[Regex::NodeSize + 2] & 0xff) << 8) + (p[Regex::NodeSize + 3] & 0xff);
+	return static_cast<int>(p[Regex::NodeSize + 1]);
 }
 
 //------------------------------------------------------------------------------
@@ -98,23 +154,6 @@ int string_compare(const prog_type *s1, const char *s2, size_t n) {
 	return ret;
 }
 
-//------------------------------------------------------------------------------
-// Name: find_character
-//------------------------------------------------------------------------------
-const prog_type *find_character(const prog_type *s, char c) {
-	const prog_type cmp = c;
-
-	assert(s);
-
-	while(*s != '\0') {
-		if(*s == cmp) {
-			return s;
-		}
-		++s;
-	}
-	return nullptr;
-}
-
 //------------------------------------------------------------------------------
 // Name: makeDelimiterTable
 // Desc: Translate a null-terminated string of delimiters into a 256 byte
@@ -302,12 +341,84 @@ void adjust_case(char *str, size_t len, char chgcase) {
 
 }
 
+//------------------------------------------------------------------------------
+// Name: advance
+// Desc: the position after 'p'. The gap is at least one byte long, so only
+//       stepping onto its first byte has to be redirected.
+//------------------------------------------------------------------------------
+inline const char *RegexMatch::advance(const char *p) const {
+	++p;
+	return (p == gapStart_) ? gapEnd_ : p;
+}
+
+//------------------------------------------------------------------------------
+// Name: advance
+// Desc: the position 'n' characters after 'p'.
+//------------------------------------------------------------------------------
+inline const char *RegexMatch::advance(const char *p, size_t n) const {
+	const char *q = p + n;
+
+	if (gapStart_ && p < gapStart_ && q >= gapStart_) {
+		q += (gapEnd_ - gapStart_);
+	}
+
+	return q;
+}
+
+//------------------------------------------------------------------------------
+// Name: retreat
+// Desc: the position before 'p'.
+//------------------------------------------------------------------------------
+inline const char *RegexMatch::retreat(const char *p) const {
+	return (p == gapEnd_ && gapStart_) ? gapStart_ - 1 : p - 1;
+}
+
+//------------------------------------------------------------------------------
+// Name: retreat
+// Desc: the position 'n' characters before 'p'.
+//------------------------------------------------------------------------------
+inline const char *RegexMatch::retreat(const char *p, size_t n) const {
+	const char *q = p - n;
+
+	if (gapStart_ && p >= gapEnd_ && q < gapEnd_) {
+		q -= (gapEnd_ - gapStart_);
+	}
+
+	return q;
+}
+
+//------------------------------------------------------------------------------
+// Name: distance
+// Desc: the number of characters from 'from' up to 'to'.
+//------------------------------------------------------------------------------
+inline size_t RegexMatch::distance(const char *from, const char *to) const {
+	size_t n = to - from;
+
+	if (gapStart_ && from < gapStart_ && to >= gapEnd_) {
+		n -= (gapEnd_ - gapStart_);
+	}
+
+	return n;
+}
+
+//------------------------------------------------------------------------------
+// Name: skipTo
+// Desc: Returns 'to', where a search skipped ahead to from 'from' as no match
+//       can start in between, counting the skipped positions for profiling.
+//------------------------------------------------------------------------------
+inline const char *RegexMatch::skipTo(const char *from, const char *to) {
+#ifdef REGEX_PROFILE
+	profile_.prefilterSkips += distance(from, to);
+#else
+	(void)from;
+#endif
+	return to;
+}
+
 //------------------------------------------------------------------------------
 // Name: RegexMatch
 //------------------------------------------------------------------------------
-RegexMatch::RegexMatch(Regex *regex) : regex_(regex), recursion_count_(0), extentpBW_(nullptr), extentpFW_(nullptr), top_branch_(0), Recursion_Limit_Exceeded(false), Current_Delimiters(nullptr), Total_Paren(0), Num_Braces(0) {
-	std::fill_n(startp_, NSUBEXP, nullptr);
-	std::fill_n(endp_,   NSUBEXP, nullptr);
+RegexMatch::RegexMatch(const Regex *regex) : regex_(regex), gapStart_(nullptr), gapEnd_(nullptr), recursion_count_(0), extentpBW_(nullptr), extentpFW_(nullptr), top_branch_(0), Recursion_Limit_Exceeded(false), captures_(true), memoWindowStart_(nullptr), memoWindowEnd_(nullptr), memoBase_(nullptr), memoSpan_(0), memoProgSize_(0), steps_(0), lookBehindDepth_(0), memoMode_(Memoization::Off), memoActive_(false), memoTriggered_(false), budget_(nullptr), budgetSteps_(0), budgetExceeded_(false), attemptStart_(nullptr), Current_Delimiters(nullptr), caseFold_(caseFoldTable()), Total_Paren(0), Num_Braces(0) {
 	
 	// Check validity of program.
 	if (regex_->program_[0] != Regex::MAGIC) {
@@ -317,19 +428,35 @@ RegexMatch::RegexMatch(Regex *regex) : regex_(regex), recursion_count_(0), exten
 	Total_Paren = regex_->program_[1];
 	Num_Braces  = regex_->program_[2];
 
-	// Allocate memory for {m,n} construct counting variables if need be.
-	if (Num_Braces > 0) {
-		brace_counts_ = new uint32_t[Num_Braces];
-	} else {
-		brace_counts_ = nullptr;
-	}	
+	/* Size the capture storage from the program: the whole match plus its
+	  groups, and back-reference pointers only if it uses them. */
+	const size_t nCaptures = Total_Paren + 1;
+	numBackRefs_ = regex_->Has_Back_Refs ? std::min(nCaptures, static_cast<size_t>(MaxBackRefs)) : 0;
+
+	const size_t nSlots = 2 * (nCaptures + numBackRefs_);
+	slots_ = (nSlots <= InlineSlots) ? inlineSlots_ : new const char *[nSlots];
+	std::fill_n(slots_, nSlots, nullptr);
+
+	startp_        = slots_;
+	endp_          = startp_ + nCaptures;
+	Back_Ref_Start = endp_ + nCaptures;
+	Back_Ref_End   = Back_Ref_Start + numBackRefs_;
+
+	// Memory for {m,n} construct counting variables if need be.
+	brace_counts_ = (Num_Braces <= InlineBraceCounts) ? inlineBraceCounts_ : new uint32_t[Num_Braces];
 }
 
 //------------------------------------------------------------------------------
 // Name: ~RegexMatch
 //------------------------------------------------------------------------------
 RegexMatch::~RegexMatch() {
-	delete [] brace_counts_;
+	if (slots_ != inlineSlots_) {
+		delete [] slots_;
+	}
+
+	if (brace_counts_ != inlineBraceCounts_) {
+		delete [] brace_counts_;
+	}
 }
 
 //------------------------------------------------------------------------------
@@ -355,20 +482,47 @@ RegexMatch::~RegexMatch() {
 //           past that boundary. If match_to is set to NULL, the terminating \0 is
 //           assumed to correspond to the logical boundary. Match_to, if set, must be
 //           larger than or equal to end, if set.
+//           If 'gap' is non-NULL the text continues at gap->end after reaching
+//           gap->start, see 'TextGap'.
 //------------------------------------------------------------------------------
-bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_to) {
+bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_to, const TextGap *gap, const ExecBudget *budget) {
 
 	bool ret_val = false;
 
+#ifdef REGEX_PROFILE
+	profile_ = RegexProfile();
+	SearchTimer timer(&profile_);
+#endif
+
 	try {
 		// Check for valid parameters.
 		if (!string) {
 			throw RegexException("NULL parameter to 'ExecRE'");
 		}
 
+		// A match may be reused for several searches.
+		Recursion_Limit_Exceeded = false;
+
+		// A budget without limits needs no bookkeeping.
+		budget_         = (budget && (budget->steps != 0 || budget->milliseconds != 0 || budget->cancel)) ? budget : nullptr;
+		budgetSteps_    = 0;
+		budgetExceeded_ = false;
+		attemptStart_   = string;
+
+		if (budget_ && budget_->milliseconds != 0) {
+			deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_->milliseconds);
+		}
+
+		// An empty gap needs no special treatment.
+		if (gap && gap->start != gap->end) {
+			gapStart_ = gap->start;
+			gapEnd_   = gap->end;
+		} else {
+			gapStart_ = nullptr;
+			gapEnd_   = nullptr;
+		}
+
 		const char *str;		
-		const char **s_ptr = startp_;
-		const char **e_ptr = endp_;
 
 		// If caller has supplied delimiters, make a delimiter table
 		bool tempDelimitTable[256];
@@ -382,7 +536,7 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 		endOfString = match_to;
 
 		if (end == nullptr && direction == Direction::Backward) {
-			for (end = string; !atEndOfString(end); end++) {
+			for (end = string; !atEndOfString(end); end = advance(end)) {
 			}
 			succ_char = '\n';
 		} else if (end == nullptr) {
@@ -398,14 +552,16 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 		succIsDelim   = Current_Delimiters[static_cast<int>(succ_char)];
 
 
-		/* Initialize the first nine (9) capturing parentheses start and end
-		  pointers to point to the start of the search string.  This is to prevent
-		  crashes when later trying to reference captured parens that do not exist
-		  in the compiled regex.  We only need to do the first nine since users
-		  can only specify \1, \2, ... \9. */
-		for (int i = 9; i > 0; i--) {
-			*s_ptr++ = string;
-			*e_ptr++ = string;
+		/* Back-references and {m,n} counters make the outcome of a node
+		  depend on more than the input position, so such programs can't be
+		  memoized. */
+		memoMode_        = (regex_->Has_Back_Refs || Num_Braces != 0) ? Memoization::Off : regex_->memoMode_.load();
+		memoActive_      = false;
+		memoWindowStart_ = lookBehindTo;
+		memoWindowEnd_   = endOfString;
+
+		if (memoMode_ == Memoization::Always) {
+			enableMemo(direction == Direction::Forward ? string : end);
 		}
 		
 		switch(direction) {
@@ -418,13 +574,12 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 					goto SINGLE_RETURN;
 				}
 
-				for (str = string; !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str++) {
+				// Jump from line start to line start.
+				for (str = skipTo(string, findChar(string, end, '\n')); !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str = skipTo(advance(str), findChar(advance(str), end, '\n'))) {
 
-					if (*str == '\n') {
-						if (attempt(str + 1)) {
-							ret_val = true;
-							break;
-						}
+					if (attempt(advance(str))) {
+						ret_val = true;
+						break;
 					}
 				}
 
@@ -432,14 +587,13 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 
 			} else if (regex_->match_start_ != '\0') {
 				// We know what char match must start with.
+				const char start_char = static_cast<char>(regex_->match_start_);
 
-				for (str = string; !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str++) {
+				for (str = skipTo(string, findChar(string, end, start_char)); !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str = skipTo(advance(str), findChar(advance(str), end, start_char))) {
 
-					if (*str == regex_->match_start_) {
-						if (attempt(str)) {
-							ret_val = true;
-							break;
-						}
+					if (attempt(str)) {
+						ret_val = true;
+						break;
 					}
 				}
 
@@ -447,11 +601,21 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 			} else {
 				// General case
 
-				for (str = string; !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str++) {
+				if (regex_->has_first_chars_) {
+					for (str = skipTo(string, findFirstChar(string, end)); !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str = skipTo(advance(str), findFirstChar(advance(str), end))) {
 
-					if (attempt(str)) {
-						ret_val = true;
-						break;
+						if (attempt(str)) {
+							ret_val = true;
+							break;
+						}
+					}
+				} else {
+					for (str = string; !atEndOfString(str) && str != end && !Recursion_Limit_Exceeded; str = advance(str)) {
+
+						if (attempt(str)) {
+							ret_val = true;
+							break;
+						}
 					}
 				}
 
@@ -474,13 +638,11 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 			if (regex_->anchor_) {
 				// Search is anchored at BOL
 
-				for (str = (end - 1); str >= string && !Recursion_Limit_Exceeded; str--) {
+				for (str = findCharBackward(retreat(end), string, '\n'); str && !Recursion_Limit_Exceeded; str = findCharBackward(retreat(str), string, '\n')) {
 
-					if (*str == '\n') {
-						if (attempt(str + 1)) {
-							ret_val = true;
-							goto SINGLE_RETURN;
-						}
+					if (attempt(advance(str))) {
+						ret_val = true;
+						goto SINGLE_RETURN;
 					}
 				}
 
@@ -493,13 +655,15 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 			} else if (regex_->match_start_ != '\0') {
 				// We know what char match must start with.
 
-				for (str = end; str >= string && !Recursion_Limit_Exceeded; str--) {
+				for (str = end; str >= string && !Recursion_Limit_Exceeded; str = retreat(str)) {
 
-					if (*str == regex_->match_start_) {
+					if (static_cast<prog_type>(*str) == regex_->match_start_) {
 						if (attempt(str)) {
 							ret_val = true;
 							break;
 						}
+					} else {
+						PROFILE(++profile_.prefilterSkips);
 					}
 				}
 
@@ -507,7 +671,12 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 			} else {
 				// General case
 
-				for (str = end; str >= string && !Recursion_Limit_Exceeded; str--) {
+				for (str = end; str >= string && !Recursion_Limit_Exceeded; str = retreat(str)) {
+
+					if (regex_->has_first_chars_ && !classMember(regex_->first_chars_, *str)) {
+						PROFILE(++profile_.prefilterSkips);
+						continue;
+					}
 
 					if (attempt(str)) {
 						ret_val = true;
@@ -538,7 +707,30 @@ bool RegexMatch::ExecRE(const char *string, const char *end, Direction direction
 **  To give the caller a chance to react to this the function returns False
 **  on any error. The substitution will still be executed.
 */
-bool RegexMatch::SubstituteRE(const char *source, char *dest, const int max) {
+bool RegexMatch::SubstituteRE(const char *source, char *dest, const int max) const {
+
+	assert(dest);
+
+	std::string result;
+	bool ok = SubstituteRE(source, &result);
+
+	if (result.size() >= static_cast<size_t>(max)) {
+		qDebug("replacing expression in 'SubstituteRE' too long; truncating");
+		ok = false;
+		result.resize(max - 1);
+	}
+
+	std::copy(result.begin(), result.end(), dest);
+	dest[result.size()] = '\0';
+
+	return ok;
+}
+
+/*
+**  SubstituteRE - Perform substitutions after a 'Regex' match, appending them
+**  to 'dest'. The string grows as needed, so the result is never shortened.
+*/
+bool RegexMatch::SubstituteRE(const char *source, std::string *dest) const {
 
 	const char *src_alias;
 	char c;
@@ -553,90 +745,89 @@ bool RegexMatch::SubstituteRE(const char *source, char *dest, const int max) {
 		return false;
 	}
 
-	const char *src = source;
-	char *dst = dest;
+	try {
+		const char *src = source;
 
-	while ((c = *src++) != '\0') {
-		char chgcase = '\0';
-		int paren_no = -1;
+		while ((c = *src++) != '\0') {
+			char chgcase = '\0';
+			int paren_no = -1;
 
-		if (c == '\\') {
-			// Process any case altering tokens, i.e \u, \U, \l, \L.
+			if (c == '\\') {
+				// Process any case altering tokens, i.e \u, \U, \l, \L.
 
-			if (*src == 'u' || *src == 'U' || *src == 'l' || *src == 'L') {
-				chgcase = *src;
-				src++;
-				c = *src++;
+				if (*src == 'u' || *src == 'U' || *src == 'l' || *src == 'L') {
+					chgcase = *src;
+					src++;
+					c = *src++;
 
-				if (c == '\0')
-					break;
+					if (c == '\0')
+						break;
+				}
 			}
-		}
 
-		if (c == '&') {
-			paren_no = 0;
-		} else if (c == '\\') {
-			/* Can not pass register variable '&src' to function 'numeric_escape'
-			so make a non-register copy that we can take the address of. */
+			if (c == '&') {
+				paren_no = 0;
+			} else if (c == '\\') {
+				/* Can not pass register variable '&src' to function 'numeric_escape'
+				so make a non-register copy that we can take the address of. */
 
-			src_alias = src;
+				src_alias = src;
 
-			if ('1' <= *src && *src <= '9') {
-				paren_no = static_cast<int>(*src++ - '0');
+				if ('1' <= *src && *src <= '9') {
+					paren_no = static_cast<int>(*src++ - '0');
 
-			} else if ((test = literal_escape(*src)) != '\0') {
-				c = test;
-				src++;
+				} else if ((test = literal_escape(*src)) != '\0') {
+					c = test;
+					src++;
 
-			} else if ((test = numeric_escape(*src, &src_alias)) != '\0') {
-				c = test;
-				src = src_alias;
-				src++;
+				} else if ((test = numeric_escape(*src, &src_alias)) != '\0') {
+					c = test;
+					src = src_alias;
+					src++;
 
-				/* NOTE: if an octal escape for zero is attempted (e.g. \000), it will be treated as a literal string. */
-			} else if (*src == '\0') {
-				/* If '\' is the last character of the replacement string, it is interpreted as a literal backslash. */
+					/* NOTE: if an octal escape for zero is attempted (e.g. \000), it will be treated as a literal string. */
+				} else if (*src == '\0') {
+					/* If '\' is the last character of the replacement string, it is interpreted as a literal backslash. */
 
-				c = '\\';
-			} else {
-				c = *src++; // Allow any escape sequence (This is
-			}               // INCONSISTENT with the 'CompileRE'
-		}                   // mind set of issuing an error!
-
-		if (paren_no < 0) { // Ordinary character.
-			if ((dst - dest) >= (max - 1)) {
-				qDebug("replacing expression in 'SubstituteRE'' too long; truncating");
-				anyWarnings = true;
-				break;
-			} else {
-				*dst++ = c;
-			}
-		} else if (startp_[paren_no] != nullptr && endp_[paren_no] != nullptr) {
+					c = '\\';
+				} else {
+					c = *src++; // Allow any escape sequence (This is
+				}               // INCONSISTENT with the 'CompileRE'
+			}                   // mind set of issuing an error!
 
-			size_t len = endp_[paren_no] - startp_[paren_no];
+			if (paren_no < 0) { // Ordinary character.
+				dest->push_back(c);
+			} else if (static_cast<size_t>(paren_no) <= Total_Paren && startp_[paren_no] != nullptr && endp_[paren_no] != nullptr) {
 
-			if ((dst + len - dest) >= max - 1) {
-				qDebug("replacing expression in 'SubstituteRE' too long; truncating");
-				anyWarnings = true;
-				len = max - (dst - dest) - 1;
-			}
+				const size_t len   = distance(startp_[paren_no], endp_[paren_no]);
+				const size_t start = dest->size();
 
-			strncpy(dst, startp_[paren_no], len);
+				// Captured text may be split by the gap.
+				size_t head = len;
+				if (gapStart_ && startp_[paren_no] < gapStart_) {
+					head = std::min(len, static_cast<size_t>(gapStart_ - startp_[paren_no]));
+				}
 
-			if (chgcase != '\0')
-				adjust_case(dst, len, chgcase);
+				dest->append(startp_[paren_no], head);
+				if (head < len) {
+					dest->append(gapEnd_, len - head);
+				}
 
-			dst += len;
+				if (chgcase != '\0')
+					adjust_case(&(*dest)[start], len, chgcase);
 
-			if (len != 0 && *(dst - 1) == '\0') { // strncpy hit NUL.
-				qDebug("damaged match string in 'SubstituteRE'");
-				anyWarnings = true;
+				if (std::find(dest->begin() + start, dest->end(), '\0') != dest->end()) {
+					qDebug("damaged match string in 'SubstituteRE'");
+					anyWarnings = true;
+					dest->resize(std::find(dest->begin() + start, dest->end(), '\0') - dest->begin());
+				}
 			}
 		}
+	} catch(const RegexException &e) {
+		qDebug("%s", e.what());
+		return false;
 	}
 
-	*dst = '\0';
-
 	return !anyWarnings;
 }
 
@@ -651,19 +842,25 @@ bool RegexMatch::attempt(const char *string) {
 	input               = string;
 	Start_Ptr_Ptr       = startp_;
 	End_Ptr_Ptr         = endp_;
-	const char **s_ptr  = startp_;
-	const char **e_ptr  = endp_;
+
+	PROFILE(++profile_.attempts);
 
 	// Reset the recursion counter.
 	recursion_count_ = 0;
+	steps_           = 0;
+	attemptStart_    = string;
+
+	if (memoActive_ && (string < memoBase_ || string >= memoBase_ + memoSpan_)) {
+		rebaseMemo(string);
+	}
 
 	// Overhead due to capturing parentheses.
 	Extent_Ptr_BW = string;
 	Extent_Ptr_FW = nullptr;
 
-	for (int i = Total_Paren + 1; i > 0; i--) {
-		*s_ptr++ = nullptr;
-		*e_ptr++ = nullptr;
+	if (captures_) {
+		std::fill_n(startp_, Total_Paren + 1, nullptr);
+		std::fill_n(endp_,   Total_Paren + 1, nullptr);
 	}
 
 	if (match(regex_->program_ + Regex::RegexStartOffset, &branch_index)) {
@@ -679,8 +876,243 @@ bool RegexMatch::attempt(const char *string) {
 	}
 }
 
+//------------------------------------------------------------------------------
+// Name: enableMemo
+// Desc: Switches failure memoization on for the rest of this execution. The
+//       bitset covers the look-behind boundary up to the logical end of the
+//       string, or as much of it around 'string' as MemoMaxBits permits.
+//------------------------------------------------------------------------------
+void RegexMatch::enableMemo(const char *string) {
+
+	if (memoWindowEnd_ == nullptr) {
+		for (memoWindowEnd_ = string; *memoWindowEnd_ != '\0'; ++memoWindowEnd_) {
+		}
+	}
+
+	const size_t window = (memoWindowEnd_ - memoWindowStart_) + 1;
+
+	memoProgSize_ = regex_->Reg_Size + 1;
+	memoSpan_     = std::min(window, MemoMaxBits / memoProgSize_);
+
+	if (memoSpan_ == 0) {
+		return; // Program is too big to be memoized at all.
+	}
+
+	memoActive_ = true;
+	rebaseMemo(string);
+}
+
+//------------------------------------------------------------------------------
+// Name: rebaseMemo
+// Desc: Moves the memoized part of the input window so that it covers
+//       'string', forgetting everything learned so far.
+//------------------------------------------------------------------------------
+void RegexMatch::rebaseMemo(const char *string) {
+
+	const size_t window = (memoWindowEnd_ - memoWindowStart_) + 1;
+	size_t offset       = (string > memoWindowStart_) ? (string - memoWindowStart_) : 0;
+
+	// Leave some room behind the attempt for look-behind and backward searches.
+	offset = (offset > memoSpan_ / 4) ? offset - memoSpan_ / 4 : 0;
+	offset = std::min(offset, window - memoSpan_);
+
+	memoBase_ = memoWindowStart_ + offset;
+	memo_.assign((memoProgSize_ * memoSpan_ + 63) / 64, 0);
+}
+
+//------------------------------------------------------------------------------
+// Name: uncapturedGroups
+// Desc: The groups with no capture recorded yet, as a bit mask. Captures are
+//       normally only recorded once the whole match has succeeded, but those
+//       inside an atomic group or a look-around are recorded as soon as its
+//       body matches, see matchAfterGroup().
+//------------------------------------------------------------------------------
+uint64_t RegexMatch::uncapturedGroups() const {
+
+	uint64_t groups = 0;
+
+	if (captures_) {
+		for (size_t i = 1; i <= Total_Paren; ++i) {
+			if (startp_[i] == nullptr) {
+				groups |= uint64_t(1) << i;
+			}
+		}
+	}
+
+	return groups;
+}
+
+//------------------------------------------------------------------------------
+// Name: capturedSince
+// Desc: Those of the 'uncaptured' groups that have a capture now.
+//------------------------------------------------------------------------------
+uint64_t RegexMatch::capturedSince(uint64_t uncaptured) const {
+
+	uint64_t groups = 0;
+
+	for (size_t i = 1; uncaptured != 0 && i <= Total_Paren; ++i) {
+		if (((uncaptured >> i) & 1) && startp_[i] != nullptr) {
+			groups |= uint64_t(1) << i;
+		}
+	}
+
+	return groups;
+}
+
+//------------------------------------------------------------------------------
+// Name: dropCaptures
+// Desc: Forgets the captures of 'groups', recorded by a body whose match
+//       didn't lead to a match of the whole expression.
+//------------------------------------------------------------------------------
+void RegexMatch::dropCaptures(uint64_t groups) {
+
+	for (size_t i = 1; groups != 0 && i <= Total_Paren; ++i) {
+		if ((groups >> i) & 1) {
+			startp_[i] = nullptr;
+			endp_[i]   = nullptr;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: matchAfterGroup
+// Desc: Matches what follows an atomic group or a positive look-around whose
+//       match recorded the groups in 'captured'. Their captures are held back
+//       until the rest has matched and then only fill in what a later
+//       repetition of the group hasn't, as for ordinary parentheses; if the
+//       rest fails they are dropped. Kept out of matchNode() so the saved
+//       captures don't enlarge every recursion frame.
+//------------------------------------------------------------------------------
+int RegexMatch::matchAfterGroup(prog_type *next, uint64_t captured) {
+
+	const char *start[NSUBEXP];
+	const char *end[NSUBEXP];
+
+	for (size_t i = 1; i <= Total_Paren; ++i) {
+		if ((captured >> i) & 1) {
+			start[i]   = startp_[i];
+			end[i]     = endp_[i];
+			startp_[i] = nullptr;
+			endp_[i]   = nullptr;
+		}
+	}
+
+	if (!match(next, nullptr)) {
+		dropCaptures(captured);
+		return 0;
+	}
+
+	for (size_t i = 1; i <= Total_Paren; ++i) {
+		if (((captured >> i) & 1) && startp_[i] == nullptr) {
+			startp_[i] = start[i];
+			endp_[i]   = end[i];
+		}
+	}
+
+	return 1;
+}
+
+//------------------------------------------------------------------------------
+// Name: matchSimpleBehind
+// Desc: Compares the body of a POS_BEHIND_SIMPLE or NEG_BEHIND_SIMPLE node,
+//       whose single branch is 'branch', with the text starting at 'p'.
+//------------------------------------------------------------------------------
+bool RegexMatch::matchSimpleBehind(prog_type *branch, const char *p) const {
+
+	for (prog_type *scan = getOperand(branch); getOpcode(scan) != LOOK_BEHIND_CLOSE; scan = next_ptr(scan)) {
+		const prog_type *operand = getOperand(scan);
+
+		switch (getOpcode(scan)) {
+		case EXACTLY:
+			for (; *operand != '\0'; ++operand, p = advance(p)) {
+				if (static_cast<prog_type>(*p) != *operand) {
+					return false;
+				}
+			}
+			break;
+
+		case SIMILAR:
+			for (; *operand != '\0'; ++operand, p = advance(p)) {
+				if (static_cast<prog_type>(caseFold_[static_cast<unsigned char>(*p)]) != *operand) {
+					return false;
+				}
+			}
+			break;
+
+		case ANY_OF:
+		case ANY_BUT:
+			if (!classMember(operand, *p)) {
+				return false;
+			}
+			p = advance(p);
+			break;
+
+		default:
+			if (!classMember(shortcutClass(getOpcode(scan)), *p)) {
+				return false;
+			}
+			p = advance(p);
+			break;
+		}
+	}
+
+	return true;
+}
+
 //------------------------------------------------------------------------------
 // Name: match
+// Desc: Memoizing front end of matchNode(). Once memoization is active, a
+//       (node, input) pair that failed before fails again immediately, so
+//       nested quantifiers can't revisit the same state exponentially often.
+//       Failures due to the recursion limit or the execution budget are not
+//       recorded.
+//------------------------------------------------------------------------------
+int RegexMatch::match(prog_type *prog, int *branch_index_param) {
+
+	if (budget_ && !withinBudget()) {
+		return 0;
+	}
+
+	if (!memoActive_) {
+		if (++steps_ > MemoTriggerSteps && memoMode_ == Memoization::Auto) {
+			memoTriggered_ = true;
+			enableMemo(input);
+		}
+
+		return matchNode(prog, branch_index_param);
+	}
+
+	const char *const start = input;
+
+	if (lookBehindDepth_ != 0 || start < memoBase_ || start >= memoBase_ + memoSpan_) {
+		return matchNode(prog, branch_index_param);
+	}
+
+	const size_t bit     = static_cast<size_t>(prog - regex_->program_) * memoSpan_ + static_cast<size_t>(start - memoBase_);
+	const uint64_t mask  = uint64_t(1) << (bit % 64);
+	uint64_t &word       = memo_[bit / 64];
+
+	if (word & mask) {
+		return 0;
+	}
+
+	const int ret = matchNode(prog, branch_index_param);
+
+	if (!ret && !Recursion_Limit_Exceeded) {
+		word |= mask;
+	}
+
+	return ret;
+}
+
+#ifdef REGEX_COMPUTED_GOTO
+// Labels as values are a GNU extension, keep -pedantic quiet about them.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+//------------------------------------------------------------------------------
+// Name: matchNode
 // Desc: Conceptually the strategy is simple: check to see whether the
 //       current node matches, call self recursively to see whether the rest
 //       matches, and then act accordingly.  In practice we make some effort
@@ -688,26 +1120,51 @@ bool RegexMatch::attempt(const char *string) {
 //       (that don't need to know whether the rest of the match failed) by a
 //       loop instead of by recursion.  Returns 0 failure, 1 success.
 //------------------------------------------------------------------------------
-int RegexMatch::match(prog_type *prog, int *branch_index_param) {
+int RegexMatch::matchNode(prog_type *prog, int *branch_index_param) {
 
 	prog_type *next;       // Next node.
 
 	if (++recursion_count_ > RegexRecursionLimit) {
 		if (!Recursion_Limit_Exceeded) { // Prevent duplicate errors
 			qDebug("recursion limit exceeded, please respecify expression");
+			PROFILE(++profile_.recursionLimits);
 		}
 		Recursion_Limit_Exceeded = true;
 		MATCH_RETURN(0);
 	}
 
+#ifdef REGEX_COMPUTED_GOTO
+	// Indexed by opcode, in the order of RegexOpcodes. Parentheses and anything unknown go to the default.
+	static const void *const dispatch_table[] = {
+		&&target_default, &&target_END, &&target_BOL, &&target_EOL, &&target_BOWORD, &&target_EOWORD,
+		&&target_NOT_BOUNDARY, &&target_EXACTLY, &&target_SIMILAR, &&target_ANY_OF, &&target_ANY_BUT,
+		&&target_ANY, &&target_EVERY, &&target_DIGIT, &&target_NOT_DIGIT, &&target_LETTER,
+		&&target_NOT_LETTER, &&target_SPACE, &&target_SPACE_NL, &&target_NOT_SPACE,
+		&&target_NOT_SPACE_NL, &&target_WORD_CHAR, &&target_NOT_WORD_CHAR, &&target_IS_DELIM,
+		&&target_NOT_DELIM, &&target_STAR, &&target_LAZY_STAR, &&target_QUESTION, &&target_LAZY_QUESTION,
+		&&target_PLUS, &&target_LAZY_PLUS, &&target_BRACE, &&target_LAZY_BRACE, &&target_NOTHING,
+		&&target_BRANCH, &&target_BACK, &&target_INIT_COUNT, &&target_INC_COUNT, &&target_TEST_COUNT,
+		&&target_BACK_REF, &&target_BACK_REF_CI, &&target_default, &&target_default,
+		&&target_POS_AHEAD_OPEN, &&target_NEG_AHEAD_OPEN, &&target_LOOK_AHEAD_CLOSE,
+		&&target_POS_BEHIND_OPEN, &&target_NEG_BEHIND_OPEN, &&target_LOOK_BEHIND_CLOSE, &&target_ATOMIC_OPEN,
+		&&target_ATOMIC_CLOSE, &&target_POSSESSIVE_STAR, &&target_POSSESSIVE_QUESTION, &&target_POSSESSIVE_PLUS,
+		&&target_POSSESSIVE_BRACE, &&target_POS_BEHIND_SIMPLE, &&target_NEG_BEHIND_SIMPLE
+	};
+	static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == OPEN, "dispatch table out of step with RegexOpcodes");
+#endif
+
 	// Current node.
 	prog_type *scan = prog;
 
 	while (scan != nullptr) {
-		NEXT_PTR(scan, next);
+		next = next_ptr(scan);
+		PROFILE_NODE(scan);
 
+#ifdef REGEX_COMPUTED_GOTO
+		goto *dispatch_table[DISPATCH_INDEX(scan)];
+#endif
 		switch (getOpcode(scan)) {
-		case BRANCH: {	
+		TARGET(BRANCH): {	
 
 			if (getOpcode(next) != BRANCH) { // No choice.
 				next = getOperand(scan);          // Avoid recursion.
@@ -728,42 +1185,48 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 					CHECK_RECURSION_LIMIT
 
 					++branch_index_local;
+					PROFILE(++profile_.backtracks);
 
 					input = save; // Backtrack.
-					NEXT_PTR(scan, scan);
+					scan = next_ptr(scan);
 				} while (scan != nullptr && getOpcode(scan) == BRANCH);
 
 				MATCH_RETURN(0); // NOT REACHED
 			}
 		}
 
-		break;
+		DISPATCH();
 
-		case EXACTLY: {
+		TARGET(EXACTLY): {
 			prog_type *opnd = getOperand(scan);
 
 			// Inline the first character, for speed.
 
-			if (*opnd != *input)
+			if (*opnd != static_cast<prog_type>(*input))
 				MATCH_RETURN(0);
 
 			size_t len = string_length(opnd);
+			const char *after = advance(input, len);
 
-			if (endOfString != nullptr && input + len > endOfString) {
+			if (endOfString != nullptr && after > endOfString) {
 				MATCH_RETURN(0);
 			}
 
-			if (len > 1 && string_compare(opnd, input, len) != 0) {
+			if (len > 1) {
+				// Compare up to the gap, then the rest after it.
+				const size_t head = (after - input == static_cast<ptrdiff_t>(len)) ? len : static_cast<size_t>(gapStart_ - input);
 
-				MATCH_RETURN(0);
+				if (string_compare(opnd, input, head) != 0 || (head < len && string_compare(opnd + head, gapEnd_, len - head) != 0)) {
+					MATCH_RETURN(0);
+				}
 			}
 
-			input += len;
+			input = after;
 		}
 
-		break;
+		DISPATCH();
 
-		case SIMILAR: {
+		TARGET(SIMILAR): {
 			prog_type test;
 
 			prog_type *opnd = getOperand(scan);
@@ -772,33 +1235,35 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			      regex compile. */
 
 			while ((test = *opnd++) != '\0') {
-				if (atEndOfString(input) || tolower(*input++) != test) {
+				if (atEndOfString(input) || static_cast<prog_type>(caseFold_[static_cast<unsigned char>(*input)]) != test) {
 
 					MATCH_RETURN(0);
 				}
+
+				input = advance(input);
 			}
 		}
 
-		break;
+		DISPATCH();
 
-		case BOL: // '^' (beginning of line anchor)
+		TARGET(BOL): // '^' (beginning of line anchor)
 			if (input == startOfString) {
 				if (prevIsBOL)
-					break;
-			} else if (*(input - 1) == '\n') {
-				break;
+					DISPATCH();
+			} else if (*retreat(input) == '\n') {
+				DISPATCH();
 			}
 
 			MATCH_RETURN(0);
 
-		case EOL: // '$' anchor matches end of line and end of string
+		TARGET(EOL): // '$' anchor matches end of line and end of string
 			if (*input == '\n' || (atEndOfString(input) && succIsEOL)) {
-				break;
+				DISPATCH();
 			}
 
 			MATCH_RETURN(0);
 
-		case BOWORD: // '<' (beginning of word anchor)
+		TARGET(BOWORD): // '<' (beginning of word anchor)
 			         /* Check to see if the current character is not a delimiter
 			            and the preceding character is. */
 			{
@@ -806,7 +1271,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				if (input == startOfString) {
 					prev_is_delim = prevIsDelim;
 				} else {
-					prev_is_delim = Current_Delimiters[static_cast<int>(*(input - 1))];
+					prev_is_delim = Current_Delimiters[static_cast<int>(*retreat(input))];
 				}
 				if (prev_is_delim) {
 					int current_is_delim;
@@ -816,13 +1281,13 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 						current_is_delim = Current_Delimiters[static_cast<int>(*input)];
 					}
 					if (!current_is_delim)
-						break;
+						DISPATCH();
 				}
 			}
 
 			MATCH_RETURN(0);
 
-		case EOWORD: // '>' (end of word anchor)
+		TARGET(EOWORD): // '>' (end of word anchor)
 			         /* Check to see if the current character is a delimiter
 			        and the preceding character is not. */
 			{
@@ -830,7 +1295,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				if (input == startOfString) {
 					prev_is_delim = prevIsDelim;
 				} else {
-					prev_is_delim = Current_Delimiters[static_cast<int>(*(input - 1))];
+					prev_is_delim = Current_Delimiters[static_cast<int>(*retreat(input))];
 				}
 				if (!prev_is_delim) {
 					int current_is_delim;
@@ -840,13 +1305,13 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 						current_is_delim = Current_Delimiters[static_cast<int>(*input)];
 					}
 					if (current_is_delim)
-						break;
+						DISPATCH();
 				}
 			}
 
 			MATCH_RETURN(0);
 
-		case NOT_BOUNDARY: // \B (NOT a word boundary)
+		TARGET(NOT_BOUNDARY): // \B (NOT a word boundary)
 		{
 			int prev_is_delim;
 			int current_is_delim;
@@ -854,7 +1319,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			if (input == startOfString) {
 				prev_is_delim = prevIsDelim;
 			} else {
-				prev_is_delim = Current_Delimiters[*input - 1];
+				prev_is_delim = Current_Delimiters[static_cast<int>(*retreat(input))];
 			}
 			if (atEndOfString(input)) {
 				current_is_delim = succIsDelim;
@@ -863,158 +1328,149 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			}
 			
 			if (!(prev_is_delim ^ current_is_delim))
-				break;
+				DISPATCH();
 		}
 
 			MATCH_RETURN(0);
 
-		case IS_DELIM: // \y (A word delimiter character.)
+		TARGET(IS_DELIM): // \y (A word delimiter character.)
 			if (Current_Delimiters[static_cast<int>(*input)] && !atEndOfString(input)) {
-				input++;
-				break;
+				input = advance(input);
+				DISPATCH();
 			}
 
 			MATCH_RETURN(0);
 
-		case NOT_DELIM: // \Y (NOT a word delimiter character.)
+		TARGET(NOT_DELIM): // \Y (NOT a word delimiter character.)
 			if (!Current_Delimiters[static_cast<int>(*input)] && !atEndOfString(input)) {
-				input++;
-				break;
+				input = advance(input);
+				DISPATCH();
 			}
 
 			MATCH_RETURN(0);
 
-		case WORD_CHAR: // \w (word character; alpha-numeric or underscore)
+		TARGET(WORD_CHAR): // \w (word character; alpha-numeric or underscore)
 			if ((isalnum(*input) || *input == '_') && !atEndOfString(input)) {
-				input++;
-				break;
+				input = advance(input);
+				DISPATCH();
 			}
 
 			MATCH_RETURN(0);
 
-		case NOT_WORD_CHAR: // \W (NOT a word character)
+		TARGET(NOT_WORD_CHAR): // \W (NOT a word character)
 			if (isalnum(*input) || *input == '_' || *input == '\n' ||
 			   atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case ANY: // '.' (matches any character EXCEPT newline)
+		TARGET(ANY): // '.' (matches any character EXCEPT newline)
 			if (atEndOfString(input) || *input == '\n')
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case EVERY: // '.' (matches any character INCLUDING newline)
+		TARGET(EVERY): // '.' (matches any character INCLUDING newline)
 			if (atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case DIGIT: // \d, same as [0123456789]
+		TARGET(DIGIT): // \d, same as [0123456789]
 			if (!isdigit(*input) || atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case NOT_DIGIT: // \D, same as [^0123456789]
+		TARGET(NOT_DIGIT): // \D, same as [^0123456789]
 			if (isdigit(*input) || *input == '\n' ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case LETTER: // \l, same as [a-zA-Z]
+		TARGET(LETTER): // \l, same as [a-zA-Z]
 			if (!isalpha(*input) ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case NOT_LETTER: // \L, same as [^0123456789]
+		TARGET(NOT_LETTER): // \L, same as [^0123456789]
 			if (isalpha(*input) || *input == '\n' ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case SPACE: // \s, same as [ \t\r\f\v]
+		TARGET(SPACE): // \s, same as [ \t\r\f\v]
 			if (!isspace(*input) || *input == '\n' ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case SPACE_NL: // \s, same as [\n \t\r\f\v]
+		TARGET(SPACE_NL): // \s, same as [\n \t\r\f\v]
 			if (!isspace(*input) ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case NOT_SPACE: // \S, same as [^\n \t\r\f\v]
+		TARGET(NOT_SPACE): // \S, same as [^\n \t\r\f\v]
 			if (isspace(*input) ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case NOT_SPACE_NL: // \S, same as [^ \t\r\f\v]
+		TARGET(NOT_SPACE_NL): // \S, same as [^ \t\r\f\v]
 			if ((isspace(*input) && *input != '\n') ||atEndOfString(input))
 				MATCH_RETURN(0);
 
-			input++;
-			break;
-
-		case ANY_OF: // [...] character class.
-			if (atEndOfString(input))
-				MATCH_RETURN(0); /* Needed because strchr ()
-				                   considers \0 as a member
-				                   of the character set. */
-
-			if (find_character(getOperand(scan), *input) == nullptr) {
-				MATCH_RETURN(0);
-			}
-
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case ANY_BUT: /* [^...] Negated character class-- does NOT normally
+		TARGET(ANY_OF):  // [...] character class.
+		TARGET(ANY_BUT): /* [^...] Negated character class-- does NOT normally
 		               match newline (\n added usually to operand at compile
-		               time.) */
+		               time.) The operand already is the complemented set. */
 
-			if (atEndOfString(input))
-				MATCH_RETURN(0); // See comment for ANY_OF.
-
-			if (find_character(getOperand(scan), *input) != nullptr) {
+			if (atEndOfString(input) || !classMember(getOperand(scan), *input)) {
 				MATCH_RETURN(0);
 			}
 
-			input++;
-			break;
+			input = advance(input);
+			DISPATCH();
 
-		case NOTHING:
-		case BACK:
-			break;
+		TARGET(NOTHING):
+		TARGET(BACK):
+			DISPATCH();
 
-		case STAR:
-		case PLUS:
-		case QUESTION:
-		case BRACE:
+		TARGET(STAR):
+		TARGET(PLUS):
+		TARGET(QUESTION):
+		TARGET(BRACE):
 
-		case LAZY_STAR:
-		case LAZY_PLUS:
-		case LAZY_QUESTION:
-		case LAZY_BRACE: {
+		TARGET(LAZY_STAR):
+		TARGET(LAZY_PLUS):
+		TARGET(LAZY_QUESTION):
+		TARGET(LAZY_BRACE):
+
+		TARGET(POSSESSIVE_STAR):
+		TARGET(POSSESSIVE_PLUS):
+		TARGET(POSSESSIVE_QUESTION):
+		TARGET(POSSESSIVE_BRACE): {
 			unsigned long num_matched = REG_ZERO;
 			unsigned long min = ULONG_MAX;
 			unsigned long max = REG_ZERO;
 			prog_type next_char;
 			bool lazy = false;
+			bool possessive = false;
 
 			/* Lookahead (when possible) to avoid useless match attempts
 			      when we know what character comes next. */
@@ -1028,6 +1484,12 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			prog_type *next_op = getOperand(scan);
 
 			switch (getOpcode(scan)) {
+			case POSSESSIVE_STAR:
+				possessive = true;
+				min = REG_ZERO;
+				max = ULONG_MAX;
+				break;
+
 			case LAZY_STAR:
 				lazy = true;
 			case STAR:
@@ -1035,6 +1497,12 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				max = ULONG_MAX;
 				break;
 
+			case POSSESSIVE_PLUS:
+				possessive = true;
+				min = REG_ONE;
+				max = ULONG_MAX;
+				break;
+
 			case LAZY_PLUS:
 				lazy = true;
 			case PLUS:
@@ -1042,6 +1510,12 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				max = ULONG_MAX;
 				break;
 
+			case POSSESSIVE_QUESTION:
+				possessive = true;
+				min = REG_ZERO;
+				max = REG_ONE;
+				break;
+
 			case LAZY_QUESTION:
 				lazy = true;
 			case QUESTION:
@@ -1050,8 +1524,10 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				break;
 
 			case LAZY_BRACE:
-				lazy = true;
 			case BRACE:
+			case POSSESSIVE_BRACE:
+				lazy       = (getOpcode(scan) == LAZY_BRACE);
+				possessive = (getOpcode(scan) == POSSESSIVE_BRACE);
 				min = getOffset(scan + Regex::NextPtrSize);
 
 				max = getOffset(scan + (2 * Regex::NextPtrSize));
@@ -1071,8 +1547,17 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				num_matched = greedy(next_op, max);
 			}
 
+			if (possessive) {
+				// Keep the whole run, what follows gets one try from its end.
+				if (num_matched < min) {
+					MATCH_RETURN(0);
+				}
+
+				DISPATCH();
+			}
+
 			while (min <= num_matched && num_matched <= max) {
-				if (next_char == '\0' || next_char == *input) {
+				if (next_char == '\0' || next_char == static_cast<prog_type>(*input)) {
 					if (match(next, nullptr))
 						MATCH_RETURN(1);
 
@@ -1080,8 +1565,12 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				}
 
 				// Couldn't or didn't match.
+				PROFILE(++profile_.backtracks);
 
 				if (lazy) {
+					// A failed match of 'next' may have moved 'input'.
+					input = advance(save, num_matched);
+
 					if (!greedy(next_op, 1)) {
 						MATCH_RETURN(0);
 					}
@@ -1093,7 +1582,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 					break;
 				}
 
-				input = save + num_matched;
+				input = advance(save, num_matched);
 			}
 
 			MATCH_RETURN(0);
@@ -1101,7 +1590,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 
 		break;
 
-		case END:
+		TARGET(END):
 			if (Extent_Ptr_FW == nullptr || (input - Extent_Ptr_FW) > 0) {
 				Extent_Ptr_FW = input;
 			}
@@ -1110,25 +1599,31 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 
 			break;
 
-		case INIT_COUNT:
-			brace_counts_[*getOperand(scan)] = REG_ZERO;
+		TARGET(INIT_COUNT):
+		TARGET(INC_COUNT): {
+			// Undo the count if the rest fails, so the next attempt doesn't see it.
+			const prog_type brace_no = *getOperand(scan);
+			const uint32_t  count    = brace_counts_[brace_no];
 
-			break;
+			brace_counts_[brace_no] = (getOpcode(scan) == INIT_COUNT) ? REG_ZERO : count + 1;
 
-		case INC_COUNT:
-			brace_counts_[*getOperand(scan)]++;
+			if (match(next, nullptr)) {
+				MATCH_RETURN(1);
+			}
 
-			break;
+			brace_counts_[brace_no] = count;
+			MATCH_RETURN(0);
+		}
 
-		case TEST_COUNT:
+		TARGET(TEST_COUNT):
 			if (brace_counts_[*getOperand(scan)] < getOffset(scan + Regex::NextPtrSize + Regex::IndexSize)) {
 				next = scan + Regex::NodeSize + Regex::IndexSize + Regex::NextPtrSize;
 			}
 
-			break;
+			DISPATCH();
 
-		case BACK_REF:
-		case BACK_REF_CI:
+		TARGET(BACK_REF):
+		TARGET(BACK_REF_CI):
 			// case X_REGEX_BR:
 			// case X_REGEX_BR_CI: *** IMPLEMENT LATER
 			{
@@ -1147,7 +1642,7 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				   } else { */
 				   
 				   
-				assert(paren_no < MaxBackRefs);
+				assert(paren_no < numBackRefs_);
 				const char *captured = Back_Ref_Start[paren_no];
 				const char *finish   = Back_Ref_End[paren_no];
 				// }
@@ -1161,25 +1656,31 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 
 						while (captured < finish) {
 							if (atEndOfString(input) ||
-								tolower(*captured++) != tolower(*input++)) {
+								caseFold_[static_cast<unsigned char>(*captured)] != caseFold_[static_cast<unsigned char>(*input)]) {
 								MATCH_RETURN(0);
 							}
+
+							captured = advance(captured);
+							input    = advance(input);
 						}
 					} else {
 						while (captured < finish) {
-							if (atEndOfString(input) || *captured++ != *input++)
+							if (atEndOfString(input) || *captured != *input)
 								MATCH_RETURN(0);
+
+							captured = advance(captured);
+							input    = advance(input);
 						}
 					}
 
-					break;
+					DISPATCH();
 				} else {
 					MATCH_RETURN(0);
 				}
 			}
 
-		case POS_AHEAD_OPEN:
-		case NEG_AHEAD_OPEN: {
+		TARGET(POS_AHEAD_OPEN):
+		TARGET(NEG_AHEAD_OPEN): {
 
 			const char *save = input;
 
@@ -1188,8 +1689,12 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			const char *saved_end = endOfString;
 			endOfString = nullptr;
 
+			const uint64_t uncaptured = uncapturedGroups();
+
 			int answer = match(next, nullptr); // Does the look-ahead regex match?
 
+			const uint64_t captured = capturedSince(uncaptured);
+
 			CHECK_RECURSION_LIMIT
 
 			if ((getOpcode(scan) == POS_AHEAD_OPEN) ? answer : !answer) {
@@ -1216,18 +1721,23 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				while (getOpcode(next) == BRANCH)
 					next = next_ptr(next);
 				next = next_ptr(next); // Skip the LOOK_AHEAD_CLOSE
+
+				if (captured != 0) {
+					MATCH_RETURN(matchAfterGroup(next, captured));
+				}
 			} else {
 				input = save;          // Backtrack to look-ahead start.
 				endOfString = saved_end; // Restore logical end.
 
+				dropCaptures(captured); // Of a body a negative look-ahead rejects.
 				MATCH_RETURN(0);
 			}
 		}
 
-		break;
+		DISPATCH();
 
-		case POS_BEHIND_OPEN:
-		case NEG_BEHIND_OPEN: {
+		TARGET(POS_BEHIND_OPEN):
+		TARGET(NEG_BEHIND_OPEN): {
 			int found = 0;
 
 			const char *save = input;
@@ -1241,20 +1751,25 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 			int lower = get_lower(scan);
 			int upper = get_upper(scan);
 
+			const uint64_t uncaptured = uncapturedGroups();
+
 			/* Start with the shortest match first. This is the most
 			      efficient direction in general.
 			      Note! Negative look behind is _very_ tricky when the length
 			      is not constant: we have to make sure the expression doesn't
 			      match for _any_ of the starting positions. */
 			for (int offset = lower; offset <= upper; ++offset) {
-				input = save - offset;
+				const char *const behind = retreat(save, offset);
+				input = behind;
 
 				if (input < lookBehindTo) {
 					// No need to look any further
 					break;
 				}
 
+				++lookBehindDepth_;
 				int answer = match(next, nullptr); // Does the look-behind regex match?
+				--lookBehindDepth_;
 
 				CHECK_RECURSION_LIMIT
 
@@ -1272,18 +1787,23 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 					    leading look-behind may need more text than it matches
 					    to accomplish a re-match. */
 
-					if (Extent_Ptr_BW == nullptr || (Extent_Ptr_BW - (save - offset)) > 0) {
-						Extent_Ptr_BW = save - offset;
+					if (Extent_Ptr_BW == nullptr || Extent_Ptr_BW > behind) {
+						Extent_Ptr_BW = behind;
 					}
 
 					break;
 				}
+
+				// Nor does a match ending elsewhere capture anything.
+				dropCaptures(capturedSince(uncaptured));
 			}
 
 			// Always restore the position and the logical string end.
 			input = save;
 			endOfString = saved_end;
 
+			const uint64_t captured = capturedSince(uncaptured);
+
 			if ((getOpcode(scan) == POS_BEHIND_OPEN) ? found : !found) {
 				/* The look-behind matches, so we must jump to the next
 				     node. The look-behind node is followed by a chain of
@@ -1294,22 +1814,75 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				while (getOpcode(next) == BRANCH)
 					next = next_ptr(next);
 				next = next_ptr(next); // Skip LOOK_BEHIND_CLOSE
+
+				if (captured != 0) {
+					MATCH_RETURN(matchAfterGroup(next, captured));
+				}
 			} else {
 				// Not a match
+				dropCaptures(captured);
 				MATCH_RETURN(0);
 			}
-		} break;
+		} DISPATCH();
 
-		case LOOK_AHEAD_CLOSE:
-		case LOOK_BEHIND_CLOSE:
-			MATCH_RETURN(1); /* We have reached the end of the look-ahead or look-behind which implies that we matched it, so return TRUE. */
-		default:
+		TARGET(POS_BEHIND_SIMPLE):
+		TARGET(NEG_BEHIND_SIMPLE): {
+			/* The body always matches the same number of characters, one
+			      by one, so it is compared right where it has to start. */
+			const char *const behind = retreat(input, get_lower(scan));
+			const bool found         = (behind >= lookBehindTo) && matchSimpleBehind(next, behind);
+
+			if (found && (Extent_Ptr_BW == nullptr || Extent_Ptr_BW > behind)) {
+				Extent_Ptr_BW = behind;
+			}
+
+			if ((getOpcode(scan) == POS_BEHIND_SIMPLE) ? !found : found) {
+				MATCH_RETURN(0);
+			}
+
+			// Skip the body, a single branch, and the LOOK_BEHIND_CLOSE.
+			next = next_ptr(next_ptr(next));
+		} DISPATCH();
+
+		TARGET(ATOMIC_OPEN): {
+			const uint64_t uncaptured = uncapturedGroups();
+
+			// Match the group on its own, up to its ATOMIC_CLOSE.
+			if (!match(next, nullptr)) {
+				MATCH_RETURN(0);
+			}
+
+			/* Carry on after the group from where its first match ended,
+			      never backtracking into it. */
+			next = next_ptr(getOperand(scan)); // Skip 1st branch
+			while (getOpcode(next) == BRANCH)
+				next = next_ptr(next);
+			next = next_ptr(next); // Skip the ATOMIC_CLOSE
+
+			const uint64_t captured = capturedSince(uncaptured);
+
+			if (captured == 0) {
+				DISPATCH();
+			}
+
+			MATCH_RETURN(matchAfterGroup(next, captured));
+		}
+
+		TARGET(LOOK_AHEAD_CLOSE):
+		TARGET(LOOK_BEHIND_CLOSE):
+		TARGET(ATOMIC_CLOSE):
+			MATCH_RETURN(1); /* We have reached the end of the look-ahead, look-behind or atomic group which implies that we matched it, so return TRUE. */
+		TARGET_DEFAULT:
 			if ((getOpcode(scan) > OPEN) && (getOpcode(scan) < OPEN + NSUBEXP)) {
 
+				if (!captures_) {
+					DISPATCH(); // Nothing to record, carry on without recursing.
+				}
+
 				int no = getOpcode(scan) - OPEN;
 				const char *save = input;
 
-				if (no < 10) {
+				if (static_cast<size_t>(no) < numBackRefs_) {
 					Back_Ref_Start[no] = save;
 					Back_Ref_End[no] = nullptr;
 				}
@@ -1327,10 +1900,14 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 				}
 			} else if ((getOpcode(scan) > CLOSE) && (getOpcode(scan) < CLOSE + NSUBEXP)) {
 
+				if (!captures_) {
+					DISPATCH();
+				}
+
 				int no = getOpcode(scan) - CLOSE;
 				const char *save = input;
 
-				if (no < 10) {
+				if (static_cast<size_t>(no) < numBackRefs_) {
 					Back_Ref_End[no] = save;
 				}
 
@@ -1357,6 +1934,9 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 		scan = next;
 	}
 
+#ifdef REGEX_COMPUTED_GOTO
+dispatch_done:
+#endif
 	/* We get here only if there's trouble -- normally "case END" is
 	  the terminating point. */
 
@@ -1365,6 +1945,10 @@ int RegexMatch::match(prog_type *prog, int *branch_index_param) {
 	MATCH_RETURN(0);
 }
 
+#ifdef REGEX_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
 //------------------------------------------------------------------------------
 // Name: greedy
 // Desc: Repeatedly match something simple up to "max" times. If max <= 0
@@ -1386,62 +1970,42 @@ unsigned long RegexMatch::greedy(prog_type *p, long max) {
 	unsigned long max_cmp = (max > 0) ? static_cast<unsigned long>(max) : ULONG_MAX;
 
 	switch (getOpcode(p)) {
-	case ANY:
-		/* Race to the end of the line or string. Dot DOESN'T match
-		    newline. */
-
-		while (count < max_cmp && *input_str != '\n' && !atEndOfString(input_str)) {
-			count++;
-			input_str++;
-		}
-
+	case ANY_OF:  // [...] character class.
+	case ANY_BUT: /* [^...] Negated character class- does NOT normally
+	                   match newline (\n added usually to operand at compile
+	                   time.) */
+		input_str = scanClass(input_str, operand, max_cmp);
+		count = distance(input, input_str);
 		break;
 
-	case EVERY:
-		// Race to the end of the line or string. Dot DOES match newline.
-
-		while (count < max_cmp && !atEndOfString(input_str)) {
-			count++;
-			input_str++;
-		}
-
+	case ANY:           // Race to the end of the line or string. Dot DOESN'T match newline.
+	case EVERY:         // Race to the end of the line or string. Dot DOES match newline.
+	case DIGIT:         // same as [0123456789]
+	case NOT_DIGIT:     // same as [^0123456789]
+	case LETTER:        // same as [a-zA-Z]
+	case NOT_LETTER:    // same as [^a-zA-Z]
+	case SPACE:         // same as [ \t\r\f\v]-- doesn't match newline.
+	case SPACE_NL:      // same as [\n \t\r\f\v]-- matches newline.
+	case NOT_SPACE:     // same as [^\n \t\r\f\v]-- doesn't match newline.
+	case NOT_SPACE_NL:  // same as [^ \t\r\f\v]-- matches newline.
+	case WORD_CHAR:     // \w (word character, alpha-numeric or underscore)
+	case NOT_WORD_CHAR: // \W (NOT a word character)
+		input_str = scanClass(input_str, shortcutClass(getOpcode(p)), max_cmp);
+		count = distance(input, input_str);
 		break;
 
 	case EXACTLY: // Count occurrences of single character operand.
-		while (count < max_cmp && *operand == *input_str && !atEndOfString(input_str)) {
+		while (count < max_cmp && *operand == static_cast<prog_type>(*input_str) && !atEndOfString(input_str)) {
 			count++;
-			input_str++;
+			input_str = advance(input_str);
 		}
 
 		break;
 
 	case SIMILAR: // Case insensitive version of EXACTLY
-		while (count < max_cmp && *operand == tolower(*input_str) && !atEndOfString(input_str)) {
-			count++;
-			input_str++;
-		}
-
-		break;
-
-	case ANY_OF: // [...] character class.
-		while (count < max_cmp && find_character(operand, *input_str) != nullptr &&
-			   !atEndOfString(input_str)) {
-
-			count++;
-			input_str++;
-		}
-
-		break;
-
-	case ANY_BUT: /* [^...] Negated character class- does NOT normally
-	                   match newline (\n added usually to operand at compile
-	                   time.) */
-
-		while (count < max_cmp && find_character(operand, *input_str) == nullptr &&
-			   !atEndOfString(input_str)) {
-
+		while (count < max_cmp && *operand == static_cast<prog_type>(caseFold_[static_cast<unsigned char>(*input_str)]) && !atEndOfString(input_str)) {
 			count++;
-			input_str++;
+			input_str = advance(input_str);
 		}
 
 		break;
@@ -1451,7 +2015,7 @@ unsigned long RegexMatch::greedy(prog_type *p, long max) {
 
 		while (count < max_cmp && Current_Delimiters[static_cast<int>(*input_str)] && !atEndOfString(input_str)) {
 			count++;
-			input_str++;
+			input_str = advance(input_str);
 		}
 
 		break;
@@ -1461,118 +2025,313 @@ unsigned long RegexMatch::greedy(prog_type *p, long max) {
 
 		while (count < max_cmp && !Current_Delimiters[static_cast<int>(*input_str)] && !atEndOfString(input_str)) {
 			count++;
-			input_str++;
+			input_str = advance(input_str);
 		}
 
 		break;
 
-	case WORD_CHAR: // \w (word character, alpha-numeric or underscore)
-		while (count < max_cmp && (isalnum(*input_str) || *input_str == '_') &&
-			   !atEndOfString(input_str)) {
+	default:
+		/* Called inappropriately.  Only atoms that are SIMPLE should
+		    generate a call to greedy.  The above cases should cover
+		    all the atoms that are SIMPLE. */
+
+		qDebug("internal error #10 'greedy'");
+		count = 0U; // Best we can do.
+	}
 
-			count++;
-			input_str++;
-		}
+	// Point to character just after last matched character.
 
-		break;
+	input = input_str;
 
-	case NOT_WORD_CHAR: // \W (NOT a word character)
-		while (count < max_cmp && !isalnum(*input_str) && *input_str != '_' &&
-			   *input_str != '\n' && !atEndOfString(input_str)) {
+	return count;
+}
 
-			count++;
-			input_str++;
-		}
+//------------------------------------------------------------------------------
+// Name: scanClass
+// Desc: Returns the end of the run of class members starting at 'p', taking at
+//       most 'max' characters and stopping at the logical end of the input.
+//       A run that reaches the gap carries on after it.
+//------------------------------------------------------------------------------
+const char *RegexMatch::scanClass(const char *p, const prog_type *operand, unsigned long max) const {
 
-		break;
+	if (gapStart_ && p < gapStart_) {
+		const char *const segmentEnd = (endOfString && endOfString < gapStart_) ? endOfString : gapStart_;
+		const char *const q          = scanRun(p, operand, max, segmentEnd);
 
-	case DIGIT: // same as [0123456789]
-		while (count < max_cmp && isdigit(*input_str) && !atEndOfString(input_str)) {
-			count++;
-			input_str++;
+		if (q != gapStart_) {
+			return q;
 		}
 
-		break;
+		if (max != ULONG_MAX) {
+			max -= (q - p);
+		}
 
-	case NOT_DIGIT: // same as [^0123456789]
-		while (count < max_cmp && !isdigit(*input_str) && *input_str != '\n' &&
-			   !atEndOfString(input_str)) {
+		p = gapEnd_;
+	}
 
-			count++;
-			input_str++;
+	return scanRun(p, operand, max, endOfString);
+}
+
+//------------------------------------------------------------------------------
+// Name: scanRun
+// Desc: scanClass() within contiguous text ending at 'limit' (NULL if it ends
+//       at the terminator, '\0' is never a member). When the class lists its
+//       few non-members, 16 characters at a time are compared against them,
+//       which makes runs like [^"]*, [^\n]* and .* about as cheap as memchr.
+//------------------------------------------------------------------------------
+const char *RegexMatch::scanRun(const char *p, const prog_type *operand, unsigned long max, const char *limit) const {
+
+	// Most runs are short or empty, get those out of the way first.
+	if (max == 0 || !classMember(operand, *p)) {
+		return p;
+	}
+
+	const bool endKnown = (limit != nullptr);
+
+	if (limit) {
+		if (p >= limit) {
+			return p;
 		}
 
-		break;
+		if (static_cast<unsigned long>(limit - p) > max) {
+			limit = p + max;
+		}
+	} else if (max != ULONG_MAX) {
+		limit = p + max;
+	}
 
-	case SPACE: // same as [ \t\r\f\v]-- doesn't match newline.
-		while (count < max_cmp && isspace(*input_str) && *input_str != '\n' &&
-			   !atEndOfString(input_str)) {
+#ifdef REGEX_HAVE_SSE2
+	const prog_type *stops = operand + Regex::ClassBitmapSize;
 
-			count++;
-			input_str++;
+	/* Only with a known end of the text: the loads must not read past it,
+	   which we can't know without one. */
+	if (endKnown && stops[0] != 0) {
+		const __m128i s0 = _mm_set1_epi8(static_cast<char>(stops[1]));
+		const __m128i s1 = _mm_set1_epi8(static_cast<char>(stops[stops[0] > 1 ? 2 : 1]));
+		const __m128i s2 = _mm_set1_epi8(static_cast<char>(stops[stops[0] > 2 ? 3 : 1]));
+		const __m128i s3 = _mm_set1_epi8(static_cast<char>(stops[stops[0] > 3 ? 4 : 1]));
+
+		while (limit - p >= 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1)),
+			                               _mm_or_si128(_mm_cmpeq_epi8(v, s2), _mm_cmpeq_epi8(v, s3)));
+
+			if (_mm_movemask_epi8(m) != 0) {
+				break; // The scalar loop below finds the exact position.
+			}
+
+			p += 16;
 		}
+	}
+#endif
 
-		break;
+	if (limit) {
+		while (p < limit && classMember(operand, *p)) {
+			p++;
+		}
+	} else {
+		while (classMember(operand, *p)) {
+			p++;
+		}
+	}
+
+	return p;
+}
 
-	case SPACE_NL: // same as [\n \t\r\f\v]-- matches newline.
-		while (count < max_cmp && isspace(*input_str) && !atEndOfString(input_str)) {
+//------------------------------------------------------------------------------
+// Name: withinBudget
+// Desc: Counts a step against the execution budget. The clock and the cancel
+//       flag are only looked at every 'BudgetCheckInterval' steps. Once the
+//       budget is exceeded the search unwinds as if the recursion limit had
+//       been hit.
+//------------------------------------------------------------------------------
+bool RegexMatch::withinBudget() {
 
-			count++;
-			input_str++;
+	if (budgetExceeded_) {
+		return false;
+	}
+
+	++budgetSteps_;
+
+	bool exceeded = (budget_->steps != 0 && budgetSteps_ > budget_->steps);
+
+	if (!exceeded && budgetSteps_ % BudgetCheckInterval == 0) {
+		exceeded = (budget_->cancel && budget_->cancel->load(std::memory_order_relaxed)) ||
+		           (budget_->milliseconds != 0 && std::chrono::steady_clock::now() >= deadline_);
+	}
+
+	if (exceeded) {
+		budgetExceeded_          = true;
+		Recursion_Limit_Exceeded = true;
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: findChar
+// Desc: Returns the first position from 'p' on that holds 'c', or where the
+//       search has to stop: 'end', the logical end of the input or a '\0'.
+//       Uses memchr wherever the extent of the text is known.
+//------------------------------------------------------------------------------
+const char *RegexMatch::findChar(const char *p, const char *end, char c) const {
+
+	const char *limit = (end && (!endOfString || end < endOfString)) ? end : endOfString;
+
+	if (!limit) {
+		while (*p != c && *p != '\0') {
+			p = advance(p);
 		}
 
-		break;
+		return p;
+	}
 
-	case NOT_SPACE: // same as [^\n \t\r\f\v]-- doesn't match newline.
-		while (count < max_cmp && !isspace(*input_str) && !atEndOfString(input_str)) {
+	while (p < limit) {
+		const char *const segmentEnd = (gapStart_ && p < gapStart_ && gapStart_ < limit) ? gapStart_ : limit;
+		const size_t length          = segmentEnd - p;
 
-			count++;
-			input_str++;
+		auto found = static_cast<const char *>(memchr(p, c, length));
+
+		// The input ends early if it holds a '\0'.
+		auto nul = static_cast<const char *>(memchr(p, '\0', found ? found - p : length));
+		if (nul) {
+			return nul;
 		}
 
-		break;
+		if (found) {
+			return found;
+		}
 
-	case NOT_SPACE_NL: // same as [^ \t\r\f\v]-- matches newline.
-		while (count < max_cmp && (!isspace(*input_str) || *input_str == '\n') && !atEndOfString(input_str)) {
+		p = (segmentEnd == gapStart_) ? gapEnd_ : segmentEnd;
+	}
 
-			count++;
-			input_str++;
+	return limit;
+}
+
+//------------------------------------------------------------------------------
+// Name: findCharBackward
+// Desc: Returns the last position from 'p' back to 'start' that holds 'c', or
+//       NULL if there is none (or 'p' is before 'start').
+//------------------------------------------------------------------------------
+const char *RegexMatch::findCharBackward(const char *p, const char *start, char c) const {
+
+	if (p < start) {
+		return nullptr;
+	}
+
+	// The text after the gap first, then the text before it.
+	if (gapStart_ && p >= gapEnd_ && start < gapStart_) {
+		if (const char *found = scanBackward(p, gapEnd_, c)) {
+			return found;
 		}
 
-		break;
+		p = gapStart_ - 1;
+	}
 
-	case LETTER: // same as [a-zA-Z]
-		while (count < max_cmp && isalpha(*input_str) && !atEndOfString(input_str)) {
+	return scanBackward(p, start, c);
+}
 
-			count++;
-			input_str++;
+//------------------------------------------------------------------------------
+// Name: scanBackward
+// Desc: findCharBackward() within contiguous text, 16 characters at a time
+//       where SSE2 is available.
+//------------------------------------------------------------------------------
+const char *RegexMatch::scanBackward(const char *p, const char *start, char c) const {
+
+#ifdef REGEX_HAVE_SSE2
+	const __m128i cc = _mm_set1_epi8(c);
+
+	while (p - start >= 15) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p - 15));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, cc)) != 0) {
+			break; // The scalar loop below finds the exact position.
 		}
 
-		break;
+		p -= 16;
+	}
+#endif
 
-	case NOT_LETTER: // same as [^a-zA-Z]
-		while (count < max_cmp && !isalpha(*input_str) && *input_str != '\n' && !atEndOfString(input_str)) {
+	for (; p >= start; --p) {
+		if (*p == c) {
+			return p;
+		}
+	}
 
-			count++;
-			input_str++;
+	return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Name: findFirstChar
+// Desc: Returns the first position from 'p' on that holds a character a match
+//       can start with, or where the search has to stop: 'end', the logical
+//       end of the input or a '\0'.
+//------------------------------------------------------------------------------
+const char *RegexMatch::findFirstChar(const char *p, const char *end) const {
+
+	const char *limit = (end && (!endOfString || end < endOfString)) ? end : endOfString;
+
+	if (!limit) {
+		while (*p != '\0' && !classMember(regex_->first_chars_, *p)) {
+			p = advance(p);
 		}
 
-		break;
+		return p;
+	}
 
-	default:
-		/* Called inappropriately.  Only atoms that are SIMPLE should
-		    generate a call to greedy.  The above cases should cover
-		    all the atoms that are SIMPLE. */
+	while (p < limit) {
+		const char *const segmentEnd = (gapStart_ && p < gapStart_ && gapStart_ < limit) ? gapStart_ : limit;
+		const char *const found      = scanFirstChar(p, segmentEnd);
 
-		qDebug("internal error #10 'greedy'");
-		count = 0U; // Best we can do.
+		if (found != segmentEnd) {
+			return found;
+		}
+
+		p = (segmentEnd == gapStart_) ? gapEnd_ : segmentEnd;
 	}
 
-	// Point to character just after last matched character.
+	return limit;
+}
 
-	input = input_str;
+//------------------------------------------------------------------------------
+// Name: scanFirstChar
+// Desc: findFirstChar() within contiguous text ending at 'limit'. When a match
+//       can only start with a few characters, as a case insensitive literal
+//       can, 16 characters at a time are compared against all of them.
+//------------------------------------------------------------------------------
+const char *RegexMatch::scanFirstChar(const char *p, const char *limit) const {
+
+	const prog_type *const chars = regex_->first_char_list_;
+
+#ifdef REGEX_HAVE_SSE2
+	if (chars[0] != 0) {
+		const __m128i c0 = _mm_set1_epi8(static_cast<char>(chars[1]));
+		const __m128i c1 = _mm_set1_epi8(static_cast<char>(chars[chars[0] > 1 ? 2 : 1]));
+		const __m128i c2 = _mm_set1_epi8(static_cast<char>(chars[chars[0] > 2 ? 3 : 1]));
+		const __m128i c3 = _mm_set1_epi8(static_cast<char>(chars[chars[0] > 3 ? 4 : 1]));
+		const __m128i nul = _mm_setzero_si128();
+
+		while (limit - p >= 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			const __m128i m = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+			                                            _mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3))),
+			                               _mm_cmpeq_epi8(v, nul));
+
+			if (_mm_movemask_epi8(m) != 0) {
+				break; // The scalar loop below finds the exact position.
+			}
 
-	return count;
+			p += 16;
+		}
+	}
+#endif
+
+	while (p < limit && *p != '\0' && !classMember(regex_->first_chars_, *p)) {
+		p++;
+	}
+
+	return p;
 }
 
 //------------------------------------------------------------------------------
@@ -4,25 +4,76 @@
 
 #include "Types.h"
 #include "RegexCommon.h"
+#include "RegexProfile.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 enum class Direction {
 	Backward, Forward
 };
 
+/* Controls the failure memoization of the backtracking matcher. A memoized
+   match remembers every (program node, input offset) pair that is known not
+   to match, which bounds the work per 'ExecRE' call to
+   O(program size * input window) at the price of a bitset of that size. */
+enum class Memoization {
+	Off,    // Plain backtracking, bounded only by the recursion limit.
+	Auto,   // Switch memoization on once an attempt runs suspiciously long.
+	Always  // Memoize from the first step.
+};
+
 struct Capture {
 	const char *start;
 	const char *end;
 };
 
+/* Text kept in two pieces of one block of memory, like the two sides of a
+   gap buffer: the text before the gap ends just before 'start' and carries on
+   at 'end'. The matcher steps over the gap, so such text is searched in place.
+   Positions passed to or reported by 'ExecRE' never point into the gap, the
+   position at the gap is 'end'. */
+struct TextGap {
+	const char *start;
+	const char *end;
+};
+
+/* Bounds the work a single search may do, so that a long search on the UI
+   thread can give way to the event loop. Zero means no limit. */
+struct ExecBudget {
+	ExecBudget() : steps(0), milliseconds(0), cancel(nullptr) {
+	}
+
+	unsigned long            steps;        // Matcher steps, roughly one per node tried.
+	unsigned long            milliseconds; // Wall clock time.
+	const std::atomic<bool> *cancel;       // Stops the search once set, from any thread (may be NULL).
+};
+
+enum class ExecStatus {
+	Matched,
+	NoMatch,
+	BudgetExceeded, // Stopped early, whether there is a match is not known.
+	NoProgress      // Stopped early where the search started, trying a match there alone takes more than the budget.
+};
+
 class Regex;
 
 class RegexMatch {
 	friend class Regex;
+	friend class RegexIterator;
 public:
 	static const int MaxBackRefs = 10;
 
+	/* Capture pointers and {m,n} counters kept inside the object, enough for
+	   the whole match plus a few groups. Programs that need more get them
+	   from the heap. */
+	static const size_t InlineSlots       = 8;
+	static const size_t InlineBraceCounts = 2;
+
 public:
-	explicit RegexMatch(Regex *regex);
+	explicit RegexMatch(const Regex *regex);
 	~RegexMatch();
 	
 private:
@@ -40,10 +91,12 @@ private:
 	 * @param delimiters - Word delimiters to use (NULL for default)
 	 * @param look_behind_to - Boundary for look-behind; defaults to "string" if NULL
 	 * @param match_till - Boundary to where match can extend. \0 is assumed to be the boundary if not set. Lookahead can cross the boundary.
+	 * @param gap - Gap in the text, NULL if it is contiguous.
+	 * @param budget - Limits on the work done, NULL for none.
 	 * @return
 	 */
 	bool ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char,
-	           const char *delimiters, const char *look_behind_to, const char *match_till);
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap, const ExecBudget *budget);
 
 public:	   
 	/**
@@ -53,25 +106,63 @@ public:
 	 * @param max
 	 * @return
 	 */
-	bool SubstituteRE(const char *source, char *dest, const int max);			   
+	bool SubstituteRE(const char *source, char *dest, const int max) const;
+
+	/**
+	 * @brief SubstituteRE - Perform substitutions after a 'regexp' match, appending them to 'dest'.
+	 * @param source
+	 * @param dest
+	 * @return
+	 */
+	bool SubstituteRE(const char *source, std::string *dest) const;
 
 public:
 	int top_branch() const {
 		return top_branch_;
 	}
 	
+	// Groups the program does not have never match.
 	Capture capture(int index) const {
 		Capture cap;
-		cap.start = startp_[index];
-		cap.end   = endp_[index];
+		if (static_cast<size_t>(index) <= Total_Paren) {
+			cap.start = startp_[index];
+			cap.end   = endp_[index];
+		} else {
+			cap.start = nullptr;
+			cap.end   = nullptr;
+		}
 		return cap;
 	}
 
 private:
 	int match(prog_type *prog, int *branch_index_param);
+	int matchNode(prog_type *prog, int *branch_index_param);
+	int matchAfterGroup(prog_type *next, uint64_t captured);
+	uint64_t uncapturedGroups() const;
+	uint64_t capturedSince(uint64_t uncaptured) const;
+	void dropCaptures(uint64_t groups);
+	bool matchSimpleBehind(prog_type *node, const char *p) const;
 	bool attempt(const char *string);
+	void enableMemo(const char *string);
+	void rebaseMemo(const char *string);
 	unsigned long greedy(prog_type *p, long max);
+	const char *scanClass(const char *p, const prog_type *operand, unsigned long max) const;
+	const char *scanRun(const char *p, const prog_type *operand, unsigned long max, const char *limit) const;
+	const char *findChar(const char *p, const char *end, char c) const;
+	const char *findCharBackward(const char *p, const char *start, char c) const;
+	const char *scanBackward(const char *p, const char *start, char c) const;
+	const char *findFirstChar(const char *p, const char *end) const;
+	const char *scanFirstChar(const char *p, const char *limit) const;
 	bool atEndOfString(const char *p) const;
+	bool withinBudget();
+	const char *skipTo(const char *from, const char *to);
+
+	// Moving through the input, stepping over the gap.
+	const char *advance(const char *p) const;
+	const char *advance(const char *p, size_t n) const;
+	const char *retreat(const char *p) const;
+	const char *retreat(const char *p, size_t n) const;
+	size_t distance(const char *from, const char *to) const;
 
 private:
 	const Regex *const regex_;
@@ -81,23 +172,29 @@ private:
 	const char *startOfString;               // Beginning of input, for ^ and < checks.
 	const char *endOfString;                 // Logical end of input (if supplied, till \0 otherwise)
 	const char *lookBehindTo;                // Position till were look behind can safely check back
+	const char *gapStart_;                   // Gap in the input (see 'TextGap'),
+	const char *gapEnd_;                     // both NULL if there is none.
 	const char **Start_Ptr_Ptr;              // Pointer to 'startp' array.
 	const char **End_Ptr_Ptr;                // Ditto for 'endp'.
 	const char *Extent_Ptr_FW;               // Forward extent pointer
 	const char *Extent_Ptr_BW;               // Backward extent pointer
-	const char *Back_Ref_Start[MaxBackRefs]; // Back_Ref_Start [0] and
-	const char *Back_Ref_End[MaxBackRefs];   // Back_Ref_End [0] are not used. This simplifies indexing.
+	const char **Back_Ref_Start;             // Back_Ref_Start [0] and
+	const char **Back_Ref_End;               // Back_Ref_End [0] are not used. This simplifies indexing.
+	size_t       numBackRefs_;               // Entries in each, none unless the program has back-references.
 
 	bool prevIsBOL;
 	bool succIsEOL;
 	bool prevIsDelim;
 	bool succIsDelim;
 
-	uint32_t *brace_counts_;
+	uint32_t *brace_counts_;           // {m,n} counters, inline when they fit.
 	int       recursion_count_;        // Recursion counter
 
-	const char *    startp_[NSUBEXP]; // Captured text starting locations.
-	const char *    endp_[NSUBEXP];   // Captured text ending locations.
+	const char **   startp_;          // Captured text starting locations, Total_Paren + 1 of them.
+	const char **   endp_;            // Captured text ending locations.
+	const char **   slots_;           // Storage of the above and the back-reference pointers,
+	const char *    inlineSlots_[InlineSlots]; // inline when they fit.
+	uint32_t        inlineBraceCounts_[InlineBraceCounts];
 
 	const char *    extentpBW_;       // Points to the maximum extent of text scanned by ExecRE in front of the string to achieve a
 	                                  // match (needed because of positive look-behind.)
@@ -107,11 +204,37 @@ private:
 	int             top_branch_;      // Zero-based index of the top branch that matches. Used by syntax highlighting only.
 
 	bool            Recursion_Limit_Exceeded; // Recursion limit exceeded flag
+	bool            captures_;        // Record capturing parentheses, off when only the extent of matches is wanted.
+	
+	// Failure memoization, see 'Memoization'.
+	std::vector<uint64_t> memo_;      // One bit per (node, input offset) known not to match.
+	const char *    memoWindowStart_; // Input window that may be memoized...
+	const char *    memoWindowEnd_;
+	const char *    memoBase_;        // ...and the part of it the bitset currently covers.
+	size_t          memoSpan_;
+	size_t          memoProgSize_;
+	unsigned long   steps_;           // match() calls in the current attempt.
+	int             lookBehindDepth_; // Look-behind bodies run with a moved string end and are never memoized.
+	Memoization     memoMode_;        // Effective mode, Off if the program can't be memoized.
+	bool            memoActive_;
+	bool            memoTriggered_;   // Auto mode had to switch memoization on.
+
+	// Execution budget, see 'ExecBudget'. Running out of it stops the search like the recursion limit does.
+	const ExecBudget *budget_;        // NULL if the search is not limited.
+	unsigned long   budgetSteps_;
+	std::chrono::steady_clock::time_point deadline_;
+	bool            budgetExceeded_;
+	const char *    attemptStart_;    // Where the latest attempt() started.
 	bool *          Current_Delimiters;       // Current delimiter table
+	const char *    caseFold_;                // tolower() table, see caseFoldTable().
 	
 	size_t          Total_Paren; // Parentheses, (),  counter.
 	size_t          Num_Braces;  // Number of general {m,n} constructs. {m,n} quantifiers of SIMPLE atoms are not included in this
 	                             // count.	
+
+#ifdef REGEX_PROFILE
+	RegexProfile    profile_;    // Counts of the latest search, added to the Regex's afterwards.
+#endif
 };
 
 #endif
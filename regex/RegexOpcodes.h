@@ -37,6 +37,8 @@ enum RegexOpcodes : uint8_t {
 
 	EXACTLY = 7,  // Match this string.
 	SIMILAR = 8,  // Match this case insensitive string
+
+	// Op codes with character class bitmap operands.
 	ANY_OF = 9,   // Match any character in the set.
 	ANY_BUT = 10, // Match any character not in the set.
 
@@ -92,7 +94,19 @@ enum RegexOpcodes : uint8_t {
 	NEG_BEHIND_OPEN = 47,   // Begin negative look behind
 	LOOK_BEHIND_CLOSE = 48, // Close look behind
 
-	OPEN = 49, // Open for capturing parentheses.
+	// Constructs that keep what they matched, never backtracking into it.
+	ATOMIC_OPEN = 49,         // Begin atomic group
+	ATOMIC_CLOSE = 50,        // End atomic group
+	POSSESSIVE_STAR = 51,     // STAR that gives nothing back
+	POSSESSIVE_QUESTION = 52, // QUESTION that gives nothing back
+	POSSESSIVE_PLUS = 53,     // PLUS that gives nothing back
+	POSSESSIVE_BRACE = 54,    // BRACE that gives nothing back
+
+	// Look behind of a fixed length plain sequence of characters, compared in place.
+	POS_BEHIND_SIMPLE = 55, // POS_BEHIND_OPEN, simple form
+	NEG_BEHIND_SIMPLE = 56, // NEG_BEHIND_OPEN, simple form
+
+	OPEN = 57, // Open for capturing parentheses.
 
 	//  OPEN+1 is number 1, etc.
 	CLOSE = (OPEN + NSUBEXP), // Close for capturing parentheses.
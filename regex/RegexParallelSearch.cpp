@@ -0,0 +1,184 @@
+
+#include "RegexParallelSearch.h"
+#include "RegexIterator.h"
+#include "RegexException.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// How far past a chunk boundary to look for the start of a line.
+const size_t MaxLineSearch = 64 * 1024;
+
+/* Logical positions in a text that may continue after a gap. Position
+   'size()' is the end of the text, the position at the gap is the first
+   character after it. */
+class TextPositions {
+public:
+	TextPositions(const char *string, const char *end, const TextGap *gap) : head_(string), tail_(nullptr), headSize_(end - string), size_(end - string) {
+		if (gap && gap->start != gap->end && string < gap->start && end >= gap->end) {
+			tail_     = gap->end;
+			headSize_ = gap->start - string;
+			size_     = headSize_ + (end - gap->end);
+		}
+	}
+
+public:
+	size_t size() const {
+		return size_;
+	}
+
+	const char *at(size_t pos) const {
+		return (tail_ && pos >= headSize_) ? tail_ + (pos - headSize_) : head_ + pos;
+	}
+
+	size_t offsetOf(const char *p) const {
+		return (tail_ && p >= tail_) ? headSize_ + (p - tail_) : p - head_;
+	}
+
+	// The position following the first newline at or after 'pos', or 'pos' if there is none close by.
+	size_t lineStart(size_t pos) const {
+		const size_t limit = std::min(size_, pos + MaxLineSearch);
+
+		for (size_t p = pos; p < limit;) {
+			const size_t segmentEnd = (tail_ && p < headSize_) ? std::min(limit, headSize_) : limit;
+
+			if (auto newline = static_cast<const char *>(memchr(at(p), '\n', segmentEnd - p))) {
+				return p + (newline - at(p)) + 1;
+			}
+
+			p = segmentEnd;
+		}
+
+		return pos;
+	}
+
+private:
+	const char *head_;
+	const char *tail_;
+	size_t      headSize_;
+	size_t      size_;
+};
+
+}
+
+//------------------------------------------------------------------------------
+// Name: FindAll
+//------------------------------------------------------------------------------
+std::vector<Capture> RegexParallelSearch::FindAll(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap, unsigned threads) {
+
+	if (!string || !end) {
+		throw RegexException("NULL argument, 'FindAll'");
+	}
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	const TextPositions text(string, end, gap);
+	const char *const lookBehindTo = look_behind_to ? look_behind_to : string;
+
+	// Character before a position, the text before the range for the first one.
+	auto charBefore = [&](size_t pos) {
+		return pos == 0 ? prev_char : *text.at(pos - 1);
+	};
+
+	auto search = [&](size_t from, size_t to, std::vector<Capture> *matches) {
+		RegexIterator it(regex, text.at(from), text.at(to), charBefore(from), succ_char, delimiters, lookBehindTo, match_till, gap);
+		it.SetRecordCaptures(false);
+
+		while (it.Next()) {
+			matches->push_back(it.Match().capture(0));
+		}
+	};
+
+	// Cut the text into chunks, each starting at the beginning of a line if possible.
+	const size_t chunkCount = std::min<size_t>(threads * ChunksPerThread, text.size() / MinChunkSize);
+
+	std::vector<size_t> bounds(1, 0);
+	for (size_t i = 1; i < chunkCount; ++i) {
+		const size_t pos = text.lineStart(text.size() / chunkCount * i);
+		if (pos > bounds.back() && pos < text.size()) {
+			bounds.push_back(pos);
+		}
+	}
+	bounds.push_back(text.size());
+
+	const size_t chunks = bounds.size() - 1;
+
+	std::vector<std::vector<Capture>> found(chunks);
+
+	if (chunks == 1) {
+		search(0, text.size(), &found[0]);
+		return std::move(found[0]);
+	}
+
+	// Threads take the next unsearched chunk until all are done.
+	std::atomic<size_t> nextChunk(0);
+
+	auto worker = [&]() {
+		for (size_t i; (i = nextChunk++) < chunks;) {
+			search(bounds[i], bounds[i + 1], &found[i]);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < std::min<size_t>(threads, chunks); ++i) {
+		pool.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread &thread : pool) {
+		thread.join();
+	}
+
+	// Merge in order, searching again where a match spilled over into the next chunk.
+	size_t total = 0;
+	for (const std::vector<Capture> &chunk : found) {
+		total += chunk.size();
+	}
+
+	std::vector<Capture> matches = std::move(found[0]);
+	matches.reserve(total);
+
+	// Positions after a gap compare greater than those before it.
+	auto startsBefore = [](const Capture &match, const char *start) {
+		return match.start < start;
+	};
+
+	for (size_t i = 1; i < chunks; ++i) {
+		const std::vector<Capture> &chunk = found[i];
+
+		if (matches.empty() || matches.back().end <= text.at(bounds[i])) {
+			matches.insert(matches.end(), chunk.begin(), chunk.end());
+			continue;
+		}
+
+		// The chunk's own search started inside the last match, carry on where that ended instead.
+		const size_t resume = text.offsetOf(matches.back().end);
+		if (resume >= bounds[i + 1]) {
+			continue;
+		}
+
+		RegexIterator it(regex, text.at(resume), text.at(bounds[i + 1]), charBefore(resume), succ_char, delimiters, lookBehindTo, match_till, gap);
+		it.SetRecordCaptures(false);
+
+		while (it.Next()) {
+			const Capture match = it.Match().capture(0);
+
+			// Once both searches agree on a match, they agree on all that follow.
+			auto same = std::lower_bound(chunk.begin(), chunk.end(), match.start, startsBefore);
+			if (same != chunk.end() && same->start == match.start && same->end == match.end) {
+				matches.insert(matches.end(), same, chunk.end());
+				break;
+			}
+
+			matches.push_back(match);
+		}
+	}
+
+	return matches;
+}
@@ -0,0 +1,40 @@
+
+#ifndef REGEX_PARALLEL_SEARCH_H_
+#define REGEX_PARALLEL_SEARCH_H_
+
+#include "RegexMatch.h"
+#include <cstddef>
+#include <vector>
+
+class Regex;
+
+/* Finds all non-overlapping matches of an expression over a large text on
+   several threads. The text is cut into chunks at line starts and every
+   chunk is searched by a RegexIterator of its own, seeing the whole text for
+   look-behind, look-ahead and matches that run past the end of the chunk.
+   The chunk results are merged in order: where a match runs over into the
+   next chunk, the merge searches on from its end until it meets a match that
+   chunk found as well, from there on both searches agree. The result is
+   exactly what a single RegexIterator over the whole text reports. Matches
+   that tile the text, say fixed length runs of any character, may never
+   meet those of the next chunk and leave the merge to redo its search. */
+class RegexParallelSearch {
+public:
+	// Texts are not split into chunks smaller than this.
+	static const size_t MinChunkSize = 1024 * 1024;
+
+	// Chunks per thread, so that threads finishing early can help out.
+	static const size_t ChunksPerThread = 4;
+
+public:
+	/**
+	 * @brief FindAll - Finds the non-overlapping matches over a range, see Regex::ExecRE for the parameters.
+	 * @param end - Pointer to the end of 'string', must not be NULL.
+	 * @param threads - Number of threads to search on, 0 for one per hardware thread.
+	 * @return the extent of every match in order. Capturing parentheses are not recorded.
+	 */
+	static std::vector<Capture> FindAll(const Regex &regex, const char *string, const char *end, char prev_char, char succ_char,
+	           const char *delimiters, const char *look_behind_to, const char *match_till, const TextGap *gap = nullptr, unsigned threads = 0);
+};
+
+#endif
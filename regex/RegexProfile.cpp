@@ -0,0 +1,60 @@
+
+#include "RegexProfile.h"
+#include "RegexOpcodes.h"
+#include <algorithm>
+#include <numeric>
+
+static_assert(RegexProfile::NodeKinds == OPEN + 2, "RegexProfile::NodeKinds out of step with RegexOpcodes");
+
+namespace {
+
+// Indexed by opcode, the last two are the capturing parentheses.
+const char *const NodeNames[RegexProfile::NodeKinds] = {
+	"(unknown)", "END", "BOL", "EOL", "BOWORD", "EOWORD", "NOT_BOUNDARY", "EXACTLY", "SIMILAR", "ANY_OF", "ANY_BUT",
+	"ANY", "EVERY", "DIGIT", "NOT_DIGIT", "LETTER", "NOT_LETTER", "SPACE", "SPACE_NL", "NOT_SPACE", "NOT_SPACE_NL",
+	"WORD_CHAR", "NOT_WORD_CHAR", "IS_DELIM", "NOT_DELIM", "STAR", "LAZY_STAR", "QUESTION", "LAZY_QUESTION", "PLUS",
+	"LAZY_PLUS", "BRACE", "LAZY_BRACE", "NOTHING", "BRANCH", "BACK", "INIT_COUNT", "INC_COUNT", "TEST_COUNT",
+	"BACK_REF", "BACK_REF_CI", "X_REGEX_BR", "X_REGEX_BR_CI", "POS_AHEAD_OPEN", "NEG_AHEAD_OPEN", "LOOK_AHEAD_CLOSE",
+	"POS_BEHIND_OPEN", "NEG_BEHIND_OPEN", "LOOK_BEHIND_CLOSE", "ATOMIC_OPEN", "ATOMIC_CLOSE", "POSSESSIVE_STAR",
+	"POSSESSIVE_QUESTION", "POSSESSIVE_PLUS", "POSSESSIVE_BRACE", "POS_BEHIND_SIMPLE", "NEG_BEHIND_SIMPLE", "OPEN",
+	"CLOSE"
+};
+
+}
+
+//------------------------------------------------------------------------------
+// Name: RegexProfile
+//------------------------------------------------------------------------------
+RegexProfile::RegexProfile() : searches(0), nanoseconds(0), attempts(0), prefilterSkips(0), backtracks(0), recursionLimits(0) {
+	std::fill_n(nodes, NodeKinds, 0);
+}
+
+//------------------------------------------------------------------------------
+// Name: Add
+//------------------------------------------------------------------------------
+void RegexProfile::Add(const RegexProfile &other) {
+	searches        += other.searches;
+	nanoseconds     += other.nanoseconds;
+	attempts        += other.attempts;
+	prefilterSkips  += other.prefilterSkips;
+	backtracks      += other.backtracks;
+	recursionLimits += other.recursionLimits;
+
+	for (size_t i = 0; i < NodeKinds; ++i) {
+		nodes[i] += other.nodes[i];
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: Nodes
+//------------------------------------------------------------------------------
+uint64_t RegexProfile::Nodes() const {
+	return std::accumulate(nodes, nodes + NodeKinds, uint64_t(0));
+}
+
+//------------------------------------------------------------------------------
+// Name: NodeName
+//------------------------------------------------------------------------------
+const char *RegexProfile::NodeName(size_t kind) {
+	return (kind < NodeKinds) ? NodeNames[kind] : NodeNames[0];
+}
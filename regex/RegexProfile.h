@@ -0,0 +1,40 @@
+
+#ifndef REGEX_PROFILE_H_
+#define REGEX_PROFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/* Counts of the work done by searches, to find out which expression makes
+   highlighting or a search slow. The matcher only keeps them when built
+   with REGEX_PROFILE defined (qmake CONFIG+=regex_profile), the counting is
+   compiled out otherwise and every count stays zero. Each 'Regex' sums the
+   counts of all its searches, see 'Regex::Profile'. */
+struct RegexProfile {
+	/* Node visits are counted per opcode, with all capturing parentheses
+	   counted as one kind of open and one kind of close node. */
+	static const size_t NodeKinds = 59;
+
+public:
+	RegexProfile();
+
+public:
+	void Add(const RegexProfile &other);
+
+	// Node visits of all kinds.
+	uint64_t Nodes() const;
+
+	// Name of a kind of node, for reports.
+	static const char *NodeName(size_t kind);
+
+public:
+	uint64_t searches;              // 'ExecRE' calls.
+	uint64_t nanoseconds;           // Time spent in them.
+	uint64_t attempts;              // Positions a match was tried from.
+	uint64_t prefilterSkips;        // Positions passed over without trying, as no match can start there.
+	uint64_t backtracks;            // Alternatives and repetition counts retried after the rest of the match failed.
+	uint64_t recursionLimits;       // Searches abandoned at the recursion limit.
+	uint64_t nodes[NodeKinds];      // Node visits by kind.
+};
+
+#endif
@@ -0,0 +1,165 @@
+
+#include "RegexSet.h"
+#include "Regex.h"
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+//------------------------------------------------------------------------------
+// Name: Add
+//------------------------------------------------------------------------------
+int RegexSet::Add(const std::shared_ptr<const Regex> &regex) {
+	assert(regex);
+
+	patterns_.push_back(regex);
+	return static_cast<int>(patterns_.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+// Name: Size
+//------------------------------------------------------------------------------
+size_t RegexSet::Size() const {
+	return patterns_.size();
+}
+
+//------------------------------------------------------------------------------
+// Name: Empty
+//------------------------------------------------------------------------------
+bool RegexSet::Empty() const {
+	return patterns_.empty();
+}
+
+//------------------------------------------------------------------------------
+// Name: Pattern
+//------------------------------------------------------------------------------
+const std::shared_ptr<const Regex> &RegexSet::Pattern(int id) const {
+	return patterns_[id];
+}
+
+//------------------------------------------------------------------------------
+// Name: ExecRE
+// Desc: Searches with each expression in turn. A forward search only needs to
+//       find matches that begin before the best one so far, so every
+//       expression after the first searches a shorter stretch of text, and
+//       none is searched at all once a match at 'string' has been found. Each
+//       expression still skips over text with its own start-of-match
+//       optimizations, which an alternation of the expressions loses.
+//------------------------------------------------------------------------------
+RegexMatch* RegexSet::ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_till, int *pattern_id, const TextGap *gap) const {
+
+	std::unique_ptr<RegexMatch> best;
+	int bestId = -1;
+
+	// A bounded search must see the same succ_char an unbounded one assumes.
+	if (end == nullptr && direction == Direction::Forward) {
+		succ_char = '\n';
+	}
+
+	for (size_t id = 0; id < patterns_.size(); id++) {
+
+		const char *limit = end;
+
+		if (best && direction == Direction::Forward) {
+			limit = best->capture(0).start;
+			if (limit == string) {
+				break;
+			}
+		}
+
+		std::unique_ptr<RegexMatch> match(patterns_[id]->ExecRE(string, limit, direction, prev_char, succ_char, delimiters, look_behind_to, match_till, gap));
+		if (!match) {
+			continue;
+		}
+
+		// Ties go to the expression added first.
+		const char *start = match->capture(0).start;
+		if (!best || (direction == Direction::Forward ? start < best->capture(0).start : start > best->capture(0).start)) {
+			best   = std::move(match);
+			bestId = static_cast<int>(id);
+		}
+	}
+
+	if (pattern_id) {
+		*pattern_id = bestId;
+	}
+
+	return best.release();
+}
+
+//------------------------------------------------------------------------------
+// Name: ExecRE
+// Desc: Finds the same match as the search above, but keeps for each
+//       expression the stretch it has searched and the match it found
+//       there. An expression whose last match is still ahead of 'string' is
+//       not searched at all, one that found nothing before the best match of
+//       the set is searched on from where it stopped, so each expression
+//       reads the text about once however many times the set is searched.
+//------------------------------------------------------------------------------
+RegexMatch* RegexSet::ExecRE(const char *string, const char *end, char prev_char, char succ_char, const char *delimiters, const char *look_behind_to, const char *match_till, int *pattern_id, Scan *scan) const {
+
+	assert(scan);
+
+	// A bounded search must see the same succ_char an unbounded one assumes.
+	if (end == nullptr) {
+		succ_char = '\n';
+	}
+
+	// What was found in another search of other text, or the same text seen differently, doesn't hold.
+	if (scan->entries_.size() != patterns_.size() || scan->end_ != end || scan->lookBehindTo_ != look_behind_to || scan->matchTill_ != match_till || scan->delimiters_ != delimiters || scan->succChar_ != succ_char) {
+		scan->entries_.clear();
+		scan->entries_.resize(patterns_.size());
+		scan->end_          = end;
+		scan->lookBehindTo_ = look_behind_to;
+		scan->matchTill_    = match_till;
+		scan->delimiters_   = delimiters;
+		scan->succChar_     = succ_char;
+	}
+
+	const char *best = nullptr;
+	int bestId       = -1;
+
+	for (size_t id = 0; id < patterns_.size(); id++) {
+
+		// Ties go to the expression added first.
+		if (best == string) {
+			break;
+		}
+
+		Scan::Entry &entry = scan->entries_[id];
+		const char *const limit = best ? best : end;
+
+		// Behind 'string', it tells nothing.
+		if (!entry.to || entry.from > string || entry.to < string) {
+			entry.from = string;
+			entry.to   = string;
+			entry.match.reset();
+			entry.none = false;
+		}
+
+		if (!entry.match && !entry.none && (!limit || entry.to < limit)) {
+			const char *const from = entry.to;
+			entry.match.reset(patterns_[id]->ExecRE(from, limit, Direction::Forward, (from == string) ? prev_char : from[-1], succ_char, delimiters, look_behind_to, match_till));
+
+			if (entry.match) {
+				entry.to = entry.match->capture(0).start;
+			} else if (limit) {
+				entry.to = limit;
+			} else {
+				entry.to   = from + strlen(from);
+				entry.none = true;
+			}
+		}
+
+		if (entry.match && (!best || entry.to < best)) {
+			best   = entry.to;
+			bestId = static_cast<int>(id);
+		}
+	}
+
+	if (pattern_id) {
+		*pattern_id = bestId;
+	}
+
+	// The caller moves on past it, nothing more is known from there.
+	return (bestId == -1) ? nullptr : scan->entries_[bestId].match.release();
+}
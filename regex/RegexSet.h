@@ -0,0 +1,88 @@
+
+#ifndef REGEX_SET_H_
+#define REGEX_SET_H_
+
+#include "RegexMatch.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Regex;
+
+/* An ordered set of compiled expressions that are searched together, e.g. the
+   end, error and sub-pattern start expressions of a highlight pattern. A
+   search reports the match that begins first in the text (last for a backward
+   search); when several expressions match at that position the one added
+   first wins, as it would in an alternation of them. Unlike an alternation,
+   each expression keeps its own capture numbering and start-of-match
+   optimizations, and nothing has to be recompiled to form the set. */
+class RegexSet {
+public:
+	/* What forward searches of a set have found so far in one text, for a
+	   caller that searches it again and again from further on, as the
+	   highlighter does token by token. Each expression is only searched
+	   again once the caller has moved past the match it found last time,
+	   so a rare expression isn't rescanned to the end of the text for every
+	   token. A scan belongs to one caller (and thread), and to searches with
+	   the same 'end', 'succ_char', delimiters and boundaries. */
+	class Scan {
+		friend class RegexSet;
+
+	public:
+		Scan() : end_(nullptr), lookBehindTo_(nullptr), matchTill_(nullptr), delimiters_(nullptr), succChar_('\0') {
+		}
+
+	private:
+		struct Entry {
+			Entry() : from(nullptr), to(nullptr), none(false) {
+			}
+
+			const char *                from;  // No match starts from here ...
+			const char *                to;    // ... up to here, NULL if not searched.
+			bool                        none;  // Nor anywhere after 'from'.
+			std::unique_ptr<RegexMatch> match; // The one starting at 'to', if known.
+		};
+
+		std::vector<Entry> entries_; // By pattern id.
+		const char *       end_;
+		const char *       lookBehindTo_;
+		const char *       matchTill_;
+		const char *       delimiters_;
+		char               succChar_;
+	};
+
+public:
+	/**
+	 * @brief Add - Appends an expression to the set.
+	 * @param regex - Compiled expression, must not be NULL.
+	 * @return the pattern id searches report when this expression matches.
+	 */
+	int Add(const std::shared_ptr<const Regex> &regex);
+
+	size_t Size() const;
+	bool Empty() const;
+	const std::shared_ptr<const Regex> &Pattern(int id) const;
+
+public:
+	/**
+	 * @brief ExecRE - Match the set against a string, see Regex::ExecRE for the parameters.
+	 * @param pattern_id - Set to the id of the expression that matched (may be NULL).
+	 * @param gap - Gap in the text, NULL if it is contiguous.
+	 * @return the match of that expression, owned by the caller, or NULL if none matched.
+	 */
+	RegexMatch* ExecRE(const char *string, const char *end, Direction direction, char prev_char, char succ_char,
+	           const char *delimiters, const char *look_behind_to, const char *match_till, int *pattern_id, const TextGap *gap = nullptr) const;
+
+	/**
+	 * @brief ExecRE - Match the set forward against a contiguous string, reusing what earlier searches in 'scan' found.
+	 * @param scan - State of the searches of this text so far, see Scan.
+	 * @return the match, owned by the caller, or NULL if none matched.
+	 */
+	RegexMatch* ExecRE(const char *string, const char *end, char prev_char, char succ_char, const char *delimiters,
+	           const char *look_behind_to, const char *match_till, int *pattern_id, Scan *scan) const;
+
+private:
+	std::vector<std::shared_ptr<const Regex>> patterns_;
+};
+
+#endif
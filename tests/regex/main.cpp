@@ -0,0 +1,392 @@
+/*
+ * Regex engine regression driver: runs fixed expressions over fixed texts
+ * and compares what they find, so that changes to the matcher which should
+ * only make it faster can be checked not to change its results.
+ *
+ *   - Known cases: the match and captures of one search, with and without
+ *     memoization, against the expected result.
+ *   - Prefilters: every match, front to back and back to front, of
+ *     expressions the first character set, the match start character, line
+ *     skipping and the simple look-behind apply to, against the same
+ *     expression written so that none of them applies.
+ *   - Equivalents: every match of atomic groups, possessive and counted
+ *     quantifiers against equivalent expressions without them.
+ *   - Memoization: the match and captures of a generated corpus of
+ *     expressions with groups inside look-arounds, atomic groups and
+ *     repetitions, with memoization off and always on.
+ *
+ * Each difference is printed, and the exit status is 1 if there were any.
+ *
+ * usage: regex-regress [--verbose]
+ */
+
+#include "regex/Regex.h"
+#include "regex/RegexException.h"
+#include "regex/RegexMatch.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Case {
+	const char *pattern;
+	const char *text;
+	const char *expected; // Captures as "group:start,end ...", "none" if nothing matches.
+};
+
+struct Equivalent {
+	const char *pattern;
+	const char *reference;
+};
+
+/* Searches whose results were wrong at some point. */
+const Case KnownCases[] = {
+	// Lazy quantifiers resume from their last match, also inside counted groups.
+	{ "[^\"]*?\"",                                     "abc\"d",                 "0:0,4"                              },
+	{ "a(b|c)*?d",                                     "abcbd",                  "0:0,5 1:3,4"                        },
+	{ "(\\wab*?){2,}",                                 "babz",                   "none"                               },
+	{ "(\\wab*?){2,}",                                 "ababz",                  "none"                               },
+	{ "(\\wab*?){2,}",                                 "babab",                  "0:0,4 1:2,4"                        },
+	{ "(ab*?){2}c",                                    "abbac",                  "0:0,5 1:3,4"                        },
+	{ "(a|ab){2}c",                                    "aabc",                   "0:0,4 1:1,3"                        },
+	{ "(?:a|b){0,2}?c",                                "bbbczzbz",               "0:1,4"                              },
+	{ "((?:\\w){0,2}?)c",                              "bbbazzc",                "0:4,7 1:4,6"                        },
+	{ "(ab){0,2}?c",                                   "ababc",                  "0:0,5 1:2,4"                        },
+	{ "((ab){2}c){2}",                                 "ababcababc",             "0:0,10 1:5,10 2:7,9"                },
+
+	// Groups inside look-arounds only capture on the path that matched.
+	{ "((\\w+?)(?=(a)))?(?=.*(c))(b+)",                "ccccbbcabb",             "0:4,6 4:6,7 5:4,6"                  },
+	{ "(?=(a))ab|(b)",                                 "acb",                    "0:2,3 2:2,3"                        },
+	{ "(?!(a)b)\\w",                                   "abac",                   "0:1,2"                              },
+	{ "(?<=(a))b|c",                                   "cab",                    "0:0,1"                              },
+	{ "x(?=(a+))a*b|xa",                               "xaac",                   "0:0,2"                              },
+	{ "a*?((?=.*(c))(b))*?(?>(a|ab))?(a|b)((b+)b)+?",  "acaaabaaabbcbbaa",       "0:6,11 4:7,8 5:8,9 6:9,11 7:9,10"   },
+	{ "(a*)(((a|b)+)(?=(b)a))?((b)(?=(b)a))(\\w+?)*?", "accbcbabbbba",           "0:9,10 1:9,9 6:9,10 7:9,10 8:10,11" },
+	{ "((\\w+?)(b+))((?=(a))(?=.*(c)))|a+?",           "baabbababaab",           "0:1,2"                              },
+	{ "((\\w+?)(?=a(b)))?(?>(a|ab))((a|b)+)+(\\w+?)",  "bacacaab",               "0:5,8 4:5,6 5:6,7 6:6,7 7:7,8"      },
+
+	// Atomic groups and possessive quantifiers don't give back what they matched.
+	{ "(?>a|ab)c",                                     "abc",                    "none"                               },
+	{ "a*+a",                                          "aaa",                    "none"                               },
+	{ "\"[^\"]*+\"",                                   "x \"ab\" y",             "0:2,6"                              },
+
+	// The prefilters.
+	{ "^#include",                                     "x\n #include\n#include", "0:12,20"                            },
+	{ "(?<=ab)c",                                      "acbcabc",                "0:6,7"                              },
+	{ "(?<!ab)c",                                      "abcbc",                  "0:4,5"                              },
+	{ "<(if|else)>",                                   "elsif else",             "0:6,10 1:6,10"                      },
+};
+
+/* Expressions the search prefilters apply to. Each is checked against itself
+   behind a look-ahead that always holds, which none of them look through. */
+const char *const Prefiltered[] = {
+	"return",
+	"#include",
+	"^#include",
+	"^\\s*#\\s*include",
+	"^.*;$",
+	"<(if|else|while|for)>",
+	"[A-Za-z_][A-Za-z0-9_]*",
+	"[0-9]+(\\.[0-9]+)?",
+	"x+y",
+	"x+?y",
+	"(?:ab|cd)e*",
+	"(?<=ab)c",
+	"(?<!ab)c",
+	"(?<=\\w)\\d+",
+	"(?<=[a-z][0-9])x",
+	"\\s+$",
+	"\"([^\"\\\\]|\\\\.)*\"",
+	"/\\*.*?\\*/",
+	"a?b*c",
+	"(?>ab|a)c",
+};
+
+/* Pairs of expressions that must find the same matches. */
+const Equivalent Equivalents[] = {
+	// Simple look-behinds against look-behinds that can't be compared directly.
+	{ "(?<=ab)c",                  "(?<=ab|ab)c"                        },
+	{ "(?<!ab)c",                  "(?<!ab|ab)c"                        },
+	{ "(?<=\\d\\w)x",              "(?<=\\d\\w|\\d\\w)x"                },
+
+	// Atomic and possessive forms against a look-ahead whose capture is taken.
+	{ "(?>a|ab)c",                 "(?=(a|ab))\\1c"                     },
+	{ "(?>a+)b",                   "(?=(a+))\\1b"                       },
+	{ "a*+b",                      "(?=(a*))\\1b"                       },
+	{ "a++a",                      "(?=(a+))\\1a"                       },
+	{ "[^\"]*+\"",                 "(?=([^\"]*))\\1\""                  },
+	{ "\\w?+\\d",                  "(?=(\\w?))\\1\\d"                   },
+	{ "(?:ab|a){2}+b",             "(?=((?:ab|a){2}))\\1b"              },
+	{ "\"(?>[^\"\\\\]+|\\\\.)*+\"", "\"(?=((?:(?=([^\"\\\\]+))\\2|\\\\.)*))\\1\"" },
+
+	// Counted groups against the group written out.
+	{ "(?:\\wab*?){2,3}",          "\\wab*?\\wab*?(?:\\wab*?)?"           },
+	{ "(?:\\wab*?){2,3}?z",        "\\wab*?\\wab*?(?:\\wab*?)??z"         },
+	{ "(?:a|ab){2}c",              "(?:a|ab)(?:a|ab)c"                    },
+	{ "(?:a|b){0,2}?c",            "(?:(?:a|b)(?:a|b)?\?)?\?c"            },
+	{ "(?:ab*?){1,3}?b",           "(?:ab*?)(?:(?:ab*?)(?:ab*?)?\?)?\?b"  },
+	{ "(?:a+?b){1,2}",             "(?:a+?b)(?:a+?b)?"                    },
+};
+
+/* Texts every prefilter and equivalence check searches. */
+const char *const Texts[] = {
+	"",
+	"abcabc ababc acbcabc abab",
+	"#include <vector>\n  # include \"x.h\"\n#include\n x #include\n",
+	"if (x) return y; else while (1) for (;;);   \n",
+	"elsif else iffy if\tfor\nwhile",
+	"xxxy xy xxxxx y x+y 12.5 7 .5 3.",
+	"a1x b2x __c3x 9zx ab ac aab abb",
+	"\"abc\" \"a\\\"b\" \"unterminated /* x */ /* y",
+	"ababab abbab aab bab cbabab abz",
+	"aaa aab aaab b ab abb \"\"\"a\"",
+	"line one\nline two;\n;\n\n  \n",
+};
+
+/* The word delimiters SyntaxHighlighter sets up. */
+const char Delimiters[] = ".,/\\`'!|@#%^&*()-=+{}[]\":;<>?";
+
+struct Options {
+	bool verbose;
+};
+
+int failures = 0;
+int checks   = 0;
+
+//------------------------------------------------------------------------------
+// Name: compile
+// Desc: the compiled expression, NULL if it doesn't compile
+//------------------------------------------------------------------------------
+std::unique_ptr<Regex> compile(const std::string &pattern) {
+	try {
+		return std::unique_ptr<Regex>(new Regex(pattern.c_str(), REDFLT_STANDARD));
+	} catch (const RegexException &) {
+		return nullptr;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: captures
+// Desc: the match and captures of one forward search, in the form of
+//       Case::expected
+//------------------------------------------------------------------------------
+std::string captures(const Regex &regex, const std::string &text) {
+
+	std::unique_ptr<RegexMatch> match(regex.ExecRE(text.c_str(), nullptr, Direction::Forward, '\n', '\n', nullptr, nullptr, nullptr));
+	if (!match) {
+		return "none";
+	}
+
+	std::string result;
+
+	for (int i = 0; i < NSUBEXP; i++) {
+		const Capture cap = match->capture(i);
+		if (cap.start) {
+			char group[64];
+			snprintf(group, sizeof(group), "%s%d:%ld,%ld", result.empty() ? "" : " ", i, static_cast<long>(cap.start - text.c_str()), static_cast<long>(cap.end - text.c_str()));
+			result += group;
+		}
+	}
+
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// Name: matches
+// Desc: every match of a find all front to back, or of repeated find previous
+//       from the end, as "start,end" pairs
+//------------------------------------------------------------------------------
+std::string matches(const Regex &regex, const std::string &text, Direction direction) {
+
+	const char *const begin = text.c_str();
+	const char *const end   = begin + text.size();
+
+	std::string result;
+	char pair[64];
+
+	if (direction == Direction::Forward) {
+		const char *p = begin;
+		char prev     = '\n';
+
+		while (p <= end) {
+			std::unique_ptr<RegexMatch> match(regex.ExecRE(p, end, Direction::Forward, prev, '\0', nullptr, begin, nullptr));
+			if (!match || match->capture(0).start > end) {
+				break;
+			}
+
+			const Capture whole = match->capture(0);
+			snprintf(pair, sizeof(pair), " %ld,%ld", static_cast<long>(whole.start - begin), static_cast<long>(whole.end - begin));
+			result += pair;
+
+			// Don't find the same empty match again.
+			p = (whole.end != whole.start) ? whole.end : whole.end + 1;
+			if (p > end) {
+				break;
+			}
+
+			prev = p[-1];
+		}
+	} else {
+		const char *p = end;
+
+		while (p) {
+			std::unique_ptr<RegexMatch> match(regex.ExecRE(begin, p, Direction::Backward, '\n', '\0', nullptr, begin, end));
+			if (!match) {
+				break;
+			}
+
+			const Capture whole = match->capture(0);
+			snprintf(pair, sizeof(pair), " %ld,%ld", static_cast<long>(whole.start - begin), static_cast<long>(whole.end - begin));
+			result += pair;
+
+			p = (whole.start != begin) ? whole.start - 1 : nullptr;
+		}
+	}
+
+	return result.empty() ? "none" : result.substr(1);
+}
+
+//------------------------------------------------------------------------------
+// Name: check
+//------------------------------------------------------------------------------
+void check(const Options &options, const char *what, const std::string &pattern, const std::string &text, const std::string &got, const std::string &expected) {
+	++checks;
+
+	if (got != expected) {
+		++failures;
+		printf("FAIL %s: /%s/ on \"%s\"\n  got      %s\n  expected %s\n", what, pattern.c_str(), text.c_str(), got.c_str(), expected.c_str());
+	} else if (options.verbose) {
+		printf("ok   %s: /%s/ on \"%s\": %s\n", what, pattern.c_str(), text.c_str(), got.c_str());
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: knownCases
+//------------------------------------------------------------------------------
+void knownCases(const Options &options) {
+	for (const Case &c : KnownCases) {
+		std::unique_ptr<Regex> regex = compile(c.pattern);
+		if (!regex) {
+			check(options, "compile", c.pattern, c.text, "error", "ok");
+			continue;
+		}
+
+		regex->SetMemoization(Memoization::Off);
+		check(options, "case", c.pattern, c.text, captures(*regex, c.text), c.expected);
+
+		regex->SetMemoization(Memoization::Always);
+		check(options, "case, memoized", c.pattern, c.text, captures(*regex, c.text), c.expected);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: sameMatches
+// Desc: checks that two expressions find the same matches in every text
+//------------------------------------------------------------------------------
+void sameMatches(const Options &options, const char *what, const std::string &pattern, const std::string &reference) {
+
+	std::unique_ptr<Regex> regex = compile(pattern);
+	std::unique_ptr<Regex> other = compile(reference);
+
+	if (!regex || !other) {
+		check(options, "compile", regex ? reference : pattern, "", "error", "ok");
+		return;
+	}
+
+	for (const char *text : Texts) {
+		for (Direction direction : { Direction::Forward, Direction::Backward }) {
+			const std::string name = std::string(what) + ((direction == Direction::Forward) ? ", forward" : ", backward");
+			check(options, name.c_str(), pattern, text, matches(*regex, text, direction), matches(*other, text, direction));
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: generatedCorpus
+// Desc: checks that memoization doesn't change the captures of generated
+//       expressions. A fixed linear congruential generator keeps the corpus
+//       the same from run to run and platform to platform.
+//------------------------------------------------------------------------------
+void generatedCorpus(const Options &options) {
+
+	static const char *const atoms[] = {
+		"a", "b", "(a)", "(ab)", "(a|b)", "(a*)", "(b+)", "(\\w+?)", "((a|b)+)",
+		"(?=(a))", "(?=(b)a)", "(?!(a)b)", "(?=(a+)b)", "(?=a(b))", "(?=.*(c))",
+		"(?=(a|b)*c)", "(?!(a|b)+c)", "(?<=(a))", "(?<!(b))", "(?>(a|ab))", "|",
+	};
+
+	static const char *const quantifiers[] = { "", "", "*", "+", "?", "*?", "+?" };
+
+	unsigned long seed = 12345;
+	auto next = [&seed](unsigned long n) {
+		seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+		return (seed >> 8) % n;
+	};
+
+	const size_t nAtoms       = sizeof(atoms) / sizeof(atoms[0]);
+	const size_t nQuantifiers = sizeof(quantifiers) / sizeof(quantifiers[0]);
+
+	for (int i = 0; i < 3000; i++) {
+		std::string pattern;
+
+		for (unsigned long n = 1 + next(6); n > 0; --n) {
+			std::string atom = atoms[next(nAtoms)];
+			if (next(4) == 0) {
+				atom = "(" + atom + atoms[next(nAtoms)] + ")";
+			}
+			pattern += atom + quantifiers[next(nQuantifiers)];
+		}
+
+		std::string text;
+		for (unsigned long n = next(20); n > 0; --n) {
+			text += "abc"[next(3)];
+		}
+
+		std::unique_ptr<Regex> regex = compile(pattern);
+		if (!regex) {
+			continue;
+		}
+
+		regex->SetMemoization(Memoization::Off);
+		const std::string expected = captures(*regex, text);
+
+		regex->SetMemoization(Memoization::Always);
+		check(options, "memoized", pattern, text, captures(*regex, text), expected);
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	Options options = { false };
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--verbose") == 0) {
+			options.verbose = true;
+		} else {
+			fprintf(stderr, "usage: regex-regress [--verbose]\n");
+			return 1;
+		}
+	}
+
+	Regex::SetDefaultWordDelimiters(Delimiters);
+
+	knownCases(options);
+
+	for (const char *pattern : Prefiltered) {
+		sameMatches(options, "prefilter", pattern, std::string("(?!\\x01\\x01)(?:") + pattern + ")");
+	}
+
+	for (const Equivalent &e : Equivalents) {
+		sameMatches(options, "equivalent", e.pattern, e.reference);
+	}
+
+	generatedCorpus(options);
+
+	printf("%d checks, %d failed\n", checks, failures);
+	return (failures != 0) ? 1 : 0;
+}
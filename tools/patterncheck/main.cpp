@@ -0,0 +1,153 @@
+/*
+ * Highlight pattern checker: compiles the start, end and error expressions
+ * of a language definition file, or expressions given on the command line,
+ * and runs RegexAnalysis over each one. Expressions that can take
+ * exponential time, or more than n^max-degree steps per byte, are rejected;
+ * those above linear are reported. Expressions too large to analyse are
+ * rejected as well, unless --allow-unanalysed is given. The exit status is 1
+ * if any expression was rejected or failed to compile, so the checker can
+ * gate changes to the language definitions.
+ *
+ * usage: patterncheck [--max-degree n] [--allow-unanalysed] [-e expression]... [language file]...
+ */
+
+#include "regex/Regex.h"
+#include "regex/RegexAnalysis.h"
+#include "QJson4/QJsonArray.h"
+#include "QJson4/QJsonDocument.h"
+#include "QJson4/QJsonObject.h"
+#include "QJson4/QJsonParseError.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringList>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Expression {
+	QString where; // Pattern and field it came from.
+	QString source;
+};
+
+QString stringOf(const QJsonObject &obj, const char *key) {
+	if (obj.contains(key) && !obj[key].isNull()) {
+		return obj[key].toString();
+	}
+
+	return QString();
+}
+
+//------------------------------------------------------------------------------
+// Name: loadExpressions
+//------------------------------------------------------------------------------
+bool loadExpressions(const QString &filename, std::vector<Expression> *expressions) {
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		fprintf(stderr, "%s: can't open\n", qPrintable(filename));
+		return false;
+	}
+
+	QJsonParseError e;
+	QJsonDocument d = QJsonDocument::fromJson(file.readAll(), &e);
+	if (d.isNull()) {
+		fprintf(stderr, "%s: %s\n", qPrintable(filename), qPrintable(e.errorString()));
+		return false;
+	}
+
+	for (QJsonValue entry : d.array()) {
+		QJsonObject obj = entry.toObject();
+		const QString name = stringOf(obj, "name");
+
+		for (const char *field : { "start", "end", "error" }) {
+			const QString re = stringOf(obj, field);
+			if (!re.isNull()) {
+				expressions->push_back(Expression{ QString("%1: %2 %3").arg(filename, name, field), re });
+			}
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: check
+// Desc: reports on one expression, returns false if it is rejected
+//------------------------------------------------------------------------------
+bool check(const Expression &expression, int maxDegree, bool allowUnanalysed) {
+
+	const std::string source = expression.source.toStdString();
+
+	try {
+		Regex regex(source.c_str(), REDFLT_STANDARD);
+		const RegexCost cost = RegexAnalysis::Cost(regex);
+
+		if (!cost.analysed) {
+			printf("%s: %s, too complex to analyse\n", qPrintable(expression.where), allowUnanalysed ? "warning" : "REJECTED");
+			printf("    %s\n", source.c_str());
+			return allowUnanalysed;
+		}
+
+		const bool rejected = cost.exponential || cost.degree > maxDegree;
+
+		if (rejected || cost.degree > 1) {
+			printf("%s: %s\n", qPrintable(expression.where), rejected ? "REJECTED" : "warning");
+			printf("    %s\n", source.c_str());
+
+			for (const RegexHazard &hazard : cost.hazards) {
+				printf("    %s\n", hazard.description.c_str());
+			}
+		}
+
+		return !rejected;
+	} catch (const RegexException &e) {
+		printf("%s: REJECTED, %s\n", qPrintable(expression.where), e.what());
+		printf("    %s\n", source.c_str());
+		return false;
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+
+	int maxDegree = 2;
+	bool allowUnanalysed = false;
+	std::vector<Expression> expressions;
+	bool loaded = true;
+	bool sources = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--max-degree") == 0 && i + 1 < argc) {
+			maxDegree = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--allow-unanalysed") == 0) {
+			allowUnanalysed = true;
+		} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			++i;
+			sources = true;
+			expressions.push_back(Expression{ QString("-e %1").arg(expressions.size() + 1), QString::fromLocal8Bit(argv[i]) });
+		} else {
+			sources = true;
+			loaded = loadExpressions(QString::fromLocal8Bit(argv[i]), &expressions) && loaded;
+		}
+	}
+
+	if (!sources) {
+		loaded = loadExpressions(":/DefaultLanguages.json", &expressions);
+	}
+
+	size_t rejected = 0;
+	for (const Expression &expression : expressions) {
+		if (!check(expression, maxDegree, allowUnanalysed)) {
+			rejected++;
+		}
+	}
+
+	printf("%zu expressions, %zu rejected\n", expressions.size(), rejected);
+
+	return (rejected == 0 && loaded) ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+
+TEMPLATE = app
+TARGET = patterncheck
+DEPENDPATH  += . ../..
+INCLUDEPATH += . ../..
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../qmake/clean-objects.pri)
+include(../../qmake/c++11.pri)
+
+linux-g++ {
+    QMAKE_CXXFLAGS += -W -Wall -pedantic
+}
+
+*msvc* {
+    DEFINES += _CRT_SECURE_NO_WARNINGS _SCL_SECURE_NO_WARNINGS
+}
+
+HEADERS += \
+	../../regex/Regex.h \
+	../../regex/RegexMatch.h \
+	../../regex/RegexException.h \
+	../../regex/RegexCommon.h \
+	../../regex/RegexProfile.h \
+	../../regex/RegexAnalysis.h
+
+SOURCES += \
+	main.cpp \
+	../../regex/Regex.cpp \
+	../../regex/RegexMatch.cpp \
+	../../regex/RegexCommon.cpp \
+	../../regex/RegexProfile.cpp \
+	../../regex/RegexAnalysis.cpp \
+	../../QJson4/QJsonArray.cpp \
+	../../QJson4/QJsonDocument.cpp \
+	../../QJson4/QJsonObject.cpp \
+	../../QJson4/QJsonParseError.cpp \
+	../../QJson4/QJsonParser.cpp \
+	../../QJson4/QJsonValue.cpp \
+	../../QJson4/QJsonValueRef.cpp
+
+RESOURCES += \
+	../../NirvanaQt.qrc